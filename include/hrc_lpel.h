@@ -24,8 +24,118 @@ lpel_task_t *LpelTaskCreate( int worker, lpel_taskfunc_t func,
 
 /* initialise priority configuration */
 void LpelTaskPrioInit(lpel_task_prio_conf *conf) ;
+/* switch prio_index and neg_demand_lim while running */
+int LpelTaskPrioSwitch(lpel_task_prio_conf *conf);
+
+/**
+ * prio_index of the critical-path priority: the scheduler maintains the
+ * stream graph and prefers tasks close to the exit streams with many
+ * items downstream, see taskpriority.c
+ */
+#define LPEL_PRIO_CRITICAL_PATH   17
+
+/**
+ * prio_index of the priorities on the estimated work of the records, i.e.
+ * their number times the measured time per record of their consumer:
+ * difference and ratio of the work in the input and output streams
+ */
+#define LPEL_PRIO_WORK_BALANCE    18
+#define LPEL_PRIO_WORK_RATIO      19
 
 /* set the limit of output records for a task */
 void LpelTaskSetRecLimit(lpel_task_t *t, int lim);
 
+/**
+ * configure task prefetching, to be called before LpelStart()
+ * batch:  number of tasks the master assigns to a worker ahead,
+ *         including the running one, 1 to disable prefetching
+ * stale:  a prefetched task is returned to the master without running it,
+ *         if its priority dropped by more than stale meanwhile
+ */
+#define LPEL_PREFETCH_STALE_DEFAULT   1.0
+void LpelTaskPrefetchInit(int batch, double stale);
+
+/**
+ * configure cache-affine dispatch, to be called before LpelStart()
+ * tolerance:  a task with a priority lower than the head of the queue
+ *             by at most tolerance may be served first to a worker
+ *             which ran the task or its producers before
+ */
+#define LPEL_LOCALITY_TOLERANCE_DEFAULT   0.0
+void LpelTaskLocalityInit(double tolerance);
+
+/**
+ * configure a time-based quantum, to be called before LpelStart()
+ * slice_us:  a task yields once it ran for slice_us microseconds,
+ *            replacing the record limit; 0 keeps the record limit
+ *            Tasks with a negative record limit never yield.
+ * The clock is read only after a number of records, estimated per task
+ * from the measured cost per record.
+ */
+#define LPEL_TASK_SLICE_DEFAULT   0
+void LpelTaskSliceInit(int slice_us);
+
+/**
+ * distribution of the time tasks ran on the workers before they stopped,
+ * summed over all workers: bucket 0 counts slices below 1 us, bucket b
+ * slices of [2^(b-1), 2^b) us, the last bucket also the longer ones
+ */
+#define LPEL_SLICE_BUCKETS   20
+void LpelTaskSliceHistogram(unsigned long long *hist);
+
+/**
+ * Admission control of the entry tasks
+ * An entry task, i.e. one with only entry streams as input, is not
+ * scheduled while its output streams hold more items than its credit.
+ * Without the controller the credit is neg_demand_lim of the priority
+ * configuration. The optional controller, configured before LpelStart(),
+ * adapts the credit periodically: it is halved if the items in flight in
+ * the middle streams, or the end-to-end latency estimated from them and
+ * the rate of items written to exit streams, are above the target, and
+ * increased by one otherwise.
+ */
+typedef struct {
+  int interval;          /* period of the controller in ms, 0 disables it */
+  int target_inflight;   /* items in flight, 0 to hold target_latency instead */
+  int target_latency;    /* end-to-end latency in us */
+  int min_credit;        /* lower bound of the credit, at least 1 */
+  int max_credit;        /* upper bound of the credit, 0 for none */
+} lpel_admission_config_t;
+
+void LpelAdmissionInit(lpel_admission_config_t *conf);
+
+/**
+ * Bounded middle streams
+ * By default only entry streams are bounded. A middle stream with a
+ * capacity blocks its producer once it holds capacity items, and a task
+ * whose output streams are all full is not scheduled.
+ * LpelStreamCapacityInit() sets the capacity of the streams created
+ * afterwards, LpelStreamSetCapacity() the one of a single stream before
+ * it is written to. A capacity of 0 means unbounded.
+ */
+void LpelStreamCapacityInit(int capacity);
+void LpelStreamSetCapacity(lpel_stream_t *s, int capacity);
+
+/**
+ * Memory budget of the items in flight
+ * The items in the middle and exit streams are counted, in bytes as
+ * reported by the rec_size callback of the monitoring callbacks, or as
+ * items without it. Once the usage exceeds high * budget, the scheduler
+ * drains the network: entry tasks are not scheduled and, with dynamic
+ * priorities, the tasks with the most input items go first. Below
+ * low * budget the configured priority function is used again.
+ * To be called before LpelStart().
+ */
+typedef struct {
+  long budget;    /* bytes (or items) in flight, 0 disables the budget */
+  double high;    /* fraction of the budget to start draining */
+  double low;     /* fraction of the budget to stop draining */
+} lpel_memory_config_t;
+
+#define LPEL_MEMORY_HIGH_DEFAULT  0.9
+#define LPEL_MEMORY_LOW_DEFAULT   0.7
+
+void LpelMemoryBudgetInit(lpel_memory_config_t *conf);
+long LpelMemoryUsage(void);
+
 #endif /* _HRC_LPEL_H */
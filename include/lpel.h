@@ -9,6 +9,7 @@
 #ifndef _DECEN_LPEL_H_
 #define _DECEN_LPEL_H_
 
+#include <sys/types.h>
 #include <lpel_common.h>
 
 /* task migration mechanism */
@@ -18,11 +19,15 @@ typedef enum {
 	LPEL_MIG_WAIT_PROP,
 } lpel_tm_mechanism;
 
-/* task migration configuration */
+/* task migration configuration, zero it before filling it in:
+ * a negative cooldown is taken as 0, a distance cost outside [0, 1] as 0 */
 typedef struct {
   double threshold;
   int num_workers;
   lpel_tm_mechanism mechanism;
+  int cooldown;			/* number of migration checks a task stays after being migrated */
+  double dist_cost[3];	/* minimum gain to migrate to a worker on the same core,
+  											 * the same socket, a remote socket (see LPEL_HW_DIST_*) */
 } lpel_tm_config_t;
 
 lpel_task_t *LpelTaskCreate( int worker, lpel_taskfunc_t func, void *inarg, int stacksize );
@@ -32,6 +37,38 @@ lpel_task_t *LpelTaskCreate( int worker, lpel_taskfunc_t func, void *inarg, int
  */
 void LpelTaskSetPriority(lpel_task_t *t, int prio);
 
+/* priority inheritance along streams
+ * A task blocked on reading a stream lends its priority to the producer
+ * until the producer writes, transitively up to depth producers.
+ * depth: 0 (default) disables it
+ */
+void LpelTaskPrioInheritInit(int depth);
+
+/* task groups
+ * The groups with ready tasks share a worker in proportion to their
+ * weights, the priority of a task applies within its group.
+ * Tasks are in group 0 unless set otherwise.
+ */
+#define LPEL_GROUP_MAX             32
+#define LPEL_GROUP_WEIGHT_DEFAULT  1024
+
+int LpelTaskGroupSetWeight(int group, int weight);
+
+/* group: 0..LPEL_GROUP_MAX-1, effective the next time the task is ready */
+int LpelTaskSetGroup(lpel_task_t *t, int group);
+
+/* cpu time used by the tasks of a group on the workers, in usec */
+unsigned long long LpelTaskGroupUsage(int group);
+
+/* set the deadline of a task to ns from now, 0 for none
+ * Tasks with a deadline are scheduled earliest deadline first, before
+ * all groups. The records a task writes carry its deadline, a task
+ * reading a record inherits it if it is earlier than its own.
+ * A task which has missed its deadline when it becomes ready is
+ * scheduled in its group again, and its records carry no deadline.
+ */
+void LpelTaskSetDeadline(lpel_task_t *t, unsigned long long ns);
+
 /* get wid of a task */
 int LpelTaskGetWorkerId(lpel_task_t *t);
 
@@ -40,11 +77,85 @@ int LpelTaskGetWorkerId(lpel_task_t *t);
 /******************************************************************************/
 typedef void (*lpel_spmdfunc_t)(void *);
 int LpelSpmdVId(void);
+int LpelSpmdSize(void);
 
 /** enter SPMD request */
 void LpelTaskEnterSPMD(lpel_spmdfunc_t, void *);
 
+/** enter SPMD request on a team of workers
+ * count: size of the team, if wids is NULL the workers are chosen
+ *        among idle and close workers
+ * wids:  ids of the workers of the team (count entries) or NULL
+ * returns the size of the team
+ */
+int LpelTaskEnterSPMDTeam(int count, const int *wids, lpel_spmdfunc_t, void *);
+
 void LpelTaskMigrationInit(lpel_tm_config_t *conf);
 
+/******************************************************************************/
+/*  TIMEOUT FUNCTIONS                                                         */
+/******************************************************************************/
+
+/* suspend the current task for ns nanoseconds, without blocking the worker */
+void LpelTaskSleep(unsigned long long ns);
+
+/* like LpelStreamRead/LpelStreamPoll, but return NULL after ns nanoseconds
+ * if nothing arrived in the meantime
+ */
+void *LpelStreamReadTimeout(lpel_stream_desc_t *sd, unsigned long long ns);
+lpel_stream_desc_t *LpelStreamPollTimeout(lpel_streamset_t *set,
+    unsigned long long ns);
+
+/******************************************************************************/
+/*  I/O FUNCTIONS                                                             */
+/******************************************************************************/
+
+/* wait until fd is ready for events (POLLIN, POLLOUT),
+ * returns the ready events or -1 on error
+ * a task on a worker is blocked instead of the worker
+ */
+int LpelTaskWaitFd(int fd, int events);
+
+/* read/write on a non-blocking fd, wait for the fd if it is not ready */
+ssize_t LpelFdRead(int fd, void *buf, size_t count);
+ssize_t LpelFdWrite(int fd, const void *buf, size_t count);
+
+
+/******************************************************************************/
+/*  SEMAPHORE FUNCTIONS                                                       */
+/******************************************************************************/
+
+/**
+ * Counting semaphores and barriers
+ * Waiting tasks are blocked and woken up by the signalling task.
+ * spin: time in usec to spin before blocking, 0 = block immediately
+ */
+typedef struct {
+  volatile int lock;
+  volatile int count;
+  int spin;
+  lpel_task_t *head, *tail;  /* blocked tasks */
+} lpel_sema_t;
+
+typedef struct {
+  volatile int lock;
+  int count;        /* number of tasks to wait for */
+  int arrived;
+  volatile unsigned int phase;
+  int spin;
+  lpel_task_t *head, *tail;  /* blocked tasks */
+} lpel_barrier_t;
+
+void LpelSemaInit(lpel_sema_t *sem, int value, int spin);
+void LpelSemaDestroy(lpel_sema_t *sem);
+void LpelSemaWait(lpel_sema_t *sem);
+int  LpelSemaTryWait(lpel_sema_t *sem);
+void LpelSemaPost(lpel_sema_t *sem);
+
+void LpelBarrierInit(lpel_barrier_t *bar, int count, int spin);
+void LpelBarrierDestroy(lpel_barrier_t *bar);
+/* returns 1 for the last task to arrive, 0 for the others */
+int  LpelBarrierWait(lpel_barrier_t *bar);
+
 
 #endif /* _DECEN_LPEL_H */
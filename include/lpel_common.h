@@ -47,6 +47,7 @@ typedef char lpel_taskstate_t;
 #define LPEL_FLAG_NONE           (0)
 #define LPEL_FLAG_PINNED      (1<<0)
 #define LPEL_FLAG_EXCLUSIVE   (1<<1)
+#define LPEL_FLAG_MASTERLESS  (1<<2)
 
 /******************************************************************************/
 /*  GENERAL CONFIGURATION AND SETUP                                           */
@@ -82,6 +83,8 @@ typedef struct lpel_monitoring_cb_t {
   int (*worker_most_wait_prop)(void);
   double (*get_global_wait_prop)(void);
   double (*get_worker_wait_prop) (mon_task_t *);
+  void (*worker_migstat)(mon_worker_t*, unsigned long, unsigned long);
+  void (*worker_groupstat)(mon_worker_t*, int, unsigned long long);  /* group, usec */
 
   /* stream callbacks */
   mon_stream_t *(*stream_open)(mon_task_t*, unsigned int, char);
@@ -97,6 +100,7 @@ typedef struct lpel_monitoring_cb_t {
   /* record callbacks
    * currently used for hrc only */
   int (*rectype_data)(void *);
+  long (*rec_size)(void *);     /* bytes of an item, for the memory budget */
 
 } lpel_monitoring_cb_t;
 
@@ -140,7 +144,15 @@ typedef struct {
  *   REALTIME - set realtime priority for workers, will succeed only if
  *              there is a 1:1 mapping of workers to procs,
  *              proc_others > 0 and the process has needed privileges.
+ *   MASTERLESS (hrc only) - no master, the workers push and pop the ready
+ *              tasks to/from a shared relaxed priority queue.
+ * num_domains (hrc only) splits the workers into scheduling domains,
+ *   each served by its own sub-master on the first core of the domain.
+ *   0 or 1 for a single master, LPEL_HRC_DOMAINS_SOCKET for a domain
+ *   per socket.
  */
+#define LPEL_HRC_DOMAINS_SOCKET   (-1)
+
 typedef struct {
   int num_workers;
   int proc_workers;
@@ -151,6 +163,8 @@ typedef struct {
 
   /* priority configuration */
   lpel_task_prio_conf prio_config;
+
+  int num_domains;
 } lpel_config_t;
 
 
@@ -200,6 +214,40 @@ typedef struct lpel_stream_iter_t    lpel_stream_iter_t;
 /** return the total number of workers (including master if in lpel_hrc) */
 int LpelWorkerCount(void);
 
+/**
+ * configure the pool of wrapper threads, to be called before LpelStart()
+ * min:  number of wrapper threads spawned at start
+ * max:  maximum number of idle wrapper threads kept for reuse
+ */
+#define LPEL_WRAPPER_POOL_MAX_DEFAULT   16
+void LpelWrapperPoolInit(int min, int max);
+
+/**
+ * Elastic worker set
+ * The configured number of workers is the maximum, LpelWorkersResize(n)
+ * retires workers n, n+1, ... or activates them again. Retired workers
+ * hand their tasks to the active workers and sleep on their mailbox.
+ *
+ * The optional controller, configured before LpelStart(), resizes the set
+ * periodically by one worker according to the idle ratio of the active
+ * workers.
+ */
+typedef struct {
+  int min_workers;      /* lower bound for the controller, at least 1 */
+  int max_workers;      /* upper bound for the controller, 0 for all */
+  int interval;         /* period of the controller in ms, 0 disables it */
+  double shrink_idle;   /* retire a worker if the idle ratio is above */
+  double grow_idle;     /* activate a worker if the idle ratio is below */
+} lpel_resize_config_t;
+
+#define LPEL_RESIZE_SHRINK_IDLE_DEFAULT  0.5
+#define LPEL_RESIZE_GROW_IDLE_DEFAULT    0.1
+
+void LpelWorkersResizeInit(lpel_resize_config_t *conf);
+/** returns the number of active workers after resizing */
+int LpelWorkersResize(int n);
+int LpelWorkersActive(void);
+
 
 /******************************************************************************/
 /*  TASK FUNCTIONS                                                            */
@@ -45,6 +45,12 @@ struct mon_worker_t {
 	unsigned int wait_cnt;
 	lpel_timing_t wait_time;
 	lpel_timing_t exec_time;
+	unsigned long mig_cnt;			/** tasks migrated away from this worker */
+	unsigned long mig_rejected;	/** migrations rejected by the cost model */
+	struct {
+		int num;
+		unsigned long long *usec;
+	} groups;         /** cpu time of the task groups */
 	struct {
 		int cnt, size;
 		mon_usrevt_t *buffer;
@@ -352,6 +358,10 @@ static mon_worker_t *MonCbWorkerCreate( int wid)
 	/* statistic info */
 	mon->wait_cnt = 0;
 	LpelTimingZero(&mon->wait_time);
+	mon->mig_cnt = 0;
+	mon->mig_rejected = 0;
+	mon->groups.num = 0;
+	mon->groups.usec = NULL;
 
 	/* user events */
 	mon->events.cnt = 0;
@@ -400,6 +410,10 @@ static mon_worker_t *MonCbWrapperCreate( mon_task_t *mt)
 	/* default values */
 	mon->disp = 0;
 	LpelTimingZero(&mon->wait_current);
+	mon->mig_cnt = 0;
+	mon->mig_rejected = 0;
+	mon->groups.num = 0;
+	mon->groups.usec = NULL;
 
 	/* user events */
 	mon->events.size = 0;
@@ -423,9 +437,41 @@ static mon_worker_t *MonCbWrapperCreate( mon_task_t *mt)
 
 
 static void printStatistic(mon_worker_t *mon){
+	int i;
 	fprintf(mon->outfile, "WC%dWT", mon->wait_cnt);
 	PrintTiming( &mon->wait_time, mon->outfile);
+	if (mon->mig_cnt > 0 || mon->mig_rejected > 0)
+		fprintf(mon->outfile, "MG%luMR%lu ", mon->mig_cnt, mon->mig_rejected);
+	for (i=0; i<mon->groups.num; i++) {
+		if (mon->groups.usec[i] > 0)
+			fprintf(mon->outfile, "G%dU%llu ", i, mon->groups.usec[i]);
+	}
+}
 
+/**
+ * Migration statistics of a worker, called before the worker is destroyed
+ */
+static void MonCbWorkerMigStat(mon_worker_t *mon, unsigned long migrated,
+		unsigned long rejected)
+{
+	mon->mig_cnt = migrated;
+	mon->mig_rejected = rejected;
+}
+
+/**
+ * CPU time of a task group on a worker, called before the worker is destroyed
+ */
+static void MonCbWorkerGroupStat(mon_worker_t *mon, int group,
+		unsigned long long usec)
+{
+	if (group >= mon->groups.num) {
+		int i;
+		mon->groups.usec = (unsigned long long *) realloc(mon->groups.usec,
+				(group + 1) * sizeof(unsigned long long));
+		for (i=mon->groups.num; i<=group; i++) mon->groups.usec[i] = 0;
+		mon->groups.num = group + 1;
+	}
+	mon->groups.usec[group] = usec;
 }
 /**
  * Destroy a monitoring context
@@ -459,6 +505,9 @@ static void MonCbWorkerDestroy( mon_worker_t *mon)
 	if ( mon->events.buffer != NULL) {
 		free(mon->events.buffer);
 	}
+	if ( mon->groups.usec != NULL) {
+		free(mon->groups.usec);
+	}
 
 	free( mon);
 }
@@ -773,6 +822,8 @@ void LpelMonInit(lpel_monitoring_cb_t *cb, unsigned long flags)
   cb->worker_destroy        = MonCbWorkerDestroy;
   cb->worker_waitstart      = MonCbWorkerWaitStart;
   cb->worker_waitstop       = MonCbWorkerWaitStop;
+  cb->worker_migstat        = MonCbWorkerMigStat;
+  cb->worker_groupstat      = MonCbWorkerGroupStat;
   //cb->worker_debug          = MonCbDebug;
   cb->task_destroy = MonCbTaskDestroy;
   cb->task_assign  = MonCbTaskAssign;
@@ -788,6 +839,7 @@ void LpelMonInit(lpel_monitoring_cb_t *cb, unsigned long flags)
   cb->stream_blockon      = MonCbStreamBlockon;
   cb->stream_wakeup       = MonCbStreamWakeup;
   cb->rectype_data				= MonCbRecTypeData;
+  cb->rec_size            = NULL;
 
 
   /* initialize timing */
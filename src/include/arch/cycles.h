@@ -0,0 +1,34 @@
+#ifndef _CYCLES_H_
+#define _CYCLES_H_
+
+/*
+ * Cheap timestamps for bounded spinning and fine-grained accounting.
+ * On x86 the time stamp counter is read, otherwise the monotonic clock
+ * in nanoseconds is used.
+ */
+
+#include <time.h>
+
+typedef unsigned long long lpel_cycles_t;
+
+/** number of cycles per microsecond, calibrated by LpelCyclesInit() */
+extern lpel_cycles_t _lpel_cycles_per_us;
+
+#define LPEL_US_TO_CYCLES(us)  ((lpel_cycles_t)(us) * _lpel_cycles_per_us)
+
+static inline lpel_cycles_t LpelCyclesNow(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((lpel_cycles_t) hi << 32) | lo;
+#else
+  struct timespec ts;
+  (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (lpel_cycles_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void LpelCyclesInit(void);
+
+#endif /* _CYCLES_H_ */
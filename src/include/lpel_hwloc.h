@@ -12,6 +12,17 @@ int LpelHwLocToWorker(lpel_hw_place_t place);
 lpel_hw_place_t LpelWorkerToHwLoc(int i);
 #endif
 
+/* distance classes between two cores, see LpelHwLocDistance() */
+#define LPEL_HW_DIST_CORE     0   /* same core (or same PU) */
+#define LPEL_HW_DIST_SOCKET   1   /* different core, same socket */
+#define LPEL_HW_DIST_REMOTE   2   /* different socket */
+#define LPEL_HW_DIST_NUM      3
+
+int LpelHwLocDistance(int core1, int core2);
+int LpelHwLocWorkerCore(int wid);
+int LpelHwLocWorkerDistance(int wid1, int wid2);
+int LpelHwLocSocket(int core);
+
 void LpelHwLocInit(lpel_config_t *cfg);
 int LpelHwLocCheckConfig(lpel_config_t *cfg);
 void LpelHwLocStart(lpel_config_t *cfg);
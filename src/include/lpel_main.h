@@ -41,5 +41,11 @@ void LpelWorkersCleanup( void);
 void LpelWorkersSpawn(void);
 void LpelWorkersTerminate(void);
 
+/* idle time of a worker (in cycles) since its start */
+unsigned long long LpelWorkerIdleCycles(int wid);
+
+void LpelResizeStart(void);
+void LpelResizeStop(void);
+
 
 #endif /* _LPELMAIN_H */
@@ -1,6 +1,7 @@
 #ifndef _MAILBOX_H_
 #define _MAILBOX_H_
 
+#include <time.h>
 #include "workermsg.h"
 
 typedef struct mailbox_t mailbox_t;
@@ -9,7 +10,13 @@ mailbox_t *LpelMailboxCreate(void);
 void LpelMailboxDestroy(mailbox_t *mbox);
 void LpelMailboxSend(mailbox_t *mbox, workermsg_t *msg);
 void LpelMailboxRecv(mailbox_t *mbox, workermsg_t *msg);
+int  LpelMailboxRecvTimeout(mailbox_t *mbox, workermsg_t *msg,
+                            const struct timespec *abstime);
 int  LpelMailboxHasIncoming(mailbox_t *mbox);
 
+int  LpelMailboxEventFd(mailbox_t *mbox);
+int  LpelMailboxPollStart(mailbox_t *mbox);
+void LpelMailboxPollStop(mailbox_t *mbox);
+
 
 #endif /* _MAILBOX_H_ */
@@ -14,6 +14,10 @@ typedef struct {
   union {
     lpel_task_t    *task;
     int            from_worker;
+    struct {
+      int domain;
+      int count;
+    } balance;
   } body;
 } workermsg_t;
 
@@ -135,7 +135,12 @@ int LpelHwLocCheckConfig(lpel_config_t *cfg)
 	  	if ( cfg->num_workers <= 0 ||  cfg->proc_workers <= 0 )
 	  		return LPEL_ERR_INVAL;
 	  } else if (cfg->type == HRC_LPEL) {
-	  	if ( cfg->num_workers <= 1 ||  cfg->proc_workers <= 0)
+	  	/* at least one worker besides the master */
+	  	int min = (cfg->flags & LPEL_FLAG_MASTERLESS) ? 1 : 2;
+	  	if ( cfg->num_workers < min ||  cfg->proc_workers <= 0)
+	  	  return LPEL_ERR_INVAL;
+	  	/* each domain needs a sub-master and a worker */
+	  	if ( min == 2 && cfg->num_domains > 1 && cfg->num_workers < 2*cfg->num_domains)
 	  	  return LPEL_ERR_INVAL;
 	  }
 
@@ -273,6 +278,66 @@ int LpelThreadAssign(int core)
   return 0;
 }
 
+/**
+ * Topological distance between two cores, see LpelHwLocWorkerCore()
+ *
+ * @return one of LPEL_HW_DIST_CORE, LPEL_HW_DIST_SOCKET, LPEL_HW_DIST_REMOTE
+ * @note without hwloc the socket layout is unknown, hence different cores
+ *       are always considered to share a socket
+ */
+int LpelHwLocDistance(int core1, int core2)
+{
+  if (core1 < 0 || core2 < 0) return LPEL_HW_DIST_SOCKET;
+  if (core1 == core2) return LPEL_HW_DIST_CORE;
+
+#ifdef HAVE_HWLOC
+  if (pu_count > 0) {
+    lpel_hw_place_t p1 = hw_places[core1 % pu_count];
+    lpel_hw_place_t p2 = hw_places[core2 % pu_count];
+    if (p1.socket != p2.socket) return LPEL_HW_DIST_REMOTE;
+    if (p1.core == p2.core) return LPEL_HW_DIST_CORE;
+  }
+#endif
+  return LPEL_HW_DIST_SOCKET;
+}
+
+/**
+ * Core a worker is bound to by LpelThreadAssign(),
+ * -1 if it is not bound to a single core
+ */
+int LpelHwLocWorkerCore(int wid)
+{
+  if (wid < 0) return -1;
+#ifdef HAVE_HWLOC
+  if (pu_count > 0) return wid % pu_count;
+#elif defined(HAVE_PTHREAD_SETAFFINITY_NP)
+  if ( LPEL_ICFG(LPEL_FLAG_PINNED) && proc_workers > 0) return wid % proc_workers;
+#endif
+  return -1;
+}
+
+/**
+ * Topological distance between two workers
+ */
+int LpelHwLocWorkerDistance(int wid1, int wid2)
+{
+  if (wid1 == wid2) return LPEL_HW_DIST_CORE;
+  return LpelHwLocDistance(LpelHwLocWorkerCore(wid1), LpelHwLocWorkerCore(wid2));
+}
+
+/**
+ * Socket of a core, 0 if unknown
+ */
+int LpelHwLocSocket(int core)
+{
+#ifdef HAVE_HWLOC
+  if (core >= 0 && pu_count > 0) return hw_places[core % pu_count].socket;
+#else
+  (void) core;
+#endif
+  return 0;
+}
+
 void LpelHwLocCleanup(void)
 {
 #ifdef HAVE_HWLOC
@@ -16,6 +16,7 @@
 #include <lpel_common.h>
 
 #include "arch/mctx.h"
+#include "arch/cycles.h"
 #include "lpel_hwloc.h"
 #include "lpelcfg.h"
 #include "lpel_main.h"
@@ -66,6 +67,9 @@ void LpelInit(lpel_config_t *cfg)
   /* Initialise hardware information for thread pinning */
   LpelHwLocInit(cfg);
 
+  /* calibrate the cycle counter for bounded spinning */
+  LpelCyclesInit();
+
 #ifdef USE_MCTX_PCL
   int res = co_thread_init();
   /* initialize machine context for main thread */
@@ -92,11 +96,15 @@ int LpelStart(lpel_config_t *cfg)
 
   LpelWorkersSpawn();
 
+  /* controller of the elastic worker set, if configured */
+  LpelResizeStart();
+
   return 0;
 }
 
 void LpelStop(void)
 {
+  LpelResizeStop();
   LpelWorkersTerminate();
 }
 
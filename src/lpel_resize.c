@@ -0,0 +1,139 @@
+/**
+ * Controller of the elastic worker set
+ *
+ * Periodically samples the idle time of the active workers and
+ * retires or activates one worker at a time.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <lpel_common.h>
+
+#include "arch/cycles.h"
+#include "lpel_main.h"
+
+
+static lpel_resize_config_t resize_conf = {
+  1, 0, 0, LPEL_RESIZE_SHRINK_IDLE_DEFAULT, LPEL_RESIZE_GROW_IDLE_DEFAULT
+};
+
+static pthread_t       ctrl_thread;
+static pthread_mutex_t ctrl_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  ctrl_cond;
+static int ctrl_running = 0;
+static int ctrl_stop = 0;
+
+
+/**
+ * Configure the controller, to be called before LpelStart()
+ */
+void LpelWorkersResizeInit(lpel_resize_config_t *conf)
+{
+  resize_conf = *conf;
+  if (resize_conf.min_workers < 1) resize_conf.min_workers = 1;
+  if (resize_conf.max_workers < 0) resize_conf.max_workers = 0;
+  if (resize_conf.interval < 0) resize_conf.interval = 0;
+  if (resize_conf.shrink_idle <= 0.0)
+    resize_conf.shrink_idle = LPEL_RESIZE_SHRINK_IDLE_DEFAULT;
+  if (resize_conf.grow_idle <= 0.0)
+    resize_conf.grow_idle = LPEL_RESIZE_GROW_IDLE_DEFAULT;
+}
+
+
+static void *ResizeThread(void *arg)
+{
+  int i, active;
+  int total = LpelWorkerCount();
+  int max = resize_conf.max_workers;
+  lpel_cycles_t *last, now, begin;
+  struct timespec ts;
+
+  (void) arg;
+  if (max <= 0 || max > total) max = total;
+  if (LpelWorkersActive() > max) (void) LpelWorkersResize(max);
+
+  last = (lpel_cycles_t *) malloc(total * sizeof(lpel_cycles_t));
+  for (i=0; i<total; i++) last[i] = LpelWorkerIdleCycles(i);
+  begin = LpelCyclesNow();
+
+  pthread_mutex_lock(&ctrl_lock);
+  (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+  while (!ctrl_stop) {
+    double idle = 0.0, ratio;
+
+    ts.tv_sec  += resize_conf.interval / 1000;
+    ts.tv_nsec += (resize_conf.interval % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+    }
+    while (!ctrl_stop &&
+        ETIMEDOUT != pthread_cond_timedwait(&ctrl_cond, &ctrl_lock, &ts));
+    if (ctrl_stop) break;
+
+    /* idle ratio of the active workers in the last period */
+    active = LpelWorkersActive();
+    now = LpelCyclesNow();
+    for (i=0; i<total; i++) {
+      lpel_cycles_t c = LpelWorkerIdleCycles(i);
+      if (i < active && c > last[i]) idle += (double)(c - last[i]);
+      last[i] = c;
+    }
+    ratio = idle / ((double)(now - begin) * active);
+    begin = now;
+
+    if (ratio > resize_conf.shrink_idle && active > resize_conf.min_workers) {
+      (void) LpelWorkersResize(active - 1);
+    } else if (ratio < resize_conf.grow_idle && active < max) {
+      (void) LpelWorkersResize(active + 1);
+    }
+  }
+  pthread_mutex_unlock(&ctrl_lock);
+
+  free(last);
+  return NULL;
+}
+
+
+/**
+ * Start the controller if configured, called in LpelStart()
+ */
+void LpelResizeStart(void)
+{
+  pthread_condattr_t attr;
+
+  if (resize_conf.interval == 0 || ctrl_running) return;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&ctrl_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  ctrl_stop = 0;
+  if (0 == pthread_create(&ctrl_thread, NULL, ResizeThread, NULL)) {
+    ctrl_running = 1;
+  } else {
+    pthread_cond_destroy(&ctrl_cond);
+  }
+}
+
+
+/**
+ * Stop the controller, called in LpelStop()
+ */
+void LpelResizeStop(void)
+{
+  if (!ctrl_running) return;
+
+  pthread_mutex_lock(&ctrl_lock);
+  ctrl_stop = 1;
+  pthread_cond_signal(&ctrl_cond);
+  pthread_mutex_unlock(&ctrl_lock);
+
+  (void) pthread_join(ctrl_thread, NULL);
+  pthread_cond_destroy(&ctrl_cond);
+  ctrl_running = 0;
+}
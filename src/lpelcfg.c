@@ -4,3 +4,6 @@
 /* Keep copy of the (checked) configuration provided at LpelInit() */
 lpel_config_t    _lpel_global_config;
 
+/* prio_config of the above unless switched while running */
+lpel_task_prio_conf * volatile _lpel_prio_config = &_lpel_global_config.prio_config;
+
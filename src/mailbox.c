@@ -1,9 +1,17 @@
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
 #include <pthread.h>
 #include <assert.h>
 #include "mailbox.h"
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
 
 /* mailbox structures */
 
@@ -18,6 +26,8 @@ struct mailbox_t {
   pthread_cond_t   notempty;
   mailbox_node_t  *list_free;
   mailbox_node_t  *list_inbox;
+  int              efd;       /* eventfd notified while polling, or -1 */
+  int              polling;   /* receiver waits on efd instead of notempty */
 };
 
 
@@ -65,12 +75,19 @@ static void PutFree( mailbox_t *mbox, mailbox_node_t *node)
 mailbox_t *LpelMailboxCreate(void)
 {
   mailbox_t *mbox = (mailbox_t *)malloc(sizeof(mailbox_t));
+  pthread_condattr_t attr;
 
   pthread_mutex_init( &mbox->lock_free,  NULL);
   pthread_mutex_init( &mbox->lock_inbox, NULL);
-  pthread_cond_init(  &mbox->notempty,   NULL);
+  /* timeouts of LpelMailboxRecvTimeout refer to the monotonic clock */
+  pthread_condattr_init( &attr);
+  pthread_condattr_setclock( &attr, CLOCK_MONOTONIC);
+  pthread_cond_init(  &mbox->notempty,   &attr);
+  pthread_condattr_destroy( &attr);
   mbox->list_free  = NULL;
   mbox->list_inbox = NULL;
+  mbox->efd = -1;
+  mbox->polling = 0;
 
   return mbox;
 }
@@ -105,6 +122,8 @@ void LpelMailboxDestroy( mailbox_t *mbox)
   }
   pthread_mutex_unlock( &mbox->lock_free);
 
+  if (mbox->efd >= 0) (void) close(mbox->efd);
+
   /* destroy sync primitives */
   pthread_mutex_destroy( &mbox->lock_free);
   pthread_mutex_destroy( &mbox->lock_inbox);
@@ -129,6 +148,10 @@ void LpelMailboxSend( mailbox_t *mbox, workermsg_t *msg)
     node->next = node; /* self-loop */
 
     pthread_cond_signal( &mbox->notempty);
+    if (mbox->polling) {
+      uint64_t one = 1;
+      (void) write(mbox->efd, &one, sizeof(one));
+    }
 
   } else {
     /* insert stream between last node=list_inbox
@@ -142,13 +165,34 @@ void LpelMailboxSend( mailbox_t *mbox, workermsg_t *msg)
 
 
 void LpelMailboxRecv( mailbox_t *mbox, workermsg_t *msg)
+{
+  (void) LpelMailboxRecvTimeout( mbox, msg, NULL);
+}
+
+
+/**
+ * Receive a message, wait at most until abstime
+ *
+ * @param abstime   absolute time of the monotonic clock,
+ *                  NULL to wait without timeout
+ * @return 0 if a message was received, -1 on timeout
+ */
+int LpelMailboxRecvTimeout( mailbox_t *mbox, workermsg_t *msg,
+    const struct timespec *abstime)
 {
   mailbox_node_t *node;
 
   /* get node from inbox */
   pthread_mutex_lock( &mbox->lock_inbox);
   while( mbox->list_inbox == NULL) {
+    if (abstime == NULL) {
       pthread_cond_wait( &mbox->notempty, &mbox->lock_inbox);
+    } else if (ETIMEDOUT == pthread_cond_timedwait(
+          &mbox->notempty, &mbox->lock_inbox, abstime)) {
+      if (mbox->list_inbox != NULL) break;
+      pthread_mutex_unlock( &mbox->lock_inbox);
+      return -1;
+    }
   }
 
   assert( mbox->list_inbox != NULL);
@@ -168,6 +212,7 @@ void LpelMailboxRecv( mailbox_t *mbox, workermsg_t *msg)
 
   /* put node into free pool */
   PutFree( mbox, node);
+  return 0;
 }
 
 /**
@@ -178,4 +223,51 @@ void LpelMailboxRecv( mailbox_t *mbox, workermsg_t *msg)
 int LpelMailboxHasIncoming( mailbox_t *mbox)
 {
   return ( mbox->list_inbox != NULL);
-}
\ No newline at end of file
+}
+
+/**
+ * Get an eventfd that becomes readable on incoming messages
+ * while the receiver is polling (see LpelMailboxPollStart)
+ * The eventfd is created on the first call.
+ *
+ * @return the eventfd, -1 if not supported
+ */
+int LpelMailboxEventFd( mailbox_t *mbox)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+  if (mbox->efd < 0) {
+    mbox->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  }
+#endif
+  return mbox->efd;
+}
+
+/**
+ * Announce that the receiver is going to wait on the eventfd
+ *
+ * @return 1 if the inbox is empty and the receiver may wait,
+ *         0 if there are incoming messages
+ */
+int LpelMailboxPollStart( mailbox_t *mbox)
+{
+  int empty;
+  assert(mbox->efd >= 0);
+  pthread_mutex_lock( &mbox->lock_inbox);
+  empty = (mbox->list_inbox == NULL);
+  mbox->polling = empty;
+  pthread_mutex_unlock( &mbox->lock_inbox);
+  return empty;
+}
+
+/**
+ * The receiver stopped waiting on the eventfd
+ */
+void LpelMailboxPollStop( mailbox_t *mbox)
+{
+  uint64_t cnt;
+  pthread_mutex_lock( &mbox->lock_inbox);
+  mbox->polling = 0;
+  pthread_mutex_unlock( &mbox->lock_inbox);
+  /* reset the eventfd */
+  (void) read(mbox->efd, &cnt, sizeof(cnt));
+}
@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "decen_reactor.h"
+
+#ifdef USE_REACTOR
+#include <sys/epoll.h>
+
+#define REACTOR_MAX_EVENTS  32
+
+/* errors and hangups are reported to every waiter of a fd */
+#define REACTOR_ALWAYS  (EPOLLERR | EPOLLHUP)
+
+/*
+ * A fd registered in the reactor, the tasks waiting on it are chained
+ * by wait_next; it is armed for the union of their events.
+ */
+typedef struct reactor_fd_t {
+  int fd;
+  lpel_task_t *waiters;
+  struct reactor_fd_t *next;
+} reactor_fd_t;
+
+struct reactor_t {
+  int epfd;
+  mailbox_t *mbox;   /* mailbox of the worker, notifies via its eventfd */
+  int num_waiting;   /* number of tasks waiting on a fd */
+  reactor_fd_t *fds; /* registered fds */
+};
+
+
+static int WaitersEvents(reactor_fd_t *rf)
+{
+  lpel_task_t *t;
+  int events = 0;
+  for (t = rf->waiters; t != NULL; t = t->wait_next) events |= t->wait_events;
+  return events;
+}
+
+/* (re-)arm rf for the events of its waiters */
+static int Arm(reactor_t *r, reactor_fd_t *rf, int op)
+{
+  struct epoll_event ev;
+  ev.events = WaitersEvents(rf) | EPOLLONESHOT;
+  ev.data.ptr = rf;
+  return epoll_ctl(r->epfd, op, rf->fd, &ev);
+}
+
+
+reactor_t *LpelReactorCreate(mailbox_t *mbox)
+{
+  struct epoll_event ev;
+  reactor_t *r;
+  int efd = LpelMailboxEventFd(mbox);
+  if (efd < 0) return NULL;
+
+  r = (reactor_t *) malloc(sizeof(reactor_t));
+  r->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (r->epfd < 0) {
+    free(r);
+    return NULL;
+  }
+  r->mbox = mbox;
+  r->num_waiting = 0;
+  r->fds = NULL;
+
+  /* the mailbox is identified by a NULL entry */
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  (void) epoll_ctl(r->epfd, EPOLL_CTL_ADD, efd, &ev);
+  return r;
+}
+
+
+void LpelReactorDestroy(reactor_t *r)
+{
+  assert(r->num_waiting == 0);
+  assert(r->fds == NULL);
+  (void) close(r->epfd);
+  free(r);
+}
+
+
+/**
+ * Register the interest of a task in events on fd
+ * The task has to block afterwards, it is woken up by LpelReactorPoll().
+ * Several tasks may wait on the same fd, each for its own events.
+ *
+ * @return 0 on success, -1 on error (errno is set)
+ */
+int LpelReactorAdd(reactor_t *r, lpel_task_t *t, int fd, int events)
+{
+  reactor_fd_t *rf;
+
+  t->wait_fd = fd;
+  t->wait_events = events;
+  t->wait_revents = 0;
+
+  for (rf = r->fds; rf != NULL && rf->fd != fd; rf = rf->next);
+  if (rf != NULL) {
+    t->wait_next = rf->waiters;
+    rf->waiters = t;
+    if (Arm(r, rf, EPOLL_CTL_MOD) != 0) {
+      rf->waiters = t->wait_next;
+      t->wait_next = NULL;
+      return -1;
+    }
+  } else {
+    rf = (reactor_fd_t *) malloc(sizeof(reactor_fd_t));
+    rf->fd = fd;
+    rf->waiters = t;
+    t->wait_next = NULL;
+    if (Arm(r, rf, EPOLL_CTL_ADD) != 0) {
+      free(rf);
+      return -1;
+    }
+    rf->next = r->fds;
+    r->fds = rf;
+  }
+  r->num_waiting++;
+  return 0;
+}
+
+
+int LpelReactorWaiting(reactor_t *r)
+{
+  return r->num_waiting;
+}
+
+
+/* wake up the waiters of rf interested in revents, re-arm it for the others */
+static void Dispatch(reactor_t *r, workerctx_t *wc, reactor_fd_t *rf, int revents)
+{
+  lpel_task_t **pt = &rf->waiters;
+  lpel_task_t *t;
+  reactor_fd_t **prf;
+
+  while ((t = *pt) != NULL) {
+    int ready = revents & (t->wait_events | REACTOR_ALWAYS);
+    if (ready == 0) {
+      pt = &t->wait_next;
+      continue;
+    }
+    *pt = t->wait_next;
+    t->wait_next = NULL;
+    t->wait_revents = ready;
+    r->num_waiting--;
+    LpelWorkerTaskWakeupLocal(wc, t);
+  }
+
+  if (rf->waiters != NULL) {
+    (void) Arm(r, rf, EPOLL_CTL_MOD);
+    return;
+  }
+  (void) epoll_ctl(r->epfd, EPOLL_CTL_DEL, rf->fd, NULL);
+  for (prf = &r->fds; *prf != rf; prf = &(*prf)->next);
+  *prf = rf->next;
+  free(rf);
+}
+
+
+/**
+ * Poll for events and wakeup the waiting tasks
+ * Wait until a fd is ready or a message arrives,
+ * at most timeout ms (-1 for no timeout, 0 to return immediately).
+ */
+void LpelReactorPoll(reactor_t *r, workerctx_t *wc, int timeout)
+{
+  struct epoll_event events[REACTOR_MAX_EVENTS];
+  int i, n;
+  int block = (timeout != 0);
+
+  if (block && !LpelMailboxPollStart(r->mbox)) {
+    /* there are incoming messages */
+    block = 0;
+    timeout = 0;
+  }
+
+  do {
+    n = epoll_wait(r->epfd, events, REACTOR_MAX_EVENTS, timeout);
+  } while (n < 0 && errno == EINTR);
+
+  if (block) LpelMailboxPollStop(r->mbox);
+
+  for (i=0; i<n; i++) {
+    reactor_fd_t *rf = (reactor_fd_t *) events[i].data.ptr;
+    if (rf == NULL) continue;  /* mailbox */
+    Dispatch(r, wc, rf, events[i].events);
+  }
+}
+
+#else /* USE_REACTOR */
+
+reactor_t *LpelReactorCreate(mailbox_t *mbox) { return NULL; }
+void LpelReactorDestroy(reactor_t *r) {}
+int  LpelReactorAdd(reactor_t *r, lpel_task_t *t, int fd, int events) { return -1; }
+int  LpelReactorWaiting(reactor_t *r) { return 0; }
+void LpelReactorPoll(reactor_t *r, workerctx_t *wc, int timeout) {}
+
+#endif /* USE_REACTOR */
@@ -0,0 +1,27 @@
+#ifndef _DECEN_REACTOR_H_
+#define _DECEN_REACTOR_H_
+
+#include <lpel.h>
+#include "decen_task.h"
+#include "decen_worker.h"
+
+/*
+ * Per-worker I/O reactor: tasks waiting on file descriptors are
+ * blocked and woken up by their worker, which polls the reactor
+ * together with its mailbox.
+ */
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+#define USE_REACTOR
+#endif
+
+typedef struct reactor_t reactor_t;
+
+reactor_t *LpelReactorCreate(mailbox_t *mbox);
+void LpelReactorDestroy(reactor_t *r);
+
+int  LpelReactorAdd(reactor_t *r, lpel_task_t *t, int fd, int events);
+int  LpelReactorWaiting(reactor_t *r);
+void LpelReactorPoll(reactor_t *r, workerctx_t *wc, int timeout);
+
+#endif /* _DECEN_REACTOR_H_ */
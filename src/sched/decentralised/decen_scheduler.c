@@ -8,58 +8,294 @@
 #include "decen_taskqueue.h"
 #include "decen_task.h"
 #include "task_migration.h"
+#include "decen_timer.h"
 
 
+/*
+ * Tasks are organised in groups, each with a queue per priority.
+ * Among the groups with ready tasks, stride scheduling serves the one
+ * with the smallest pass. The pass of a group advances by the cycles its
+ * tasks ran, scaled by the inverse of its weight, so the groups share a
+ * worker in proportion to their weights. Within a group the highest
+ * priority is served first, unless a lower one has waited too long.
+ *
+ * Tasks with a deadline take precedence over all groups, they are kept
+ * in a min-heap and served earliest deadline first. A task which missed
+ * its deadline is back in its group, otherwise a pipeline which cannot
+ * keep up with its deadlines would take the worker from all groups.
+ */
+
+typedef struct {
+  taskqueue_t queue[SCHED_NUM_PRIO];
+  int skipped[SCHED_NUM_PRIO];  /* times passed over while ready */
+  int count;                    /* ready tasks */
+  lpel_cycles_t pass;           /* virtual time of the group */
+  lpel_cycles_t usage;          /* cycles used on this worker */
+} schedgroup_t;
+
+typedef struct {
+  uint64_t deadline;            /* of the task when it became ready */
+  lpel_task_t *task;
+} edfentry_t;
+
 struct schedctx_t {
-  taskqueue_t *queue[SCHED_NUM_PRIO];
+  schedgroup_t group[LPEL_GROUP_MAX];
+  unsigned int ready;           /* mask of the groups with ready tasks */
+  lpel_cycles_t vtime;          /* pass of the group served last */
+  edfentry_t *edf;              /* heap of the tasks with a deadline */
+  int edf_num, edf_size;
 };
 
 
+/* weights shared by all workers, 0 for the default */
+static volatile int group_weight[LPEL_GROUP_MAX];
+
+#define GROUP_WEIGHT(g) \
+  ((group_weight[g] > 0) ? group_weight[g] : LPEL_GROUP_WEIGHT_DEFAULT)
+
+
 schedctx_t *LpelSchedCreate( int wid)
 {
-  int i;
-  schedctx_t *sc = (schedctx_t *) malloc( sizeof(schedctx_t));
-  for (i=0; i<SCHED_NUM_PRIO; i++) {
-    sc->queue[i] = LpelTaskqueueInit(NULL);
-  }
+  /* empty queues and passes are all zero */
+  schedctx_t *sc = (schedctx_t *) calloc( 1, sizeof(schedctx_t));
+  sc->edf_size = 16;
+  sc->edf = (edfentry_t *) malloc( sc->edf_size * sizeof(edfentry_t));
   return sc;
 }
 
 
 void LpelSchedDestroy( schedctx_t *sc)
 {
-  int i;
-  for (i=0; i<SCHED_NUM_PRIO; i++) {
-    assert( sc->queue[i]->count == 0);
-    LpelTaskqueueDestroy(sc->queue[i]);
+  int g, i;
+  for (g=0; g<LPEL_GROUP_MAX; g++) {
+    for (i=0; i<SCHED_NUM_PRIO; i++) {
+      assert( sc->group[g].queue[i].count == 0);
+    }
   }
+  assert( sc->edf_num == 0);
 
+  free( sc->edf);
   free( sc);
 }
 
 
 
-void LpelSchedMakeReady( schedctx_t* sc, lpel_task_t *t)
+static void EdfPush( schedctx_t *sc, lpel_task_t *t)
 {
-  int prio = t->sched_info.prio;
+  edfentry_t e;
+  int i;
+
+  if (sc->edf_num == sc->edf_size) {
+    sc->edf_size *= 2;
+    sc->edf = (edfentry_t *) realloc( sc->edf, sc->edf_size * sizeof(edfentry_t));
+  }
+  e.deadline = t->sched_info.deadline;
+  e.task = t;
+
+  /* sift up */
+  for (i=sc->edf_num++; i>0 && sc->edf[(i-1)/2].deadline > e.deadline; i=(i-1)/2) {
+    sc->edf[i] = sc->edf[(i-1)/2];
+  }
+  sc->edf[i] = e;
+}
+
 
+static lpel_task_t *EdfPop( schedctx_t *sc)
+{
+  lpel_task_t *t = sc->edf[0].task;
+  edfentry_t last = sc->edf[--sc->edf_num];
+  int i = 0, c;
+
+  /* sift down */
+  while ((c = 2*i + 1) < sc->edf_num) {
+    if (c+1 < sc->edf_num && sc->edf[c+1].deadline < sc->edf[c].deadline) c++;
+    if (last.deadline <= sc->edf[c].deadline) break;
+    sc->edf[i] = sc->edf[c];
+    i = c;
+  }
+  sc->edf[i] = last;
+  return t;
+}
+
+
+static inline int QueuePrio( lpel_task_t *t)
+{
+  int prio = SCHED_PRIO(t->sched_info);
   if (prio < 0) prio = 0;
   if (prio >= SCHED_NUM_PRIO) prio = SCHED_NUM_PRIO-1;
-  LpelTaskqueuePush( sc->queue[prio], t);
+  return prio;
+}
+
+
+/* remove the head of a queue of a group */
+static lpel_task_t *GroupPop( schedctx_t *sc, int gid, int prio)
+{
+  schedgroup_t *g = &sc->group[gid];
+  lpel_task_t *t = LpelTaskqueuePop( &g->queue[prio]);
+
+  /* a queue gains no credit for the time it was empty */
+  if (g->queue[prio].count == 0) g->skipped[prio] = 0;
+  if (--g->count == 0) sc->ready &= ~(1u << gid);
+  t->sched_info.qprio = -1;
+  return t;
+}
+
+
+void LpelSchedMakeReady( schedctx_t* sc, lpel_task_t *t)
+{
+  int prio = QueuePrio( t);
+  int gid = t->sched_info.group;
+  schedgroup_t *g = &sc->group[gid];
+
+  if (t->sched_info.deadline != 0) {
+    uint64_t now = LpelTimerNow();
+    if (t->sched_info.deadline > now) {
+      t->sched_info.qprio = -1;
+      EdfPush( sc, t);
+      return;
+    }
+    /* missed, the records it writes carry no deadline either */
+    if (t->sched_info.own_deadline <= now) t->sched_info.own_deadline = 0;
+    t->sched_info.deadline = 0;
+  }
+
+  if (g->count++ == 0) {
+    /* an idle group does not gain credit for the time it was idle */
+    if (g->pass < sc->vtime) g->pass = sc->vtime;
+    sc->ready |= 1u << gid;
+  }
+  t->sched_info.qgroup = gid;
+  t->sched_info.qprio = prio;
+  LpelTaskqueuePush( &g->queue[prio], t);
 }
 
 
 lpel_task_t *LpelSchedFetchReady( schedctx_t *sc)
 {
-  lpel_task_t *t = NULL;
-  int i;
+  schedgroup_t *g = NULL;
+  unsigned int mask = sc->ready;
+  int gid = -1;
+  int i, top = -1, pick;
+
+  if (sc->edf_num > 0) return EdfPop( sc);
+  if (mask == 0) return NULL;
+
+  /* group with the smallest pass */
+  while (mask != 0) {
+    int j = __builtin_ctz(mask);
+    mask &= mask - 1;
+    if (g == NULL || sc->group[j].pass < g->pass) {
+      g = &sc->group[j];
+      gid = j;
+    }
+  }
+  sc->vtime = g->pass;
+
+  /* highest priority, or a lower one that has aged enough */
   for (i=SCHED_NUM_PRIO-1; i>=0; i--) {
-    if (sc->queue[i]->count > 0) {
-      t = LpelTaskqueuePop( sc->queue[i]);
+    if (g->queue[i].count > 0) {
+      top = i;
       break;
     }
   }
+  pick = top;
+  for (i=top-1; i>=0; i--) {
+    if (g->queue[i].count > 0 && g->skipped[i] >= SCHED_AGING_LIMIT) {
+      pick = i;
+      break;
+    }
+  }
+  for (i=0; i<pick; i++) {
+    if (g->queue[i].count > 0) g->skipped[i]++;
+  }
+  g->skipped[pick] = 0;
 
-  return t;
+  return GroupPop( sc, gid, pick);
+}
+
+
+/**
+ * Take any ready task, e.g. to hand it to another worker
+ * Unlike LpelSchedFetchReady(), the virtual time and the aging of the
+ * queues are left as they are, as the task does not run here.
+ */
+lpel_task_t *LpelSchedTakeReady( schedctx_t *sc)
+{
+  int gid, i;
+
+  if (sc->edf_num > 0) return EdfPop( sc);
+  if (sc->ready == 0) return NULL;
+
+  gid = __builtin_ctz(sc->ready);
+  for (i=0; sc->group[gid].queue[i].count == 0; i++);
+  return GroupPop( sc, gid, i);
 }
 
+
+int LpelSchedNumReady( schedctx_t *sc)
+{
+  int g, n = sc->edf_num;
+  for (g=0; g<LPEL_GROUP_MAX; g++) {
+    n += sc->group[g].count;
+  }
+  return n;
+}
+
+
+/**
+ * Move a ready task to the queue of its current priority,
+ * e.g. after it has inherited a higher one
+ *
+ * @pre   t is not queued on another worker
+ */
+void LpelSchedRequeue( schedctx_t *sc, lpel_task_t *t)
+{
+  int gid = t->sched_info.qgroup;
+  schedgroup_t *g = &sc->group[gid];
+
+  /* not ready, or scheduled by deadline */
+  if (t->sched_info.qprio < 0) return;
+  if (t->sched_info.qprio == QueuePrio( t)) return;
+
+  LpelTaskqueueRemove( &g->queue[t->sched_info.qprio], t);
+  if (g->queue[t->sched_info.qprio].count == 0) g->skipped[t->sched_info.qprio] = 0;
+  if (--g->count == 0) sc->ready &= ~(1u << gid);
+  LpelSchedMakeReady( sc, t);
+}
+
+
+/**
+ * Charge the cycles a task has run to its group
+ */
+void LpelSchedAccount( schedctx_t *sc, lpel_task_t *t, lpel_cycles_t cycles)
+{
+  int gid = t->sched_info.group;
+  schedgroup_t *g = &sc->group[gid];
+
+  g->usage += cycles;
+  g->pass += cycles * LPEL_GROUP_WEIGHT_DEFAULT / GROUP_WEIGHT(gid);
+}
+
+
+/**
+ * Cycles used by a group on this worker
+ */
+lpel_cycles_t LpelSchedGroupUsage( schedctx_t *sc, int group)
+{
+  return sc->group[group].usage;
+}
+
+
+/**
+ * Set the weight of a task group
+ * The groups ready on a worker share it in proportion to their weights.
+ *
+ * @return LPEL_ERR_INVAL for an invalid group or weight
+ */
+int LpelTaskGroupSetWeight(int group, int weight)
+{
+  if (group < 0 || group >= LPEL_GROUP_MAX || weight <= 0)
+    return LPEL_ERR_INVAL;
+  group_weight[group] = weight;
+  return 0;
+}
@@ -1,22 +1,44 @@
 #ifndef _DECEN_SCHEDULER_H_
 #define _DECEN_SCHEDULER_H_
 
+#include <stdint.h>
 #include "lpel.h"
+#include "arch/cycles.h"
 
 #define SCHED_NUM_PRIO  2
 
+/* a ready lower priority is served after being passed over this often */
+#define SCHED_AGING_LIMIT  8
+
 typedef struct schedctx_t schedctx_t;
 
 typedef struct {
   int prio;
+  int boost;              /* inherited priority, removed on the next write,
+                           * see LpelTaskInheritPrio() */
+  int qgroup, qprio;      /* ready queue of the task, qprio -1 if none */
+  int group;              /* task group, see LpelTaskSetGroup() */
+  uint64_t deadline;      /* effective deadline (LpelTimerNow), 0 if none */
+  uint64_t own_deadline;  /* set by LpelTaskSetDeadline() */
+  lpel_cycles_t start;    /* begin of the current run, for the group accounting */
+  int mig_cooldown;		/* remaining migration checks before the task may move again */
 } sched_task_t;
 
+/* effective priority, including an inherited one */
+#define SCHED_PRIO(si)  (((si).boost > (si).prio) ? (si).boost : (si).prio)
+
 
 schedctx_t *LpelSchedCreate( int wid);
 void LpelSchedDestroy( schedctx_t *sc);
 
 void LpelSchedMakeReady( schedctx_t* sc, lpel_task_t *t);
 struct lpel_task_t *LpelSchedFetchReady( schedctx_t *sc);
+struct lpel_task_t *LpelSchedTakeReady( schedctx_t *sc);
+int LpelSchedNumReady( schedctx_t *sc);
+void LpelSchedRequeue( schedctx_t *sc, lpel_task_t *t);
+
+void LpelSchedAccount( schedctx_t *sc, lpel_task_t *t, lpel_cycles_t cycles);
+lpel_cycles_t LpelSchedGroupUsage( schedctx_t *sc, int group);
 
 
 
@@ -8,6 +8,7 @@
 #include "arch/atomic.h"
 #include "lpelcfg.h"
 #include "decen_task.h"
+#include "decen_worker.h"
 
 #include "decen_stream.h"
 #include "lpel/monitor.h"
@@ -39,6 +40,7 @@ lpel_stream_t *LpelStreamCreate(int size)
 
   /* reset buffer (including buffer area) */
   LpelBufferInit(&s->buffer, size);
+  s->deadline = (uint64_t *) calloc( size, sizeof(uint64_t));
 
   s->uid = atomic_fetch_add( &stream_seq, 1);
   PRODLOCK_INIT( &s->prod_lock );
@@ -67,6 +69,7 @@ void LpelStreamDestroy( lpel_stream_t *s)
   atomic_destroy( &s->n_sem);
   atomic_destroy( &s->e_sem);
   LpelBufferCleanup( &s->buffer);
+  free( s->deadline);
   free( s);
 }
 
@@ -116,6 +119,8 @@ void LpelStreamWrite( lpel_stream_desc_t *sd, void *item)
   {
     /* there must be space now in buffer */
     assert( LpelBufferIsSpace( &sd->stream->buffer) );
+    /* the item carries the deadline of the writer */
+    sd->stream->deadline[sd->stream->buffer.pwrite] = self->sched_info.deadline;
     /* put item into buffer */
     LpelBufferPut( &sd->stream->buffer, item);
 
@@ -133,6 +138,8 @@ void LpelStreamWrite( lpel_stream_desc_t *sd, void *item)
   if ( atomic_fetch_add( &sd->stream->n_sem, 1) < 0) {
     /* n_sem was -1 */
     lpel_task_t *cons = sd->stream->cons_sd->task;
+    /* the consumer reads this item next */
+    LpelTaskInheritDeadline( cons, self->sched_info.deadline);
     /* wakeup consumer: make ready */
     LpelTaskUnblock( self, cons);
 
@@ -147,6 +154,7 @@ void LpelStreamWrite( lpel_stream_desc_t *sd, void *item)
     if (poll_wakeup) {
       lpel_task_t *cons = sd->stream->cons_sd->task;
       cons->wakeup_sd = sd->stream->cons_sd;
+      LpelTaskInheritDeadline( cons, self->sched_info.deadline);
 
       LpelTaskUnblock( self, cons);
 
@@ -159,6 +167,10 @@ void LpelStreamWrite( lpel_stream_desc_t *sd, void *item)
     }
   }
 
+  /* an inherited priority lasts until the next write, without the lock,
+   * see LpelTaskInheritPrio() */
+  self->sched_info.boost = 0;
+
   /* MONITORING CALLBACK */
 #ifdef USE_TASK_EVENT_LOGGING
   if (sd->mon && MON_CB(stream_writefinish)) {
@@ -188,19 +200,33 @@ int LpelStreamTryWrite( lpel_stream_desc_t *sd, void *item)
 }
 
 /**
- * Blocking, consuming read from a stream
- *
- * If the stream is empty, the task is suspended until
- * a producer writes an item to the stream.
+ * Timeout of a read: take back the P(n_sem) if no producer
+ * has woken up the consumer in the meantime
  *
- * @param sd  stream descriptor
- * @return    the next item of the stream
- * @pre       current task is single reader
+ * @return 1 if the consumer has to be woken up by the timer
  */
-void *LpelStreamRead( lpel_stream_desc_t *sd)
+static int ReadExpire( lpel_task_t *t)
+{
+  lpel_stream_t *s = t->wakeup_sd->stream;
+  return atomic_test_and_set( &s->n_sem, -1, 0);
+}
+
+/**
+ * Timeout of a poll: the poll token is taken either by
+ * a producer or by the timer
+ */
+static int PollExpire( lpel_task_t *t)
+{
+  return atomic_exchange( &t->poll_token, 0);
+}
+
+
+static void *StreamRead( lpel_stream_desc_t *sd, int timed,
+    unsigned long long ns)
 {
   void *item;
   lpel_task_t *self = sd->task;
+  uint64_t deadline;
 
   assert( sd->mode == 'r');
 
@@ -221,16 +247,33 @@ void *LpelStreamRead( lpel_stream_desc_t *sd)
     }
 #endif
 
+    if (timed) {
+      self->wakeup_sd = sd;
+      LpelWorkerSelfTimeout( self, ns, ReadExpire);
+    }
+
+    /* the producer runs with at least the priority of self */
+    self->read_block = sd->stream;
+    LpelTaskInheritPrio( self, sd->stream);
+
     /* wait on stream: */
     LpelTaskBlockStream( self);
+    self->read_block = NULL;
+
+    if (timed && self->timed_out) {
+      /* nothing arrived, P(n_sem) has been taken back */
+      return NULL;
+    }
   }
 
 
   /* read the top element */
   item = LpelBufferTop( &sd->stream->buffer);
   assert( item != NULL);
+  deadline = sd->stream->deadline[sd->stream->buffer.pread];
   /* pop off the top element */
   LpelBufferPop( &sd->stream->buffer);
+  LpelTaskInheritDeadline( self, deadline);
 
 
   /* quasi V(e_sem) */
@@ -259,6 +302,39 @@ void *LpelStreamRead( lpel_stream_desc_t *sd)
 }
 
 
+/**
+ * Blocking, consuming read from a stream
+ *
+ * If the stream is empty, the task is suspended until
+ * a producer writes an item to the stream.
+ *
+ * @param sd  stream descriptor
+ * @return    the next item of the stream
+ * @pre       current task is single reader
+ */
+void *LpelStreamRead( lpel_stream_desc_t *sd)
+{
+  return StreamRead( sd, 0, 0);
+}
+
+
+/**
+ * Consuming read from a stream with timeout
+ *
+ * The task is suspended at most ns nanoseconds
+ * until a producer writes an item to the stream.
+ *
+ * @param sd  stream descriptor
+ * @param ns  timeout in nanoseconds
+ * @return    the next item of the stream, NULL on timeout
+ * @pre       current task is single reader
+ */
+void *LpelStreamReadTimeout( lpel_stream_desc_t *sd, unsigned long long ns)
+{
+  return StreamRead( sd, 1, ns);
+}
+
+
 /**
   * Open a stream for reading/writing
  *
@@ -317,6 +393,12 @@ void LpelStreamClose( lpel_stream_desc_t *sd, int destroy_s)
   }
 #endif
 
+  if (sd->mode == 'w') {
+    /* the producer is looked up for priority inheritance */
+    PRODLOCK_LOCK( &sd->stream->prod_lock);
+    if (sd->stream->prod_sd == sd) sd->stream->prod_sd = NULL;
+    PRODLOCK_UNLOCK( &sd->stream->prod_lock);
+  }
   if (destroy_s) {
     LpelStreamDestroy( sd->stream);
   }
@@ -401,26 +483,13 @@ void *LpelStreamPeek( lpel_stream_desc_t *sd)
 }
 
 
-/**
- * Poll a set of streams
- *
- * This is a blocking function called by a consumer which wants to wait
- * for arrival of data on any of a specified set of streams.
- * The consumer task is suspended while there is no new data on all streams.
- *
- * @param set     a stream descriptor set the task wants to poll
- * @pre           set must not be empty (*set != NULL)
- *
- * @post          The first element when iterating through the set after
- *                LpelStreamPoll() will be the one after the one which
- *                caused the task to wakeup,
- *                i.e., the first stream where data arrived.
- */
-lpel_stream_desc_t *LpelStreamPoll( lpel_streamset_t *set)
+static lpel_stream_desc_t *StreamPoll( lpel_streamset_t *set, int timed,
+    unsigned long long ns)
 {
   lpel_task_t *self;
   lpel_stream_iter_t *iter;
   int do_ctx_switch = 1;
+  int timed_out = 0;
   int cnt = 0;
 
   assert( *set != NULL);
@@ -486,8 +555,12 @@ lpel_stream_desc_t *LpelStreamPoll( lpel_streamset_t *set)
 
   /* context switch */
   if (do_ctx_switch) {
+    if (timed) {
+      LpelWorkerSelfTimeout( self, ns, PollExpire);
+    }
     /* set task as blocked */
     LpelTaskBlockStream( self);
+    timed_out = timed && self->timed_out;
   }
   assert( atomic_load( &self->poll_token) == 0);
 
@@ -513,12 +586,52 @@ lpel_stream_desc_t *LpelStreamPoll( lpel_streamset_t *set)
 
   LpelStreamIterDestroy(iter);
 
+  if (timed_out) return NULL;
+
   /* 'rotate' set to stream descriptor for non-empty buffer */
   *set = self->wakeup_sd;
 
   return self->wakeup_sd;
 }
 
+
+/**
+ * Poll a set of streams
+ *
+ * This is a blocking function called by a consumer which wants to wait
+ * for arrival of data on any of a specified set of streams.
+ * The consumer task is suspended while there is no new data on all streams.
+ *
+ * @param set     a stream descriptor set the task wants to poll
+ * @pre           set must not be empty (*set != NULL)
+ *
+ * @post          The first element when iterating through the set after
+ *                LpelStreamPoll() will be the one after the one which
+ *                caused the task to wakeup,
+ *                i.e., the first stream where data arrived.
+ */
+lpel_stream_desc_t *LpelStreamPoll( lpel_streamset_t *set)
+{
+  return StreamPoll( set, 0, 0);
+}
+
+
+/**
+ * Poll a set of streams with timeout
+ *
+ * Like LpelStreamPoll(), but the task is suspended at most ns nanoseconds.
+ *
+ * @param set     a stream descriptor set the task wants to poll
+ * @param ns      timeout in nanoseconds
+ * @return        the stream descriptor with new data, NULL on timeout,
+ *                the set is left unchanged in this case
+ */
+lpel_stream_desc_t *LpelStreamPollTimeout( lpel_streamset_t *set,
+    unsigned long long ns)
+{
+  return StreamPoll( set, 1, ns);
+}
+
 int LpelStreamGetId(lpel_stream_desc_t *sd) {
 	if (sd)
 		if (sd->stream)
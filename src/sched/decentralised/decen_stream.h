@@ -27,6 +27,7 @@ struct lpel_stream_t {
   lpel_stream_desc_t *cons_sd;   /** points to the sd of the consumer */
   atomic_int n_sem;           /** counter for elements in the stream */
   atomic_int e_sem;           /** counter for empty space in the stream */
+  uint64_t *deadline;       /** deadlines of the items, parallel to the buffer */
   void *usr_data;           /** arbitrary user data */
 };
 
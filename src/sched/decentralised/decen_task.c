@@ -1,4 +1,9 @@
+#include <stdlib.h>
 #include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
 #include <lpel.h>
 #include "lpelcfg.h"
 #include "decen_worker.h"
@@ -6,9 +11,12 @@
 #include "lpel/monitor.h"
 #include "decen_scheduler.h"
 #include "task_migration.h"
+#include "decen_reactor.h"
+#include "decen_stream.h"
 
 extern lpel_tm_config_t tm_conf;
 static atomic_int taskseq = ATOMIC_VAR_INIT(0);
+static int inherit_depth = 0;   /* priority inheritance disabled */
 
 static void FinishOffCurrentTask(lpel_task_t *ct);
 static void TaskStartup( void *arg);
@@ -51,6 +59,14 @@ lpel_task_t *LpelTaskCreate( int worker, lpel_taskfunc_t func,
 	t->worker_context = LpelWorkerGetContext(worker);
 
 	t->sched_info.prio = 0;
+	t->sched_info.boost = 0;
+	t->sched_info.qgroup = 0;
+	t->sched_info.qprio = -1;
+	t->sched_info.group = 0;
+	t->sched_info.deadline = 0;
+	t->sched_info.own_deadline = 0;
+	t->sched_info.start = 0;
+	t->sched_info.mig_cooldown = 0;
 
 	t->uid = atomic_fetch_add( &taskseq, 1);  /* obtain a unique task id */
 	t->func = func;
@@ -58,6 +74,16 @@ lpel_task_t *LpelTaskCreate( int worker, lpel_taskfunc_t func,
 
 	/* initialize poll token to 0 */
 	atomic_init( &t->poll_token, 0);
+	t->read_block = NULL;
+	t->wait_fd = -1;
+	t->wait_events = 0;
+	t->wait_revents = 0;
+	t->wait_next = NULL;
+	t->timer.next = NULL;
+	t->timer.pprev = NULL;
+	t->timer.task = t;
+	t->timer.expire = NULL;
+	t->timed_out = 0;
 
 	t->state = TASK_CREATED;
 
@@ -113,6 +139,102 @@ void LpelTaskSetPriority(lpel_task_t *t, int prio)
 	t->sched_info.prio = prio;
 }
 
+/**
+ * Set the task group of a task
+ * @param t				task
+ * @param group		group id, 0..LPEL_GROUP_MAX-1
+ * @return LPEL_ERR_INVAL for an invalid group
+ */
+int LpelTaskSetGroup(lpel_task_t *t, int group)
+{
+	if (group < 0 || group >= LPEL_GROUP_MAX) return LPEL_ERR_INVAL;
+	t->sched_info.group = group;
+	return 0;
+}
+
+/**
+ * Set the deadline of a task
+ * Overrides an inherited deadline until the task reads the next record.
+ * @param t				task
+ * @param ns			deadline in ns from now, 0 for none
+ */
+void LpelTaskSetDeadline(lpel_task_t *t, unsigned long long ns)
+{
+	t->sched_info.own_deadline = (ns > 0) ? LpelTimerNow() + ns : 0;
+	t->sched_info.deadline = t->sched_info.own_deadline;
+}
+
+/**
+ * Inherit the deadline of a record, the earlier one of the own
+ * deadline and the deadline of the record is effective
+ * @param t				task reading the record
+ * @param deadline	deadline of the record, 0 if none
+ */
+void LpelTaskInheritDeadline(lpel_task_t *t, uint64_t deadline)
+{
+	uint64_t own = t->sched_info.own_deadline;
+	if (own != 0 && (deadline == 0 || own < deadline)) deadline = own;
+	t->sched_info.deadline = deadline;
+}
+
+
+/**
+ * Enable priority inheritance along streams
+ * @param depth		number of producers boosted transitively by a task
+ * 								blocked on reading, 0 to disable
+ */
+void LpelTaskPrioInheritInit(int depth)
+{
+	inherit_depth = (depth > 0) ? depth : 0;
+}
+
+/**
+ * Boost the producer of the stream a task is going to block on
+ * to the priority of the task, and transitively the producers
+ * the producer is blocked on.
+ *
+ * A producer on the same worker is moved to its new queue at once,
+ * as none of the tasks of the worker runs meanwhile the chain can
+ * be followed. A producer on another worker takes the boost into
+ * account the next time it becomes ready.
+ *
+ * The boost is set under the producer lock, but cleared by the producer
+ * without it. A boost set by a reader which is woken up by the same
+ * write lasts one write longer, one cleared right after being set was
+ * not needed as the write has woken the reader up.
+ *
+ * @param t				task blocking on s
+ * @param s				stream t is reading from
+ */
+void LpelTaskInheritPrio(lpel_task_t *t, lpel_stream_t *s)
+{
+	workerctx_t *wc = t->worker_context;
+	int prio = SCHED_PRIO(t->sched_info);
+	int d;
+
+	for (d=0; d<inherit_depth && s != NULL; d++) {
+		lpel_task_t *p = NULL;
+		int same = 0;
+
+		/* the producer closes its descriptor under the lock, a producer
+		 * on another worker may exit as soon as it is released
+		 */
+		PRODLOCK_LOCK( &s->prod_lock);
+		if (s->prod_sd != NULL && SCHED_PRIO(s->prod_sd->task->sched_info) < prio) {
+			p = s->prod_sd->task;
+			p->sched_info.boost = prio;
+			same = (p->worker_context == wc);
+		}
+		PRODLOCK_UNLOCK( &s->prod_lock);
+
+		if (!same || wc->sched == NULL) break;
+		if (p->state == TASK_READY) {
+			LpelSchedRequeue( wc->sched, p);
+		}
+		s = p->read_block;
+	}
+}
+
 
 /**
  * Let a task start
@@ -146,25 +268,139 @@ void LpelTaskExit(void)
  */
 void LpelTaskEnterSPMD( lpel_spmdfunc_t fun, void *arg)
 {
-	lpel_task_t *ct = LpelTaskSelf();
-	workermsg_t msg;
-	assert( ct->state == TASK_RUNNING );
+	(void) LpelTaskEnterSPMDTeam( 0, NULL, fun, arg);
+}
 
-	//FIXME conditional for availability?
 
-	/* world request */
-	LpelSpmdRequest(ct, fun, arg);
+/**
+ * Task issues an enter request for a team of workers
+ * Only the workers of the team execute fun, the others continue
+ * scheduling their tasks.
+ */
+int LpelTaskEnterSPMDTeam( int count, const int *wids,
+		lpel_spmdfunc_t fun, void *arg)
+{
+	lpel_task_t *ct = LpelTaskSelf();
+	int size;
+	assert( ct->state == TASK_RUNNING );
 
-	/* broadcast message */
-	msg.type = WORKER_MSG_SPMDREQ;
-	msg.body.from_worker = ct->worker_context->wid;
-	LpelWorkerBroadcast(&msg);
+	/* team request, all members are claimed at once */
+	while ((size = LpelSpmdRequest(ct, count, wids, fun, arg)) < 0) {
+		/* team not available, meanwhile serve other requests */
+		ct->state = TASK_READY;
+		LpelWorkerSelfTaskYield(ct);
+		TaskStop( ct);
+		LpelWorkerDispatcher( ct);
+		TaskStart( ct);
+	}
 
+	/* woken up by the worker after the team has left the spmd */
 	ct->state = TASK_BLOCKED;
-	/* TODO block on what? */
 	TaskStop( ct);
 	LpelWorkerDispatcher( ct);
 	TaskStart( ct);
+
+	return size;
+}
+
+
+/**
+ * Suspend the current task for (at least) ns nanoseconds
+ *
+ * The worker continues with other tasks in the meantime.
+ */
+void LpelTaskSleep(unsigned long long ns)
+{
+  lpel_task_t *ct = LpelTaskSelf();
+  assert( ct->state == TASK_RUNNING );
+
+  LpelWorkerSelfTimeout(ct, ns, NULL);
+  ct->state = TASK_BLOCKED;
+  TaskStop( ct);
+  LpelWorkerDispatcher( ct);
+  TaskStart( ct);
+}
+
+
+/**
+ * Wait until fd is ready for events (POLLIN, POLLOUT, see poll(2))
+ *
+ * On a worker the task is blocked and the worker continues with other
+ * tasks, it polls the fd in its I/O reactor. On a wrapper the thread blocks.
+ *
+ * @return the ready events, -1 on error (errno is set)
+ */
+int LpelTaskWaitFd(int fd, int events)
+{
+  lpel_task_t *ct = LpelTaskSelf();
+  workerctx_t *wc = ct->worker_context;
+  struct pollfd pfd;
+  int n;
+  assert( ct->state == TASK_RUNNING );
+
+  if (wc->wid >= 0) {
+    if (wc->reactor == NULL) {
+      wc->reactor = LpelReactorCreate(wc->mailbox);
+    }
+    if (wc->reactor != NULL) {
+      if (0 != LpelReactorAdd(wc->reactor, ct, fd, events)) return -1;
+
+      /* woken up by the worker if the fd is ready */
+      ct->state = TASK_BLOCKED;
+      TaskStop( ct);
+      LpelWorkerDispatcher( ct);
+      TaskStart( ct);
+      return ct->wait_revents;
+    }
+  }
+
+  /* wrapper or no reactor available */
+  pfd.fd = fd;
+  pfd.events = events;
+  pfd.revents = 0;
+  do {
+    n = poll(&pfd, 1, -1);
+  } while (n < 0 && errno == EINTR);
+  return (n < 0) ? -1 : pfd.revents;
+}
+
+
+/**
+ * Read from a non-blocking fd, waits for the fd if no data is available
+ * @return see read(2)
+ */
+ssize_t LpelFdRead(int fd, void *buf, size_t count)
+{
+  ssize_t n;
+  while (1) {
+    n = read(fd, buf, count);
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+      return n;
+    if (errno != EINTR && LpelTaskWaitFd(fd, POLLIN) < 0)
+      return -1;
+  }
+}
+
+
+/**
+ * Write to a non-blocking fd, waits for the fd until everything is written
+ * @return count or -1 on error, see write(2)
+ */
+ssize_t LpelFdWrite(int fd, const void *buf, size_t count)
+{
+  size_t done = 0;
+  ssize_t n;
+  while (done < count) {
+    n = write(fd, (const char *)buf + done, count - done);
+    if (n >= 0) {
+      done += n;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      return -1;
+    } else if (errno != EINTR && LpelTaskWaitFd(fd, POLLOUT) < 0) {
+      return -1;
+    }
+  }
+  return done;
 }
 
 
@@ -186,7 +422,7 @@ void LpelTaskYield(void)
    */
   if (tm_conf.mechanism == LPEL_MIG_WAIT_PROP) {
   	int target = LpelPickTargetWorker(ct);
-  	if (target > 0) {
+  	if (target >= 0) {
   		TaskStop(ct);
   		LpelWorkerSelfTaskMigrate(ct, target);
   		TaskStart(ct);
@@ -377,14 +613,20 @@ void TaskStart( lpel_task_t *t)
 	}
 #endif
 
+	t->sched_info.start = LpelCyclesNow();
 	t->state = TASK_RUNNING;
 }
 
 void TaskStop( lpel_task_t *t)
 {
-  //workerctx_t *wc = t->worker_context;
+  workerctx_t *wc = t->worker_context;
   assert( t->state != TASK_RUNNING);
 
+  /* charge the run to the group, wrappers are not scheduled */
+  if (wc->sched != NULL) {
+    LpelSchedAccount( wc->sched, t, LpelCyclesNow() - t->sched_info.start);
+  }
+
   /* MONITORING CALLBACK */
 #ifdef USE_TASK_EVENT_LOGGING
   if (t->mon && MON_CB(task_stop)) {
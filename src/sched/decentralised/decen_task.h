@@ -6,6 +6,7 @@
 #include "arch/mctx.h"
 #include "arch/atomic.h"
 #include "decen_scheduler.h"
+#include "decen_timer.h"
 
 
 /**
@@ -40,6 +41,15 @@ struct lpel_task_t {
    */
   struct lpel_stream_desc_t *wakeup_sd;
   atomic_int poll_token;        /** poll token, accessed concurrently */
+  struct lpel_stream_t *read_block;  /** stream the task is blocked reading */
+
+  int wait_fd;                  /** fd the task waits on in the reactor */
+  int wait_events;              /** events the task waits for */
+  int wait_revents;             /** events that woke up the task */
+  struct lpel_task_t *wait_next;  /** next task waiting on the same fd */
+
+  lpel_timer_t timer;           /** timeout of a blocking operation */
+  int timed_out;                /** set if woken up by the timer */
 
   /* ACCOUNTING INFORMATION */
   struct mon_task_t *mon;
@@ -63,6 +73,8 @@ struct lpel_task_t {
 void LpelTaskDestroy( lpel_task_t *t);
 void LpelTaskBlockStream( lpel_task_t *ct);
 void LpelTaskUnblock( lpel_task_t *ct, lpel_task_t *blocked);
+void LpelTaskInheritDeadline( lpel_task_t *t, uint64_t deadline);
+void LpelTaskInheritPrio( lpel_task_t *t, struct lpel_stream_t *s);
 
 
 
@@ -141,6 +141,29 @@ lpel_task_t *LpelTaskqueuePopBack(taskqueue_t *tq)
 
 
 
+/**
+ * Unlink a task from anywhere in the queue
+ *
+ * @pre   t is in tq
+ */
+void LpelTaskqueueRemove(taskqueue_t *tq, lpel_task_t *t)
+{
+  if (t->prev != NULL) {
+    t->prev->next = t->next;
+  } else {
+    tq->head = t->next;
+  }
+  if (t->next != NULL) {
+    t->next->prev = t->prev;
+  } else {
+    tq->tail = t->prev;
+  }
+  t->prev = NULL;
+  t->next = NULL;
+  tq->count--;
+}
+
+
 
 /**
  * Iterates once through the taskqueue (starting at head),
@@ -28,6 +28,7 @@ int LpelTaskqueueSize(taskqueue_t *tq);
 
 void LpelTaskqueuePushFront( taskqueue_t *tq, lpel_task_t *t);
 lpel_task_t *LpelTaskqueuePopBack(  taskqueue_t *tq);
+void LpelTaskqueueRemove( taskqueue_t *tq, lpel_task_t *t);
 
 #endif 	/* _DECEN_TASKQUEUE_H */
 
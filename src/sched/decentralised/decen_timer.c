@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "decen_timer.h"
+
+/*
+ * Timers are kept in a hierarchy of wheels. Level l holds the timers
+ * expiring within 2^(6*(l+1)) ticks. Level 0 is processed tick by tick,
+ * at each boundary the slot of the next level is cascaded down.
+ */
+
+struct timerwheel_t {
+  uint64_t cur;       /* next tick to be processed */
+  int num;            /* number of pending timers */
+  lpel_timer_t *slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+};
+
+#define LEVEL_SHIFT(l)  (TIMER_WHEEL_BITS * (l))
+#define TIMER_RANGE     (1ULL << LEVEL_SHIFT(TIMER_WHEEL_LEVELS))
+
+
+/**
+ * Current time in ns of the monotonic clock
+ */
+uint64_t LpelTimerNow(void)
+{
+  struct timespec ts;
+  (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+timerwheel_t *LpelTimerWheelCreate(void)
+{
+  timerwheel_t *w = (timerwheel_t *) calloc(1, sizeof(timerwheel_t));
+  w->cur = LpelTimerNow() >> TIMER_TICK_SHIFT;
+  return w;
+}
+
+
+void LpelTimerWheelDestroy(timerwheel_t *w)
+{
+  assert(w->num == 0);
+  free(w);
+}
+
+
+/**
+ * Put the timer into the slot according to its expiry
+ */
+static void Place(timerwheel_t *w, lpel_timer_t *tm)
+{
+  lpel_timer_t **head;
+  uint64_t exp = tm->expiry;
+  int lvl;
+
+  if (exp < w->cur) exp = w->cur;
+  /* beyond range, will be placed again when cascaded */
+  if (exp - w->cur >= TIMER_RANGE) exp = w->cur + TIMER_RANGE - 1;
+
+  for (lvl=0; lvl<TIMER_WHEEL_LEVELS-1; lvl++) {
+    if (exp - w->cur < (1ULL << LEVEL_SHIFT(lvl+1))) break;
+  }
+  head = &w->slot[lvl][(exp >> LEVEL_SHIFT(lvl)) & TIMER_WHEEL_MASK];
+
+  tm->next = *head;
+  if (tm->next) tm->next->pprev = &tm->next;
+  tm->pprev = head;
+  *head = tm;
+}
+
+
+/**
+ * Add a timer
+ * @param deadline  absolute time in ns (see LpelTimerNow)
+ * @pre             timer not pending
+ */
+void LpelTimerAdd(timerwheel_t *w, lpel_timer_t *tm, uint64_t deadline)
+{
+  assert(!LpelTimerIsPending(tm));
+  /* round up, a timer never expires early */
+  tm->expiry = (deadline + (1ULL << TIMER_TICK_SHIFT) - 1) >> TIMER_TICK_SHIFT;
+  Place(w, tm);
+  w->num++;
+}
+
+
+void LpelTimerCancel(timerwheel_t *w, lpel_timer_t *tm)
+{
+  assert(LpelTimerIsPending(tm));
+  *tm->pprev = tm->next;
+  if (tm->next) tm->next->pprev = tm->pprev;
+  tm->pprev = NULL;
+  tm->next = NULL;
+  w->num--;
+}
+
+
+int LpelTimerPending(timerwheel_t *w)
+{
+  return w->num;
+}
+
+
+/**
+ * Point in time the wheel has to be processed next
+ *
+ * For higher levels this is the time of the cascade, which is
+ * not later than the expiry of the timers in the slot.
+ *
+ * @return absolute time in ns, UINT64_MAX if no timer is pending
+ */
+uint64_t LpelTimerNext(timerwheel_t *w)
+{
+  uint64_t best = UINT64_MAX;
+  uint64_t tick;
+  int lvl, i;
+
+  if (w->num == 0) return UINT64_MAX;
+
+  for (i=0; i<TIMER_WHEEL_SIZE; i++) {
+    tick = w->cur + i;
+    if (w->slot[0][tick & TIMER_WHEEL_MASK] != NULL) {
+      best = tick;
+      break;
+    }
+  }
+
+  for (lvl=1; lvl<TIMER_WHEEL_LEVELS; lvl++) {
+    int sh = LEVEL_SHIFT(lvl);
+    /* first boundary of this level not processed yet */
+    uint64_t b = ((w->cur + (1ULL << sh) - 1) >> sh) << sh;
+    for (i=0; i<TIMER_WHEEL_SIZE && b < best; i++, b += (1ULL << sh)) {
+      if (w->slot[lvl][(b >> sh) & TIMER_WHEEL_MASK] != NULL) {
+        best = b;
+        break;
+      }
+    }
+  }
+
+  return (best == UINT64_MAX) ? best : best << TIMER_TICK_SHIFT;
+}
+
+
+static void Cascade(timerwheel_t *w, int lvl, int idx)
+{
+  lpel_timer_t *tm = w->slot[lvl][idx];
+  w->slot[lvl][idx] = NULL;
+  while (tm != NULL) {
+    lpel_timer_t *next = tm->next;
+    Place(w, tm);
+    tm = next;
+  }
+}
+
+
+/**
+ * Process the wheel up to now
+ *
+ * @param now   current time in ns
+ * @return      list of expired timers, linked by next
+ */
+lpel_timer_t *LpelTimerExpire(timerwheel_t *w, uint64_t now)
+{
+  uint64_t now_tick = now >> TIMER_TICK_SHIFT;
+  lpel_timer_t *expired = NULL;
+
+  while (w->num > 0 && w->cur <= now_tick) {
+    uint64_t t = w->cur;
+    lpel_timer_t *tm;
+    int lvl;
+
+    /* cascade at the boundaries of the higher levels */
+    for (lvl=1; lvl<TIMER_WHEEL_LEVELS; lvl++) {
+      if ((t & ((1ULL << LEVEL_SHIFT(lvl)) - 1)) != 0) break;
+      Cascade(w, lvl, (t >> LEVEL_SHIFT(lvl)) & TIMER_WHEEL_MASK);
+    }
+
+    /* expire the current slot */
+    tm = w->slot[0][t & TIMER_WHEEL_MASK];
+    w->slot[0][t & TIMER_WHEEL_MASK] = NULL;
+    while (tm != NULL) {
+      lpel_timer_t *next = tm->next;
+      tm->pprev = NULL;
+      tm->next = expired;
+      expired = tm;
+      w->num--;
+      tm = next;
+    }
+    w->cur++;
+  }
+  /* no need to go through empty ticks */
+  if (w->num == 0 && w->cur <= now_tick) w->cur = now_tick + 1;
+
+  return expired;
+}
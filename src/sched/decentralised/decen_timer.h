@@ -0,0 +1,47 @@
+#ifndef _DECEN_TIMER_H_
+#define _DECEN_TIMER_H_
+
+#include <stdint.h>
+
+/*
+ * Per-worker hierarchical timer wheel
+ *
+ * Only the owning worker accesses the wheel, no locking required.
+ * Timers are embedded in the task control block.
+ */
+
+#define TIMER_TICK_SHIFT   16   /* tick of 2^16 ns = 65.5 us */
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SIZE   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK   (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS  4   /* range of 2^40 ns, ~18 min */
+
+struct lpel_task_t;
+
+typedef struct lpel_timer_t {
+  struct lpel_timer_t *next;
+  struct lpel_timer_t **pprev;  /* NULL if not pending */
+  uint64_t expiry;              /* tick of expiry */
+  struct lpel_task_t *task;
+  /* called upon expiry, the task is woken up if it returns != 0,
+   * if NULL, the task is woken up always */
+  int (*expire)(struct lpel_task_t *t);
+} lpel_timer_t;
+
+typedef struct timerwheel_t timerwheel_t;
+
+
+uint64_t LpelTimerNow(void);
+
+timerwheel_t *LpelTimerWheelCreate(void);
+void LpelTimerWheelDestroy(timerwheel_t *w);
+
+void LpelTimerAdd(timerwheel_t *w, lpel_timer_t *tm, uint64_t deadline);
+void LpelTimerCancel(timerwheel_t *w, lpel_timer_t *tm);
+int  LpelTimerPending(timerwheel_t *w);
+uint64_t LpelTimerNext(timerwheel_t *w);
+lpel_timer_t *LpelTimerExpire(timerwheel_t *w, uint64_t now);
+
+#define LpelTimerIsPending(tm)  ((tm)->pprev != NULL)
+
+#endif /* _DECEN_TIMER_H_ */
@@ -8,6 +8,7 @@
 #include <stdarg.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
 
 #include <pthread.h>
 #include "arch/mctx.h"
@@ -26,6 +27,7 @@
 #include "decen_scheduler.h"
 #include "workermsg.h"
 #include "task_migration.h"
+#include "decen_reactor.h"
 
 #define WORKER_PTR(i) (workers[(i)])
 
@@ -36,8 +38,19 @@
 
 extern lpel_tm_config_t tm_conf;
 static int num_workers = -1;
+static volatile int num_active = -1;   /* workers num_active.. are retired */
 static workerctx_t **workers;
 
+/* pool of parked wrapper threads */
+static struct {
+  pthread_mutex_t lock;
+  workerctx_t *parked;
+  int num_parked;
+  int min, max;
+  int terminate;
+} wrapper_pool = { PTHREAD_MUTEX_INITIALIZER, NULL, 0,
+                   0, LPEL_WRAPPER_POOL_MAX_DEFAULT, 0 };
+
 
 
 #ifdef HAVE___THREAD
@@ -49,12 +62,24 @@ static pthread_key_t workerctx_key;
 
 /* worker thread function declaration */
 static void *WorkerThread( void *arg);
+static workerctx_t *CreateWrapperContext(int wid, int parked);
 
 
 static void FetchAllMessages( workerctx_t *wc);
 static void CleanupTaskContext(workerctx_t *wc, lpel_task_t *t);
 
 
+/**
+ * Woken up before the timeout, the timer is not needed anymore
+ */
+static inline void StopTimeout( workerctx_t *wc, lpel_task_t *t)
+{
+  if (LpelTimerIsPending(&t->timer)) {
+    LpelTimerCancel(wc->timers, &t->timer);
+  }
+}
+
+
 
 
 /*******************************************************************************
@@ -115,6 +140,7 @@ void LpelWorkersInit(lpel_config_t *cfg)
   int size = cfg->num_workers;
   assert(0 <= size);
   num_workers = size;
+  num_active = size;
 
 
 #ifndef HAVE___THREAD
@@ -142,6 +168,11 @@ void LpelWorkersInit(lpel_config_t *cfg)
     wc->sched = LpelSchedCreate( i);
     wc->wraptask = NULL;
     wc->migrated = NULL;
+    wc->reactor = NULL;
+    wc->timers = NULL;
+    wc->idle_cycles = 0;
+    wc->idle_since = 0;
+    wc->resized_from = 0;
 
 #ifdef USE_LOGGING
 
@@ -183,6 +214,8 @@ void LpelWorkersCleanup(void)
   /* cleanup the data structures */
   for( i=0; i<num_workers; i++) {
     wc = WORKER_PTR(i);
+    if (wc->reactor) LpelReactorDestroy(wc->reactor);
+    if (wc->timers) LpelTimerWheelDestroy(wc->timers);
     LpelMailboxDestroy(wc->mailbox);
     LpelSchedDestroy( wc->sched);
     free(wc);
@@ -190,10 +223,27 @@ void LpelWorkersCleanup(void)
 
   /* free workers table */
   free( workers);
+  num_workers = -1;
 
   /* cleanup spmdext module */
   LpelSpmdCleanup();
 
+  /* cleanup task migration state */
+  LpelTaskMigrationCleanup();
+
+  /* terminate parked wrappers, they cleanup themselves */
+  pthread_mutex_lock(&wrapper_pool.lock);
+  wrapper_pool.terminate = 1;
+  while (wrapper_pool.parked != NULL) {
+    workermsg_t msg;
+    wc = wrapper_pool.parked;
+    wrapper_pool.parked = wc->next;
+    msg.type = WORKER_MSG_TERMINATE;
+    LpelMailboxSend(wc->mailbox, &msg);
+  }
+  wrapper_pool.num_parked = 0;
+  pthread_mutex_unlock(&wrapper_pool.lock);
+
 #ifndef HAVE___THREAD
   pthread_key_delete(workerctx_key);
 #endif /* HAVE___THREAD */
@@ -260,7 +310,9 @@ void LpelWorkerDispatcher( lpel_task_t *t)
     /* before executing a task, handle all pending requests! */
     LpelSpmdHandleRequests(wc->wid);
 
-    next = LpelSchedFetchReady( wc->sched);
+    /* tasks are handed off after a resize from the worker context */
+    next = (wc->wid < num_active && wc->resized_from == 0) ?
+      LpelSchedFetchReady( wc->sched) : NULL;
     if (next != NULL) {
       /* short circuit */
       if (next==t) { return; }
@@ -298,6 +350,22 @@ void LpelWorkersSpawn(void)
     /* spawn joinable thread */
     (void) pthread_create( &wc->thread, NULL, WorkerThread, wc);
   }
+
+  /* spawn parked wrappers */
+  wrapper_pool.terminate = 0;
+  for (i=0; i<wrapper_pool.min; i++) {
+    (void) CreateWrapperContext(LPEL_MAP_WRAPPER, 1);
+  }
+}
+
+
+void LpelWrapperPoolInit(int min, int max)
+{
+  if (max < 0) max = 0;
+  if (min < 0) min = 0;
+  if (min > max) min = max;
+  wrapper_pool.min = min;
+  wrapper_pool.max = max;
 }
 
 /*
@@ -310,7 +378,7 @@ void LpelWorkerMakeTaskReady(lpel_task_t *t) {
 	workerctx_t *wc = t->worker_context;
 	if (tm_conf.mechanism == LPEL_MIG_WAIT_PROP){
 		int target = LpelPickTargetWorker(t);
-		if (target > 0 && target != wc->wid) {
+		if (target >= 0 && target != wc->wid) {
 			t->worker_context = LpelWorkerGetContext(target);
 			wc->num_tasks--;
 			SendAssign( t->worker_context, t);		/* MIGRATE */
@@ -340,6 +408,7 @@ void LpelWorkerTaskWakeup( lpel_task_t *by, lpel_task_t *whom)
       SendWakeup( wc, whom);
     } else {
       assert(whom->state != TASK_READY);
+      StopTimeout( wc, whom);
       whom->state = TASK_READY;
       LpelWorkerMakeTaskReady(whom);
     }
@@ -392,21 +461,30 @@ workerctx_t *LpelWorkerGetContext(int id) {
     wc = WORKER_PTR(id);
   }
 
-  /* create a new worker context for a wrapper */
+  /* get a worker context for a wrapper */
   if (id < 0) {
-    wc = (workerctx_t *) malloc( sizeof( workerctx_t));
-    wc->wid = id;
-    wc->terminate = 0;
-    /* Wrapper is excluded from scheduling module */
-    wc->sched = NULL;
-    wc->wraptask = NULL;
-    wc->mon = NULL;
-    /* mailbox */
-    wc->mailbox = LpelMailboxCreate();
-    /* taskqueue of free tasks */
-    //LpelTaskqueueInit( &wc->free_tasks);
-    (void) pthread_create( &wc->thread, NULL, WorkerThread, wc);
-    (void) pthread_detach( wc->thread);
+    /* reuse a parked wrapper */
+    pthread_mutex_lock(&wrapper_pool.lock);
+    wc = wrapper_pool.parked;
+    if (wc != NULL) {
+      wrapper_pool.parked = wc->next;
+      wrapper_pool.num_parked--;
+    }
+    pthread_mutex_unlock(&wrapper_pool.lock);
+
+    if (wc != NULL) {
+      /* the parked thread is blocked on its mailbox,
+       * it sets its affinity upon the first message */
+      wc->wid = id;
+      wc->terminate = 0;
+      wc->num_tasks = 0;
+      wc->current_task = NULL;
+      wc->wraptask = NULL;
+      wc->mon = NULL;
+      wc->next = NULL;
+    } else {
+      wc = CreateWrapperContext(id, 0);
+    }
   }
 
   assert((wc != NULL) && "The worker of the requested id does not exist.");
@@ -462,11 +540,107 @@ void LpelWorkerSelfTaskMigrate(lpel_task_t *t, int target) {
 
 void LpelWorkerTaskBlock(lpel_task_t *t) {}
 
+
+/**
+ * Set a timeout for the current task, before it blocks
+ *
+ * If the timer expires before the task is woken up, expire(t) is called
+ * in the worker loop. If it returns != 0 (or expire is NULL), the task is
+ * woken up with t->timed_out set.
+ *
+ * @param ns  relative timeout in ns
+ */
+void LpelWorkerSelfTimeout(lpel_task_t *t, uint64_t ns,
+                           int (*expire)(lpel_task_t *))
+{
+  workerctx_t *wc = t->worker_context;
+  assert( t->state == TASK_RUNNING );
+
+  if (wc->timers == NULL) {
+    wc->timers = LpelTimerWheelCreate();
+  }
+  t->timed_out = 0;
+  t->timer.expire = expire;
+  LpelTimerAdd(wc->timers, &t->timer, LpelTimerNow() + ns);
+}
+
 /** return the total number of workers */
 int LpelWorkerCount(void)
 {
   return num_workers;
 }
+
+
+int LpelWorkersActive(void)
+{
+  return num_active;
+}
+
+
+/**
+ * CPU time used by the tasks of a group on all workers, in usec
+ * Read while the workers update it, the result is approximate.
+ */
+unsigned long long LpelTaskGroupUsage(int group)
+{
+  lpel_cycles_t sum = 0;
+  int i;
+
+  if (group < 0 || group >= LPEL_GROUP_MAX) return 0;
+  for (i=0; i<num_workers; i++) {
+    sum += LpelSchedGroupUsage( WORKER_PTR(i)->sched, group);
+  }
+  return sum / _lpel_cycles_per_us;
+}
+
+
+/**
+ * Resize the set of active workers
+ *
+ * Retired workers hand their ready tasks to the active workers,
+ * activated workers get a share of the ready tasks of the others.
+ *
+ * @param n   number of active workers, within 1..LpelWorkerCount()
+ * @return    the number of active workers
+ */
+int LpelWorkersResize(int n)
+{
+  workermsg_t msg;
+  int i, old;
+
+  if (n < 1) n = 1;
+  if (n > num_workers) n = num_workers;
+
+  old = __sync_lock_test_and_set(&num_active, n);
+  if (old == n) return n;
+
+  msg.type = WORKER_MSG_RESIZE;
+  msg.body.from_worker = old;
+  if (n < old) {
+    /* wakeup the retired workers to hand off their tasks */
+    for (i=n; i<old; i++) LpelMailboxSend(WORKER_PTR(i)->mailbox, &msg);
+  } else {
+    /* the workers active before share their tasks */
+    for (i=0; i<old; i++) LpelMailboxSend(WORKER_PTR(i)->mailbox, &msg);
+  }
+  return n;
+}
+
+
+/**
+ * Time the worker waited for messages, including the current wait
+ */
+unsigned long long LpelWorkerIdleCycles(int wid)
+{
+  workerctx_t *wc = WORKER_PTR(wid);
+  lpel_cycles_t idle = wc->idle_cycles;
+  lpel_cycles_t since = wc->idle_since;
+  if (since != 0) {
+    lpel_cycles_t now = LpelCyclesNow();
+    if (now > since) idle += now - since;
+  }
+  return idle;
+}
 /******************************************************************************/
 /*  PRIVATE FUNCTIONS                                                         */
 /******************************************************************************/
@@ -491,6 +665,56 @@ static void CleanupTaskContext(workerctx_t *wc, lpel_task_t *t)
 
 
 
+/**
+ * Move a ready task to another worker
+ */
+static void HandOffTask( workerctx_t *wc, lpel_task_t *t, int target)
+{
+  t->worker_context = WORKER_PTR(target);
+  wc->num_tasks--;
+  SendAssign( t->worker_context, t);
+}
+
+
+/**
+ * A retired worker passes its ready tasks to the active workers,
+ * to the least loaded one first
+ */
+static void RetireTasks( workerctx_t *wc)
+{
+  lpel_task_t *t;
+  int i, active;
+
+  while ((t = LpelSchedTakeReady( wc->sched)) != NULL) {
+    int target = 0;
+    active = num_active;
+    for (i=1; i<active; i++) {
+      if (WORKER_PTR(i)->num_tasks < WORKER_PTR(target)->num_tasks) target = i;
+    }
+    HandOffTask( wc, t, target);
+  }
+}
+
+
+/**
+ * Give a share of the ready tasks to the workers activated after old
+ */
+static void ShareTasks( workerctx_t *wc, int old)
+{
+  lpel_task_t *t;
+  int active = num_active;
+  int share, i;
+
+  if (active <= old) return;
+  share = LpelSchedNumReady( wc->sched) * (active - old) / active;
+  for (i=0; i<share; i++) {
+    t = LpelSchedTakeReady( wc->sched);
+    if (t == NULL) break;
+    HandOffTask( wc, t, old + i % (active - old));
+  }
+}
+
+
 static void ProcessMessage( workerctx_t *wc, workermsg_t *msg)
 {
   lpel_task_t *t;
@@ -504,6 +728,7 @@ static void ProcessMessage( workerctx_t *wc, workermsg_t *msg)
        */
       t = msg->body.task;
       assert(t->state != TASK_READY);
+      StopTimeout( wc, t);
       t->state = TASK_READY;
 
       WORKER_DBGMSG(wc, "Received wakeup for %d.\n", t->uid);
@@ -566,6 +791,12 @@ static void ProcessMessage( workerctx_t *wc, workermsg_t *msg)
       */
       break;
 
+    case WORKER_MSG_RESIZE:
+      assert(wc->wid >= 0);
+      /* tasks are handed off in the worker loop */
+      wc->resized_from = msg->body.from_worker;
+      break;
+
     default: assert(0);
   }
 }
@@ -574,14 +805,44 @@ static void ProcessMessage( workerctx_t *wc, workermsg_t *msg)
 static void WaitForNewMessage( workerctx_t *wc)
 {
   workermsg_t msg;
+  int poll = (wc->reactor && LpelReactorWaiting(wc->reactor) > 0);
+  int received = 1;
+  uint64_t next = UINT64_MAX;
+
+  /* wait at most until the next timer expires */
+  if (wc->timers && LpelTimerPending(wc->timers)) {
+    next = LpelTimerNext(wc->timers);
+  }
 
 #ifdef USE_LOGGING
   if (wc->mon && MON_CB(worker_waitstart)) {
     MON_CB(worker_waitstart)(wc->mon);
   }
 #endif
+  wc->idle_since = LpelCyclesNow();
+
+  if (poll) {
+    /* wait for a ready fd or a message,
+     * messages are fetched afterwards in the worker loop */
+    int timeout = -1;
+    if (next != UINT64_MAX) {
+      uint64_t now = LpelTimerNow();
+      /* round up to ms */
+      timeout = (next > now) ? (int)((next - now + 999999) / 1000000) : 0;
+    }
+    LpelReactorPoll(wc->reactor, wc, timeout);
+    received = 0;
+  } else if (next != UINT64_MAX) {
+    struct timespec abstime;
+    abstime.tv_sec  = next / 1000000000ULL;
+    abstime.tv_nsec = next % 1000000000ULL;
+    received = (0 == LpelMailboxRecvTimeout(wc->mailbox, &msg, &abstime));
+  } else {
+    LpelMailboxRecv(wc->mailbox, &msg);
+  }
 
-  LpelMailboxRecv(wc->mailbox, &msg);
+  wc->idle_cycles += LpelCyclesNow() - wc->idle_since;
+  wc->idle_since = 0;
 
 #ifdef USE_LOGGING
   if (wc->mon && MON_CB(worker_waitstop)) {
@@ -589,7 +850,33 @@ static void WaitForNewMessage( workerctx_t *wc)
   }
 #endif
 
-  ProcessMessage( wc, &msg);
+  if (received) ProcessMessage( wc, &msg);
+}
+
+
+/**
+ * Wakeup the tasks with expired timers
+ */
+static void ExpireTimers( workerctx_t *wc)
+{
+  lpel_timer_t *tm = LpelTimerExpire(wc->timers, LpelTimerNow());
+
+  while (tm != NULL) {
+    lpel_timer_t *next = tm->next;
+    lpel_task_t *t = tm->task;
+    tm->next = NULL;
+    if (tm->expire == NULL || tm->expire(t)) {
+      assert(t->state == TASK_BLOCKED);
+      t->timed_out = 1;
+      t->state = TASK_READY;
+      if (wc->wid < 0) {
+        wc->wraptask = t;
+      } else {
+        LpelWorkerMakeTaskReady(t);
+      }
+    }
+    tm = next;
+  }
 }
 
 
@@ -600,6 +887,16 @@ static void FetchAllMessages( workerctx_t *wc)
     LpelMailboxRecv(wc->mailbox, &msg);
     ProcessMessage( wc, &msg);
   }
+
+  /* tasks with ready fds are ready as well */
+  if (wc->reactor && LpelReactorWaiting(wc->reactor) > 0) {
+    LpelReactorPoll(wc->reactor, wc, 0);
+  }
+
+  /* as well as tasks with expired timeouts */
+  if (wc->timers && LpelTimerPending(wc->timers)) {
+    ExpireTimers( wc);
+  }
 }
 
 
@@ -614,6 +911,14 @@ static void WorkerLoop( workerctx_t *wc)
     /* before executing a task, handle all pending requests! */
     LpelSpmdHandleRequests(wc->wid);
 
+    /* a retired worker runs no tasks, it passes them on */
+    if (wc->wid >= num_active) {
+      RetireTasks( wc);
+    } else if (wc->resized_from > 0) {
+      ShareTasks( wc, wc->resized_from);
+    }
+    wc->resized_from = 0;
+
     t = LpelSchedFetchReady( wc->sched);
     if (t != NULL) {
       /* execute task */
@@ -642,6 +947,93 @@ static void WorkerLoop( workerctx_t *wc)
 }
 
 
+/**
+ * Create a worker context and thread for a wrapper
+ * @param parked  if set, the wrapper is put in the pool of parked wrappers
+ */
+static workerctx_t *CreateWrapperContext(int wid, int parked)
+{
+  workerctx_t *wc = (workerctx_t *) malloc( sizeof( workerctx_t));
+  wc->wid = wid;
+  wc->terminate = 0;
+  wc->num_tasks = 0;
+  /* Wrapper is excluded from scheduling module */
+  wc->sched = NULL;
+  wc->wraptask = NULL;
+  wc->mon = NULL;
+  wc->next = NULL;
+  wc->reactor = NULL;
+  wc->timers = NULL;
+  wc->idle_cycles = 0;
+  wc->idle_since = 0;
+  wc->resized_from = 0;
+  /* mailbox */
+  wc->mailbox = LpelMailboxCreate();
+  /* taskqueue of free tasks */
+  //LpelTaskqueueInit( &wc->free_tasks);
+
+  if (parked) {
+    /* no task yet, the thread waits for the first message */
+    wc->terminate = 1;
+    pthread_mutex_lock(&wrapper_pool.lock);
+    wc->next = wrapper_pool.parked;
+    wrapper_pool.parked = wc;
+    wrapper_pool.num_parked++;
+    pthread_mutex_unlock(&wrapper_pool.lock);
+  }
+
+  (void) pthread_create( &wc->thread, NULL, WorkerThread, wc);
+  (void) pthread_detach( wc->thread);
+  return wc;
+}
+
+/**
+ * Park a wrapper after its task has terminated
+ * @return 1 if parked, 0 if the wrapper thread should exit
+ */
+static int WrapperPark( workerctx_t *wc)
+{
+  int parked = 0;
+
+#ifdef USE_LOGGING
+  /* the monitoring context belongs to the terminated task */
+  if (wc->mon && MON_CB(worker_destroy)) {
+    MON_CB(worker_destroy)(wc->mon);
+  }
+#endif
+  wc->mon = NULL;
+
+  pthread_mutex_lock(&wrapper_pool.lock);
+  if (!wrapper_pool.terminate
+      && wrapper_pool.num_parked < wrapper_pool.max) {
+    wc->next = wrapper_pool.parked;
+    wrapper_pool.parked = wc;
+    wrapper_pool.num_parked++;
+    parked = 1;
+  }
+  pthread_mutex_unlock(&wrapper_pool.lock);
+  return parked;
+}
+
+/**
+ * Wait until a parked wrapper is reused
+ * @return 1 if reused, 0 if the wrapper thread should exit
+ */
+static int WrapperWaitReuse( workerctx_t *wc)
+{
+  workermsg_t msg;
+
+  LpelMailboxRecv(wc->mailbox, &msg);
+  if (msg.type == WORKER_MSG_TERMINATE) {
+    return 0;
+  }
+  /* reused, honour the mapping of the new task */
+  LpelThreadAssign( wc->wid);
+  ProcessMessage( wc, &msg);
+  return 1;
+}
+
+
 static void WrapperLoop( workerctx_t *wc)
 {
   lpel_task_t *t = NULL;
@@ -694,19 +1086,42 @@ static void *WorkerThread( void *arg)
   /* no task marked for deletion */
   wc->marked_del = NULL;
 
-  /* assign to cores */
-  LpelThreadAssign( wc->wid);
-
   /*******************************************************/
   if ( wc->wid >= 0) {
+    /* assign to cores */
+    LpelThreadAssign( wc->wid);
     WorkerLoop( wc);
   } else {
-    WrapperLoop( wc);
+    /* a wrapper created for the pool waits for its first task */
+    int run = 1;
+    if (wc->terminate) {
+      run = WrapperWaitReuse( wc);
+    } else {
+      /* assign to cores */
+      LpelThreadAssign( wc->wid);
+    }
+    while (run) {
+      WrapperLoop( wc);
+      run = WrapperPark( wc) && WrapperWaitReuse( wc);
+    }
   }
   /*******************************************************/
 
 #ifdef USE_LOGGING
   /* cleanup monitoring */
+  if (wc->mon && MON_CB(worker_migstat)) {
+    unsigned long migrated, rejected;
+    if (LpelTaskMigrationStats(wc->wid, &migrated, &rejected) == 0)
+      MON_CB(worker_migstat)(wc->mon, migrated, rejected);
+  }
+  if (wc->mon && wc->sched && MON_CB(worker_groupstat)) {
+    int g;
+    for (g=0; g<LPEL_GROUP_MAX; g++) {
+      lpel_cycles_t usage = LpelSchedGroupUsage( wc->sched, g);
+      if (usage > 0)
+        MON_CB(worker_groupstat)(wc->mon, g, usage / _lpel_cycles_per_us);
+    }
+  }
   if (wc->mon && MON_CB(worker_destroy)) {
     MON_CB(worker_destroy)(wc->mon);
   }
@@ -724,6 +1139,7 @@ static void *WorkerThread( void *arg)
   if (wc->wid < 0) {
     /* clean up the mailbox for the worker */
     LpelMailboxDestroy(wc->mailbox);
+    if (wc->timers) LpelTimerWheelDestroy(wc->timers);
 
     /* free the worker context */
     free( wc);
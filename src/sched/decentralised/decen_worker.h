@@ -6,6 +6,7 @@
 #include <lpel_common.h>
 
 #include "arch/mctx.h"
+#include "arch/cycles.h"
 #include "decen_task.h"
 #include "mailbox.h"
 
@@ -29,6 +30,7 @@ typedef struct workerctx_t workerctx_t;
 #define  WORKER_MSG_ASSIGN			3
 #define  WORKER_MSG_SPMDREQ			4
 #define  WORKER_MSG_TASKMIG			5
+#define  WORKER_MSG_RESIZE			6
 
 
 struct workerctx_t {
@@ -46,6 +48,12 @@ struct workerctx_t {
   lpel_task_t  *wraptask;
   char          padding[64];
   lpel_task_t	 *migrated;
+  struct workerctx_t *next;   /* list of parked wrappers */
+  struct reactor_t *reactor;  /* I/O reactor, created on demand */
+  timerwheel_t *timers;       /* timeouts of tasks, created on demand */
+  lpel_cycles_t idle_cycles;  /* time waited for messages */
+  volatile lpel_cycles_t idle_since;  /* start of the current wait or 0 */
+  int resized_from;           /* active workers before a resize, 0 if none */
 };
 
 void LpelWorkerRunTask( lpel_task_t *t);
@@ -63,5 +71,7 @@ void LpelWorkerTaskBlock(lpel_task_t *t);
 void LpelWorkerTaskWakeup( lpel_task_t *by, lpel_task_t *whom);
 void LpelWorkerTaskWakeupLocal( workerctx_t *wc, lpel_task_t *task);
 void LpelWorkerSelfTaskMigrate(lpel_task_t *t, int target);
+void LpelWorkerSelfTimeout(lpel_task_t *t, uint64_t ns,
+                           int (*expire)(lpel_task_t *));
 
 #endif /* _DECEN_WORKER_H */
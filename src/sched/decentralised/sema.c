@@ -1,7 +1,47 @@
 
+#include <assert.h>
 #include "decen_task.h"
 #include "decen_worker.h"
-#include <sys/time.h>
+#include "arch/cycles.h"
+
+
+#define SEMA_LOCK(s)    while (__sync_lock_test_and_set(&(s)->lock, 1))
+#define SEMA_UNLOCK(s)  __sync_lock_release(&(s)->lock)
+
+/* append the current task to the list of blocked tasks */
+#define SEMA_ENQUEUE(s, t) do { \
+  (t)->next = NULL; \
+  if ((s)->tail) (s)->tail->next = (t); else (s)->head = (t); \
+  (s)->tail = (t); \
+} while (0)
+
+
+/**
+ * Block the current task, it has been appended to the list of a semaphore
+ * or barrier, which has to be unlocked before.
+ */
+static void BlockSelf(lpel_task_t *t)
+{
+  t->state = TASK_BLOCKED;
+  TaskStop(t);
+  LpelWorkerDispatcher(t);
+  TaskStart(t);
+}
+
+/**
+ * Spin until cond holds, for at most spin usec
+ * @return 1 if cond holds
+ */
+#define SPIN_UNTIL(cond, spin) ({ \
+  int ok = (cond); \
+  if (!ok && (spin) > 0) { \
+    lpel_cycles_t end = LpelCyclesNow() + LPEL_US_TO_CYCLES(spin); \
+    while (!(ok = (cond)) && LpelCyclesNow() < end) { \
+      __asm__ __volatile__ ("" ::: "memory"); \
+    } \
+  } \
+  ok; \
+})
 
 
 /** Initialize a binary semaphore. It is signalled by default. */
@@ -19,7 +59,7 @@ void LpelBiSemaDestroy(lpel_bisema_t *sem)
 /** Wait on the semaphore */
 void LpelBiSemaWait(lpel_bisema_t *sem)
 {
-  struct timeval start_tv, current_tv;
+  lpel_cycles_t start = 0, slice = LPEL_US_TO_CYCLES(1000);
   int looping = 0;
 
   /* __sync_lock_test_and_set is an atomic exchange.
@@ -34,35 +74,26 @@ void LpelBiSemaWait(lpel_bisema_t *sem)
      * The need for task rescheduling on these dedicated workers is very low.
      * Therefore, to optimize overheads this function will try to re-schedule
      * the LPEL worker at most once per 1 milisecond.
+     * The time is taken from the cycle counter, which is much cheaper
+     * than gettimeofday().
      */
     if (!looping) {
       /* the first cycle */
-      gettimeofday(&start_tv, NULL);
+      start = LpelCyclesNow();
       looping = 1;
+    } else if (LpelCyclesNow() - start > slice) {
+      start = LpelCyclesNow();
+      /* re-schedule another task */
+      lpel_task_t *t = LpelTaskSelf();
+      t->state = TASK_READY;
+      LpelWorkerSelfTaskYield(t);
+      TaskStop(t);
+      LpelWorkerDispatcher(t);
+      TaskStart(t);
     } else {
-      /* not the first cycle; determine the current time */
-      gettimeofday(&current_tv, NULL);    /* this takes roughly hundreds of nanoseconds */
-      /* has elapsed more than, say, roughly 1 ms? */
-      int yeah = 0;
-      long sec_diff = current_tv.tv_sec - start_tv.tv_sec;
-      if (sec_diff != 0) {
-        yeah = 1;
-      } else {
-        long usec_diff = current_tv.tv_usec - start_tv.tv_usec;
-        if (usec_diff > 1000) {
-          yeah = 1;
-        }
-      }
-
-      if (yeah) {
-        start_tv = current_tv;
-        /* re-schedule another task */
-        lpel_task_t *t = LpelTaskSelf();
-        t->state = TASK_READY;
-        LpelWorkerSelfTaskYield(t);
-        TaskStop(t);
-        LpelWorkerDispatcher(t);
-        TaskStart(t);
+      /* do not hammer the cache line */
+      while (sem->counter == 1 && LpelCyclesNow() - start <= slice) {
+        __asm__ __volatile__ ("" ::: "memory");
       }
     }
   }
@@ -74,3 +105,160 @@ void LpelBiSemaSignal(lpel_bisema_t *sem)
   /* This simply writes 0 */
   __sync_lock_release(&sem->counter);
 }
+
+
+
+/******************************************************************************/
+/*  COUNTING SEMAPHORES                                                       */
+/******************************************************************************/
+
+/** Initialize a counting semaphore with value */
+void LpelSemaInit(lpel_sema_t *sem, int value, int spin)
+{
+  assert(value >= 0);
+  sem->lock = 0;
+  sem->count = value;
+  sem->spin = spin;
+  sem->head = sem->tail = NULL;
+}
+
+/** Destroy a semaphore, no task must be blocked on it */
+void LpelSemaDestroy(lpel_sema_t *sem)
+{
+  assert(sem->head == NULL);
+}
+
+/**
+ * Decrement the semaphore if its value is positive
+ * @return 1 if decremented, 0 otherwise
+ */
+int LpelSemaTryWait(lpel_sema_t *sem)
+{
+  int c;
+  while ((c = sem->count) > 0) {
+    if (__sync_bool_compare_and_swap(&sem->count, c, c-1)) return 1;
+  }
+  return 0;
+}
+
+/**
+ * Wait on the semaphore
+ * The task spins for at most sem->spin usec, then it is blocked
+ * until a post hands over a unit.
+ *
+ * @pre called from within a LPEL task
+ */
+void LpelSemaWait(lpel_sema_t *sem)
+{
+  lpel_task_t *t;
+
+  if (SPIN_UNTIL(LpelSemaTryWait(sem), sem->spin)) return;
+
+  t = LpelTaskSelf();
+  assert( t->state == TASK_RUNNING );
+
+  SEMA_LOCK(sem);
+  /* count is only incremented with the lock held */
+  if (LpelSemaTryWait(sem)) {
+    SEMA_UNLOCK(sem);
+    return;
+  }
+  SEMA_ENQUEUE(sem, t);
+  SEMA_UNLOCK(sem);
+
+  /* the unit is passed directly by LpelSemaPost() */
+  BlockSelf(t);
+}
+
+/**
+ * Signal the semaphore, waking up the first blocked task if any
+ *
+ * @pre called from within a LPEL task
+ */
+void LpelSemaPost(lpel_sema_t *sem)
+{
+  lpel_task_t *t;
+
+  SEMA_LOCK(sem);
+  t = sem->head;
+  if (t) {
+    sem->head = t->next;
+    if (sem->head == NULL) sem->tail = NULL;
+    t->next = NULL;
+  } else {
+    (void) __sync_fetch_and_add(&sem->count, 1);
+  }
+  SEMA_UNLOCK(sem);
+
+  if (t) LpelTaskUnblock(LpelTaskSelf(), t);
+}
+
+
+/******************************************************************************/
+/*  BARRIERS                                                                  */
+/******************************************************************************/
+
+/** Initialize a barrier for count tasks */
+void LpelBarrierInit(lpel_barrier_t *bar, int count, int spin)
+{
+  assert(count > 0);
+  bar->lock = 0;
+  bar->count = count;
+  bar->arrived = 0;
+  bar->phase = 0;
+  bar->spin = spin;
+  bar->head = bar->tail = NULL;
+}
+
+/** Destroy a barrier, no task must be blocked on it */
+void LpelBarrierDestroy(lpel_barrier_t *bar)
+{
+  assert(bar->head == NULL);
+}
+
+/**
+ * Wait until count tasks have arrived at the barrier
+ *
+ * @pre called from within a LPEL task
+ * @return 1 for the last task to arrive, 0 for the others
+ */
+int LpelBarrierWait(lpel_barrier_t *bar)
+{
+  lpel_task_t *self = LpelTaskSelf();
+  lpel_task_t *t, *next;
+  unsigned int phase;
+
+  SEMA_LOCK(bar);
+  phase = bar->phase;
+  if (++bar->arrived == bar->count) {
+    /* last one: start a new phase and release the blocked tasks */
+    bar->arrived = 0;
+    t = bar->head;
+    bar->head = bar->tail = NULL;
+    __sync_synchronize();
+    bar->phase = phase + 1;
+    SEMA_UNLOCK(bar);
+
+    while (t) {
+      next = t->next;
+      t->next = NULL;
+      LpelTaskUnblock(self, t);
+      t = next;
+    }
+    return 1;
+  }
+  SEMA_UNLOCK(bar);
+
+  if (SPIN_UNTIL(bar->phase != phase, bar->spin)) return 0;
+
+  SEMA_LOCK(bar);
+  if (bar->phase != phase) {
+    SEMA_UNLOCK(bar);
+    return 0;
+  }
+  SEMA_ENQUEUE(bar, self);
+  SEMA_UNLOCK(bar);
+
+  BlockSelf(self);
+  return 0;
+}
@@ -1,14 +1,22 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
+#include <sched.h>
 
-//FIXME check availability
-#include <semaphore.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 
+#include <pthread.h>
+
 #include "spmdext.h"
 
 #include "lpelcfg.h"
+#include "lpel_hwloc.h"
 #include "arch/atomic.h"
 #include "decen_worker.h"
 
@@ -19,21 +27,50 @@
 
 
 
+/*
+ * Sense-reversing combining tree barrier
+ *
+ * Participants arrive at the leaf node p/SPMD_BARRIER_FANIN, the last
+ * arriving participant of a node resets the node and continues at the
+ * parent. The last arriving participant at the root releases all others
+ * by flipping the global sense. Waiters spin for a while before they
+ * sleep on a futex.
+ */
+#define SPMD_BARRIER_FANIN  4
+#define SPMD_BARRIER_SPIN   (1<<12)
+
+typedef struct {
+  volatile int count;   /* participants still to arrive */
+  int fanin;            /* participants (nodes or workers) below */
+  int parent;           /* index of parent node, -1 for the root */
+  int padding[13];
+} spmd_node_t;
+
+typedef struct {
+  spmd_node_t *nodes;
+  int size;
+  volatile int sense;
+  volatile int sleepers;
+} spmd_barrier_t;
+
+
+/* a team request */
 typedef struct {
   workerctx_t *wctx;     /* requesting worker */
   lpel_spmdfunc_t func;
   void *arg;
   lpel_task_t *task; /* requesting task */
+  int size;              /* number of team members */
+  volatile int active;   /* members that have not left the request yet */
+  spmd_barrier_t barrier;
 } spmdreq_t;
 
 
-
 typedef struct {
-  sem_t sema;
-  spmdreq_t *curreq; /* pointer to local copy of
-                         the current request on the stack */
-  int pending;
-  int padding[7];
+  spmdreq_t * volatile req; /* request the worker is claimed for */
+  spmdreq_t *curreq; /* set while executing the request */
+  int vid;           /* virtual id within the team */
+  int padding[11];
 } spmd_worker_t;
 
 
@@ -47,23 +84,150 @@ static int num_workers = -1;
 /** worker specific data */
 static spmd_worker_t *worker_data = NULL;
 
+/**
+ * lock for team formation: all members of a team are claimed at once,
+ * a worker is member of at most one team at any time
+ */
+static pthread_mutex_t team_lock;
+
+
+/****************************************************************************/
+
+static inline void FutexWait(volatile int *addr, int val)
+{
+#ifdef __linux__
+  (void) syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+  (void) sched_yield();
+#endif
+}
+
+static inline void FutexWakeAll(volatile int *addr)
+{
+#ifdef __linux__
+  (void) syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+
+/**
+ * Build the combining tree for size participants
+ */
+static void BarrierInit(spmd_barrier_t *b, int size)
+{
+  int width, start, next, i;
+
+  /* a tree with leaves for size participants has less than size nodes */
+  b->nodes = malloc(size * sizeof(spmd_node_t));
+  b->size = size;
+  b->sense = 0;
+  b->sleepers = 0;
+
+  /* fill level by level, children of a level are its participants */
+  width = size;
+  start = 0;
+  do {
+    int cnt = (width + SPMD_BARRIER_FANIN-1) / SPMD_BARRIER_FANIN;
+    next = start + cnt;
+    for (i=0; i<cnt; i++) {
+      spmd_node_t *n = &b->nodes[start+i];
+      n->fanin = width - i*SPMD_BARRIER_FANIN;
+      if (n->fanin > SPMD_BARRIER_FANIN) n->fanin = SPMD_BARRIER_FANIN;
+      n->count = n->fanin;
+      n->parent = (cnt > 1) ? next + i/SPMD_BARRIER_FANIN : -1;
+    }
+    width = cnt;
+    start = next;
+  } while (width > 1);
+}
+
+static void BarrierDestroy(spmd_barrier_t *b)
+{
+  free(b->nodes);
+  b->nodes = NULL;
+}
 
 /**
- * array for the request queue
- * note that a fixed queue size of num_workers is sufficient
+ * Wait at the barrier
+ * @param p       participant index in [0, size)
+ * @param sense   local sense of the participant
  */
-static spmdreq_t *req_queue = NULL;
+static void BarrierWait(spmd_barrier_t *b, int p, int *sense)
+{
+  int s = !(*sense);
+  int n = p / SPMD_BARRIER_FANIN;
+  int spin;
+  *sense = s;
 
-static atomic_int qhead = ATOMIC_VAR_INIT(0);
-static atomic_int qtail = ATOMIC_VAR_INIT(0);
+  while (1) {
+    spmd_node_t *node = &b->nodes[n];
+    if (__sync_fetch_and_sub(&node->count, 1) != 1) break;
+
+    /* last one arriving at the node,
+     * nobody else touches it before the release */
+    node->count = node->fanin;
+    if (node->parent < 0) {
+      /* last one arriving at the root: release */
+      __sync_synchronize();
+      b->sense = s;
+      __sync_synchronize();
+      if (b->sleepers > 0) FutexWakeAll(&b->sense);
+      return;
+    }
+    n = node->parent;
+  }
 
+  for (spin=0; spin<SPMD_BARRIER_SPIN; spin++) {
+    if (b->sense == s) {
+      __sync_synchronize();
+      return;
+    }
+    __asm__ __volatile__ ("" ::: "memory");
+  }
 
+  (void) __sync_fetch_and_add(&b->sleepers, 1);
+  while (b->sense != s) {
+    FutexWait(&b->sense, !s);
+  }
+  (void) __sync_fetch_and_sub(&b->sleepers, 1);
+}
 
 /****************************************************************************/
 
-static inline int GetVId(int self_id, int master_id) {
-  int vid = master_id - self_id;
-  return (vid < 0) ? vid+num_workers : vid;
+/**
+ * Choose the free worker preferable for a team of worker self:
+ * idle workers first, then close workers, then less loaded workers
+ *
+ * @pre team_lock is held
+ * @return worker id, -1 if no free worker is left
+ */
+static int PickMember(int self, const int *members, int n)
+{
+  int w, i, best = -1;
+  int best_dist = 0;
+  unsigned int best_load = 0;
+
+  for (w=0; w<num_workers; w++) {
+    int dist;
+    unsigned int load;
+    if (worker_data[w].req != NULL) continue;
+    for (i=0; i<n; i++) {
+      if (members[i] == w) break;
+    }
+    if (i < n) continue;
+
+    load = LpelWorkerGetContext(w)->num_tasks;
+    dist = LpelHwLocWorkerDistance(self, w);
+    if (best < 0
+        || (load == 0 && best_load > 0)
+        || ((load == 0) == (best_load == 0)
+          && (dist < best_dist || (dist == best_dist && load < best_load)))) {
+      best = w;
+      best_dist = dist;
+      best_load = load;
+    }
+  }
+  return best;
 }
 
 /****************************************************************************/
@@ -74,99 +238,50 @@ int LpelSpmdInit(int numworkers)
   assert(numworkers > 0);
   num_workers = numworkers;
 
-  /* allocate request queue */
-  req_queue = malloc(num_workers * sizeof(spmdreq_t));
-  for (i=0; i<num_workers; i++) {
-    req_queue[i].wctx = NULL; /* initialize to invalid worker id */
-  }
-
   /* allocate private worker data */
   worker_data = malloc(num_workers * sizeof(spmd_worker_t));
   for (i=0; i<num_workers; i++) {
     spmd_worker_t *wd = &worker_data[i];
-    sem_init(&wd->sema, 0, 0);
+    wd->req = NULL;
     wd->curreq = NULL;
-    wd->pending = 0;
+    wd->vid = -1;
   }
 
+  pthread_mutex_init(&team_lock, NULL);
+
   return 0;
 }
 
 void LpelSpmdCleanup(void)
 {
-  int i;
-  for (i=0; i<num_workers; i++) {
-    spmd_worker_t *wd = &worker_data[i];
-    sem_destroy(&wd->sema);
-  }
-  free(req_queue);
+  pthread_mutex_destroy(&team_lock);
   free(worker_data);
 }
 
 void LpelSpmdHandleRequests(int worker_id)
 {
-	spmdreq_t curreq;
-  spmd_worker_t *master_data, *self_data;
-  int i, head, cur_worker_id;
+  spmdreq_t *req;
+  spmd_worker_t *self_data;
+  int sense;
 
   assert(worker_id >= 0 && worker_id < num_workers);
 
-  while (1) {
-    head = atomic_load(&qhead);
-    /* local copy of current request */
-    curreq = req_queue[head];
-
-    if (curreq.wctx == NULL) {
-      /* all requests handled */
-      break;
-    };
+  self_data = &worker_data[worker_id];
 
-    cur_worker_id = curreq.wctx->wid;
-    assert(cur_worker_id != -1);
+  /* a worker is claimed for a new team only after it has left the last one */
+  while ((req = self_data->req) != NULL) {
+    __sync_synchronize();
 
-    master_data = &worker_data[cur_worker_id];
-    self_data   = &worker_data[worker_id];
+    /* the barrier of a request is fresh, start with sense 0 */
+    sense = 0;
 
     /*
      * "Start-Barrier"
      */
-    if (cur_worker_id == worker_id) {
-      /* we are the "master" thread */
-
-      /* wait until other threads have entered the spmd */
-      for (i=0; i<num_workers-1; i++) {
-        sem_wait(&master_data->sema);
-      }
-
-      /* now master is the sole thread operating on the queue */
-      { /* CRITICAL SECTION */
-        int tail;
-        /* invalidate the head (current) in req_queue */
-        req_queue[head].wctx = NULL;
-        /* move head */
-        head = (head+1) % num_workers;
-        atomic_store(&qhead, head);
-        /* correct tail */
-        tail = atomic_load(&qtail);
-        if (tail >= num_workers) tail %= num_workers;
-        atomic_store(&qtail, tail);
-      } /* CRITICAL SECTION */
-
-      /* signal the other threads */
-      for (i=0; i<num_workers; i++) {
-        if (i != worker_id) {
-          sem_post(&worker_data[i].sema);
-        }
-      }
-    } else {
-      /* we are NOT master, signal master, then wait */
-      sem_post(&master_data->sema);
-      sem_wait(&self_data->sema);
-    } /* End "Start-Barrier" */
-
+    BarrierWait(&req->barrier, self_data->vid, &sense);
 
     /* set the pointer to curreq */
-    self_data->curreq = &curreq;
+    self_data->curreq = req;
 
     /**********************************/
     /* EXECUTE THE REQUESTED FUNCTION */
@@ -174,10 +289,9 @@ void LpelSpmdHandleRequests(int worker_id)
 //      workerctx_t *wc = LpelWorkerGetContext(worker_id);
 //      WORKER_DBGMSG(wc,
 //          "Enter spmd req'd by task %u on worker %d (VId=%d).\n",
-//          curreq.task->uid, cur_worker_id,
-//          GetVId(worker_id, cur_worker_id)
+//          req->task->uid, req->wctx->wid, self_data->vid
 //          );
-//      curreq.func(curreq.arg);
+      req->func(req->arg);
 //      WORKER_DBGMSG(wc, "Left spmd.\n");
     }
     /**********************************/
@@ -188,47 +302,119 @@ void LpelSpmdHandleRequests(int worker_id)
     /*
      * "Stop-Barrier"
      */
-    if (cur_worker_id == worker_id) {
-      /* we are the "master" thread */
-      /* wait until other threads have left the spmd */
-      for (i=0; i<num_workers-1; i++) {
-        sem_wait(&master_data->sema);
+    BarrierWait(&req->barrier, self_data->vid, &sense);
+
+    /* leave the team, the worker can be claimed again */
+    self_data->vid = -1;
+    __sync_synchronize();
+    self_data->req = NULL;
+
+    if (req->wctx->wid == worker_id) {
+      /* we are the "master" thread,
+       * wait until the other threads do not access the request anymore
+       */
+      while (req->active > 1) {
+        (void) sched_yield();
       }
-
-      /* clear pending flag, now it is safe on the current worker
-         to handle subsequent requests */
-      assert( 1 == master_data->pending );
-      master_data->pending = 0;
+      BarrierDestroy(&req->barrier);
 
       /* now we can wakeup the task */
-      LpelWorkerTaskWakeupLocal( curreq.task->worker_context, curreq.task);
+      LpelWorkerTaskWakeupLocal( req->task->worker_context, req->task);
+      free(req);
     } else {
-      /* we are NOT master, signal master before continuing */
-      sem_post(&master_data->sema);
-    } /* End "Stop-Barrier" */
-
-  } /* END WHILE(1) */
+      (void) __sync_fetch_and_sub(&req->active, 1);
+    }
+  } /* END WHILE */
 }
 
 
-void LpelSpmdRequest(lpel_task_t *task, lpel_spmdfunc_t fun, void *arg)
+/**
+ * Claim a team for a spmd request of a task
+ *
+ * The worker of the task is always member of the team with virtual id 0.
+ * Either all members are claimed or none.
+ *
+ * @param count   size of the team including the worker of the task,
+ *                all workers if <= 0; if wids is given, the number of
+ *                worker ids in wids
+ * @param wids    ids of the workers to join the team, or NULL to let
+ *                the worker choose idle and close workers
+ * @return size of the team, -1 if the team is not available (yet)
+ */
+int LpelSpmdRequest(lpel_task_t *task, int count, const int *wids,
+    lpel_spmdfunc_t fun, void *arg)
 {
-  int tail;
+  int i, n, self;
+  int *members;
   spmdreq_t *req;
+  workermsg_t msg;
   workerctx_t *wc = task->worker_context;
   assert(wc != NULL && wc->wid >= 0 && wc->wid < num_workers);
+  self = wc->wid;
 
-  /* set pending flag */
-  assert( 0 == worker_data[wc->wid].pending);
-  worker_data[wc->wid].pending = 1;
+  if (wids == NULL && (count <= 0 || count > num_workers)) {
+    count = num_workers;
+  }
+
+  members = malloc(num_workers * sizeof(int));
+  members[0] = self;
+  n = 1;
+
+  pthread_mutex_lock(&team_lock);
 
-  /* append */
-  tail = atomic_fetch_add(&qtail, 1) % num_workers;
-  req = &req_queue[tail];
+  if (worker_data[self].req != NULL) goto busy;
+
+  if (wids != NULL) {
+    for (i=0; i<count; i++) {
+      int j, w = wids[i];
+      assert(w >= 0 && w < num_workers);
+      for (j=0; j<n; j++) {
+        if (members[j] == w) break;
+      }
+      if (j < n) continue;  /* duplicate or self */
+      if (worker_data[w].req != NULL) goto busy;
+      members[n++] = w;
+    }
+  } else {
+    while (n < count) {
+      int w = PickMember(self, members, n);
+      if (w < 0) goto busy;
+      members[n++] = w;
+    }
+  }
+
+  req = malloc(sizeof(spmdreq_t));
   req->wctx = wc;
   req->func = fun;
   req->arg  = arg;
   req->task = task;
+  req->size = n;
+  req->active = n;
+  BarrierInit(&req->barrier, n);
+
+  /* publish the request */
+  __sync_synchronize();
+  for (i=0; i<n; i++) {
+    worker_data[members[i]].vid = i;
+    worker_data[members[i]].req = req;
+  }
+
+  pthread_mutex_unlock(&team_lock);
+
+  /* wake up the other members */
+  msg.type = WORKER_MSG_SPMDREQ;
+  msg.body.from_worker = self;
+  for (i=1; i<n; i++) {
+    LpelMailboxSend(LpelWorkerGetContext(members[i])->mailbox, &msg);
+  }
+
+  free(members);
+  return n;
+
+busy:
+  pthread_mutex_unlock(&team_lock);
+  free(members);
+  return -1;
 }
 
 
@@ -238,22 +424,30 @@ void LpelSpmdRequest(lpel_task_t *task, lpel_spmdfunc_t fun, void *arg)
  */
 int LpelSpmdVId(void)
 {
-  int self_id, master_id;
-  spmdreq_t *curreq;
+  int self_id;
 
   self_id = LpelWorkerSelf()->wid;
   assert( self_id >= 0 && self_id < num_workers );
 
   /* if we are not in a spmd, curreq is NULL */
-  curreq = worker_data[self_id].curreq;
-  assert(curreq != NULL);
+  assert(worker_data[self_id].curreq != NULL);
 
   /* the virtual id for the master is 0,
-   * all other worker ids are shifted
-   * by the master id modulo num_workers
+   * the other members are numbered in the order they joined the team
    */
-  master_id = curreq->wctx->wid;
-  return GetVId(self_id, master_id);
+  return worker_data[self_id].vid;
 }
 
+/**
+ * Get the size of the team from within a spmd function
+ */
+int LpelSpmdSize(void)
+{
+  int self_id;
 
+  self_id = LpelWorkerSelf()->wid;
+  assert( self_id >= 0 && self_id < num_workers );
+
+  assert(worker_data[self_id].curreq != NULL);
+  return worker_data[self_id].curreq->size;
+}
@@ -5,48 +5,71 @@
 #include "decen_worker.h"
 #include "lpel.h"
 #include "lpelcfg.h"
+#include "lpel_hwloc.h"
 #include "task_migration.h"
 
 lpel_tm_config_t tm_conf;
 
-/* function to check if task should be migrated. 1 = yes, 0 = no*/
-static int (*check_migrate_func)(lpel_task_t *) = NULL;
+/*
+ * per-worker migration state, only accessed by the owning worker
+ * (the worker the task currently belongs to), hence no locking
+ */
+typedef struct {
+	unsigned int rng;						/* xorshift state, never 0 */
+	unsigned long migrated;			/* number of migrations away from this worker */
+	unsigned long rejected;			/* migrations rejected by the cost model */
+	char padding[64];
+} tm_worker_t;
+
+static tm_worker_t *tm_workers = NULL;
+
+/* function to check if task should be migrated
+ * @return the expected gain of a migration, <= 0 = no migration */
+static double (*check_migrate_func)(lpel_task_t *, tm_worker_t *) = NULL;
 
 /* function to pick worker to migrate the task */
-static int (*pick_worker_func) () = NULL;
+static int (*pick_worker_func) (tm_worker_t *) = NULL;
 
 /******* PRIVATE FUNCTION *******/
+/* xorshift32, uniformly distributed in [0, 1) */
+static inline double NextRandom(tm_worker_t *tw) {
+	unsigned int x = tw->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	tw->rng = x;
+	return (double) x / 4294967296.0;
+}
+
 /* check by random */
-int MigrateRandom(lpel_task_t *t) {
-	double c = (double) rand() / (double) RAND_MAX;
-	if (c > tm_conf.threshold)
-		return 1;
-	else
-		return 0;
+static double MigrateRandom(lpel_task_t *t, tm_worker_t *tw) {
+	return NextRandom(tw) - tm_conf.threshold;
 }
 
 /* pick random worker */
-int PickWorkerRandom() {
-	return rand() % tm_conf.num_workers;
+static int PickWorkerRandom(tm_worker_t *tw) {
+	return (int) (NextRandom(tw) * tm_conf.num_workers);
 }
 
 
 /*--------------------------------*/
 /* migrate based on the waiting proportion */
-int MigrateTaskWait(lpel_task_t *t) {
+static double MigrateTaskWait(lpel_task_t *t, tm_worker_t *tw) {
+	(void) tw;
 	if (!t->mon)
-		return 0;
+		return 0.0;
 	double task_wait = MON_CB(get_task_wait_prop) (t->mon);
 	double worker_wait = MON_CB(get_worker_wait_prop)(t->mon);
 	double global_wait = MON_CB(get_global_wait_prop)();
 	if (task_wait > worker_wait && worker_wait > global_wait)
-		return 1;
+		return task_wait - global_wait;
 	else
-		return 0;
+		return 0.0;
 }
 
 /* choose the worker with the most wait proportion */
-int PickWorkerTaskWait() {
+static int PickWorkerTaskWait(tm_worker_t *tw) {
+	(void) tw;
 	return MON_CB(worker_most_wait_prop)();
 }
 
@@ -58,7 +81,27 @@ int PickWorkerTaskWait() {
  * Initialize migration mechanism
  */
 void LpelTaskMigrationInit(lpel_tm_config_t *conf) {
+	int i;
 	tm_conf = *conf;
+	/* fields a caller may have left uninitialised fall back to no cooldown
+	 * and no distance cost; the gains are proportions, i.e. within [0, 1] */
+	if (tm_conf.cooldown < 0)
+		tm_conf.cooldown = 0;
+	for (i = 0; i < 3; i++) {
+		if (!(tm_conf.dist_cost[i] >= 0.0 && tm_conf.dist_cost[i] <= 1.0))
+			tm_conf.dist_cost[i] = 0.0;
+	}
+
+	if (tm_conf.mechanism != LPEL_MIG_NONE && tm_conf.num_workers > 0) {
+		tm_workers = (tm_worker_t *) malloc(tm_conf.num_workers * sizeof(tm_worker_t));
+		for (i = 0; i < tm_conf.num_workers; i++) {
+			/* distinct non-zero seed per worker */
+			tm_workers[i].rng = 2654435761u * (unsigned int) (i + 1);
+			tm_workers[i].migrated = 0;
+			tm_workers[i].rejected = 0;
+		}
+	}
+
 	switch(tm_conf.mechanism) {
 	case LPEL_MIG_RAND:
 		check_migrate_func = MigrateRandom;
@@ -74,19 +117,81 @@ void LpelTaskMigrationInit(lpel_tm_config_t *conf) {
 			pick_worker_func = PickWorkerTaskWait;
 		}
 		break;
+	default:
+		break;
+	}
+	if (!tm_workers) {
+		check_migrate_func = NULL;
+		pick_worker_func = NULL;
+	}
+}
+
+void LpelTaskMigrationCleanup(void) {
+	check_migrate_func = NULL;
+	pick_worker_func = NULL;
+	if (tm_workers) {
+		free(tm_workers);
+		tm_workers = NULL;
 	}
 }
 
+/*
+ * get the migration statistics of a worker
+ * @return 0 on success, -1 if migration is not enabled or wid invalid
+ */
+int LpelTaskMigrationStats(int wid, unsigned long *migrated, unsigned long *rejected) {
+	if (!tm_workers || wid < 0 || wid >= tm_conf.num_workers)
+		return -1;
+	*migrated = tm_workers[wid].migrated;
+	*rejected = tm_workers[wid].rejected;
+	return 0;
+}
+
 /*
  * pick target worker to migrate the task
+ * A task that has just been migrated is kept in place for tm_conf.cooldown
+ * checks to avoid ping-ponging. Otherwise the expected gain has to exceed
+ * the cost of moving the task to the target, given by the topological
+ * distance between the two workers.
+ * Must be called by the worker the task currently belongs to.
+ *
  * @param t			task
  * @return wid	worker id
  * 							If wid < 0 --> should not migrate the task
  */
 int LpelPickTargetWorker(lpel_task_t *t) {
-	if (check_migrate_func && pick_worker_func)
-		if (check_migrate_func(t))
-			return pick_worker_func();
-	return -1;
+	if (!check_migrate_func || !pick_worker_func)
+		return -1;
+
+	int wid = t->worker_context->wid;
+	if (wid < 0 || wid >= tm_conf.num_workers)
+		return -1;		// wrapper task
+
+	if (t->sched_info.mig_cooldown > 0) {
+		t->sched_info.mig_cooldown--;
+		return -1;
+	}
+
+	tm_worker_t *tw = &tm_workers[wid];
+	double gain = check_migrate_func(t, tw);
+	if (gain <= 0.0)
+		return -1;
+
+	int target = pick_worker_func(tw);
+	if (target < 0 || target >= tm_conf.num_workers || target == wid)
+		return -1;
+
+	/* retired workers do not take tasks */
+	if (target >= LpelWorkersActive())
+		return -1;
+
+	if (gain <= tm_conf.dist_cost[LpelHwLocWorkerDistance(wid, target)]) {
+		tw->rejected++;
+		return -1;
+	}
+
+	tw->migrated++;
+	t->sched_info.mig_cooldown = tm_conf.cooldown;
+	return target;
 }
 
@@ -5,5 +5,7 @@
 #include "decen_task.h"
 
 int LpelPickTargetWorker(lpel_task_t *t);
+void LpelTaskMigrationCleanup(void);
+int LpelTaskMigrationStats(int wid, unsigned long *migrated, unsigned long *rejected);
 
 #endif /* _TASK_MIGRATION_H */
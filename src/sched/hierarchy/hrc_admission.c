@@ -0,0 +1,167 @@
+/**********************************************************
+ * Desc:		Admission controller of the entry tasks
+ * 			Periodically compares the items in flight between
+ * 			the entry and the exit streams, or the latency
+ * 			estimated from them, with the target and adapts
+ * 			the credit of the entry tasks AIMD-style.
+ **********************************************************/
+
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "hrc_lpel.h"
+#include "hrc_admission.h"
+
+
+static lpel_admission_config_t adm_conf = { 0, 0, 0, 1, 0 };
+
+volatile int _lpel_admission_active = 0;
+static volatile int inflight = 0;		// items in the middle streams
+static volatile int exits = 0;			// items written to exit streams
+static volatile int credit = -1;		// -1 if the controller does not run
+
+static pthread_t       adm_thread;
+static pthread_mutex_t adm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  adm_cond;
+static int adm_running = 0;
+static int adm_stop = 0;
+
+
+/**
+ * Configure the controller, to be called before LpelStart()
+ */
+void LpelAdmissionInit(lpel_admission_config_t *conf)
+{
+	adm_conf = *conf;
+	if (adm_conf.interval < 0) adm_conf.interval = 0;
+	if (adm_conf.target_inflight < 0) adm_conf.target_inflight = 0;
+	if (adm_conf.target_latency < 0) adm_conf.target_latency = 0;
+	if (adm_conf.min_credit < 1) adm_conf.min_credit = 1;
+	if (adm_conf.max_credit <= 0) adm_conf.max_credit = INT_MAX;
+	if (adm_conf.max_credit < adm_conf.min_credit)
+		adm_conf.max_credit = adm_conf.min_credit;
+}
+
+
+/* called by the streams for reads and writes of middle streams */
+void LpelAdmissionMiddle(int delta)
+{
+	(void) __sync_fetch_and_add(&inflight, delta);
+}
+
+/* called by the streams for writes to exit streams */
+void LpelAdmissionExit(void)
+{
+	(void) __sync_fetch_and_add(&exits, 1);
+}
+
+/**
+ * Maximum number of output items of an entry task to be scheduled
+ * @return -1 if the controller does not run
+ */
+int LpelAdmissionCredit(void)
+{
+	return credit;
+}
+
+
+/* 1 if the network is beyond the target in the last period */
+static int overloaded(int last_exits)
+{
+	int n = inflight;
+	int out = exits - last_exits;
+	if (n < 0) n = 0;
+
+	if (adm_conf.target_inflight > 0)
+		return n > adm_conf.target_inflight;
+
+	/* Little's law: latency = items in flight / departure rate */
+	if (out <= 0)
+		return n > 0;
+	return (double) n * adm_conf.interval * 1000.0 / out > adm_conf.target_latency;
+}
+
+
+static void *AdmissionThread(void *arg)
+{
+	struct timespec ts;
+	int last_exits = exits;
+
+	(void) arg;
+	pthread_mutex_lock(&adm_lock);
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	while (!adm_stop) {
+		ts.tv_sec  += adm_conf.interval / 1000;
+		ts.tv_nsec += (adm_conf.interval % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		while (!adm_stop &&
+				ETIMEDOUT != pthread_cond_timedwait(&adm_cond, &adm_lock, &ts));
+		if (adm_stop) break;
+
+		/* multiplicative decrease, additive increase */
+		if (overloaded(last_exits)) {
+			credit = (credit / 2 < adm_conf.min_credit) ? adm_conf.min_credit : credit / 2;
+		} else if (credit < adm_conf.max_credit) {
+			credit++;
+		}
+		last_exits = exits;
+	}
+	pthread_mutex_unlock(&adm_lock);
+	return NULL;
+}
+
+
+/**
+ * Start the controller if configured, called when the workers are spawned
+ */
+void LpelAdmissionStart(void)
+{
+	pthread_condattr_t attr;
+
+	if (adm_conf.interval == 0 || adm_running) return;
+	if (adm_conf.target_inflight == 0 && adm_conf.target_latency == 0) return;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&adm_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	inflight = 0;
+	exits = 0;
+	credit = adm_conf.min_credit;
+	_lpel_admission_active = 1;
+	adm_stop = 0;
+	if (0 == pthread_create(&adm_thread, NULL, AdmissionThread, NULL)) {
+		adm_running = 1;
+	} else {
+		_lpel_admission_active = 0;
+		credit = -1;
+		pthread_cond_destroy(&adm_cond);
+	}
+}
+
+
+/**
+ * Stop the controller, called when the workers are terminated
+ */
+void LpelAdmissionStop(void)
+{
+	if (!adm_running) return;
+
+	pthread_mutex_lock(&adm_lock);
+	adm_stop = 1;
+	pthread_cond_signal(&adm_cond);
+	pthread_mutex_unlock(&adm_lock);
+
+	(void) pthread_join(adm_thread, NULL);
+	pthread_cond_destroy(&adm_cond);
+	_lpel_admission_active = 0;
+	credit = -1;
+	adm_running = 0;
+}
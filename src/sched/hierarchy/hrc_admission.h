@@ -0,0 +1,18 @@
+#ifndef _HRC_ADMISSION_H_
+#define _HRC_ADMISSION_H_
+
+/*
+ * Admission control of the entry tasks, see LpelAdmissionInit()
+ */
+
+/* streams only count items while the controller runs */
+extern volatile int _lpel_admission_active;
+
+void LpelAdmissionMiddle(int delta);
+void LpelAdmissionExit(void);
+int  LpelAdmissionCredit(void);
+
+void LpelAdmissionStart(void);
+void LpelAdmissionStop(void);
+
+#endif /* _HRC_ADMISSION_H_ */
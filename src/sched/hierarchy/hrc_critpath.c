@@ -0,0 +1,163 @@
+/**********************************************************
+ * Desc:		Critical-path priority
+ * 			The scheduler keeps the distance of each task to the
+ * 			exit streams, in hops along the stream graph. It is
+ * 			updated when a task opens or closes a stream and
+ * 			propagated upstream as far as it changes.
+ * 			The downstream backlog, i.e. the items between a task
+ * 			and the exit along its shortest path, is refreshed
+ * 			whenever the priority of a task is calculated.
+ **********************************************************/
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "hrc_lpel.h"
+#include "lpelcfg.h"
+#include "hrc_task.h"
+#include "hrc_stream.h"
+#include "hrc_critpath.h"
+
+
+/* protects the depths and the stream arrays of all tasks */
+static pthread_mutex_t graph_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* tasks whose depth has to be recalculated, under graph_lock */
+static lpel_task_t **work = NULL;
+static int num_work = 0;
+static int alloc_work = 0;
+
+
+void LpelCritPathLock(void)
+{
+	pthread_mutex_lock(&graph_lock);
+}
+
+void LpelCritPathUnlock(void)
+{
+	pthread_mutex_unlock(&graph_lock);
+}
+
+
+static int hasSd(sd_array_t *arr, lpel_stream_desc_t *sd)
+{
+	int i;
+	for (i = 0; i < arr->count; i++)
+		if (arr->sds[i] == sd)
+			return 1;
+	return 0;
+}
+
+/* consumer of s, only if both ends have registered the stream */
+static lpel_task_t *consumerOf(lpel_stream_t *s)
+{
+	lpel_stream_desc_t *sd = s->cons_sd;
+	if (sd == NULL || sd->stream != s || sd->task == NULL)
+		return NULL;
+	return hasSd(&sd->task->sched_info.in_streams, sd) ? sd->task : NULL;
+}
+
+static lpel_task_t *producerOf(lpel_stream_t *s)
+{
+	lpel_stream_desc_t *sd = s->prod_sd;
+	if (sd == NULL || sd->stream != s || sd->task == NULL)
+		return NULL;
+	return hasSd(&sd->task->sched_info.out_streams, sd) ? sd->task : NULL;
+}
+
+static void pushWork(lpel_task_t *t)
+{
+	if (num_work == alloc_work) {
+		alloc_work = (alloc_work == 0) ? 16 : 2 * alloc_work;
+		work = (lpel_task_t **) realloc(work, alloc_work * sizeof(lpel_task_t *));
+	}
+	work[num_work++] = t;
+}
+
+/* recalculate the depth of t, its producers follow if it changed */
+static void updateDepth(lpel_task_t *t)
+{
+	sd_array_t *arr = &t->sched_info.out_streams;
+	lpel_stream_t *s;
+	lpel_task_t *c;
+	int i, depth = CRITPATH_MAX_DEPTH;
+
+	/* a task without outputs is an end of the graph as well */
+	if (arr->count == 0 || t->sched_info.out_term > 0)
+		depth = 0;
+	for (i = 0; i < arr->count && depth > 0; i++) {
+		s = arr->sds[i]->stream;
+		if (s == NULL)
+			continue;
+		if (s->type == LPEL_STREAM_EXIT)
+			depth = 0;
+		else if ((c = consumerOf(s)) != NULL && c->sched_info.cp_depth + 1 < depth)
+			depth = c->sched_info.cp_depth + 1;
+	}
+	if (depth == t->sched_info.cp_depth)
+		return;
+	t->sched_info.cp_depth = depth;
+
+	arr = &t->sched_info.in_streams;
+	for (i = 0; i < arr->count; i++) {
+		s = arr->sds[i]->stream;
+		if (s != NULL && (c = producerOf(s)) != NULL)
+			pushWork(c);
+	}
+}
+
+
+/**
+ * Task t has opened (added) or closed (removed) the stream of sd
+ *
+ * An output stream changes the depth of t, an input stream the
+ * depth of its producer.
+ * @pre graph lock held
+ */
+void LpelCritPathUpdate(lpel_task_t *t, lpel_stream_desc_t *sd, char mode)
+{
+	lpel_task_t *p;
+
+	if (mode == 'w')
+		pushWork(t);
+	else if (sd->stream != NULL && (p = producerOf(sd->stream)) != NULL)
+		pushWork(p);
+
+	/* depths are bounded, cycles in the graph terminate */
+	while (num_work > 0)
+		updateDepth(work[--num_work]);
+}
+
+
+/**
+ * Priority of a task on the critical path
+ *
+ * The closer to an exit stream and the more items downstream,
+ * the higher: (in + 1) * (backlog + 1) / (depth + 1)
+ */
+double LpelCritPathPriority(lpel_task_t *t, int in, int out)
+{
+	sd_array_t *arr = &t->sched_info.out_streams;
+	lpel_task_t *c, *next = NULL;
+	lpel_stream_t *s;
+	int i, backlog;
+
+	/* the consumer on the shortest path to the exit */
+	for (i = 0; i < arr->count; i++) {
+		s = arr->sds[i]->stream;
+		if (s == NULL || s->type == LPEL_STREAM_EXIT)
+			continue;
+		c = LpelStreamConsumer(s);
+		if (c != NULL && c->sched_info.cp_depth < t->sched_info.cp_depth
+				&& (next == NULL || c->sched_info.cp_depth < next->sched_info.cp_depth))
+			next = c;
+	}
+	backlog = (out > 0) ? out : 0;
+	if (next != NULL)
+		backlog += next->sched_info.cp_backlog;
+	t->sched_info.cp_backlog = backlog;
+
+	if (in < 0)
+		in = 0;
+	return (in + 1.0) * (backlog + 1.0) / (t->sched_info.cp_depth + 1.0);
+}
@@ -0,0 +1,20 @@
+#ifndef _HRC_CRITPATH_H_
+#define _HRC_CRITPATH_H_
+
+#include "hrc_task.h"
+
+/*
+ * Critical-path priority (prio_index LPEL_PRIO_CRITICAL_PATH)
+ */
+
+/* depth of a task without a path to an exit stream */
+#define CRITPATH_MAX_DEPTH	64
+
+#define LpelCritPathActive()	(PRIO_CFG(prio_index) == LPEL_PRIO_CRITICAL_PATH)
+
+void LpelCritPathLock(void);
+void LpelCritPathUnlock(void);
+void LpelCritPathUpdate(lpel_task_t *t, lpel_stream_desc_t *sd, char mode);
+double LpelCritPathPriority(lpel_task_t *t, int in, int out);
+
+#endif /* _HRC_CRITPATH_H_ */
@@ -0,0 +1,72 @@
+/**********************************************************
+ * Desc:		Memory budget of the items in flight
+ * 			Counts the items written to the middle and exit
+ * 			streams and not read yet. The drain mode is
+ * 			entered above the high mark and left below the
+ * 			low mark, on each change the queued tasks are
+ * 			re-evaluated.
+ **********************************************************/
+
+#include <stdlib.h>
+
+#include "hrc_lpel.h"
+#include "lpelcfg.h"
+#include "hrc_worker.h"
+#include "hrc_memory.h"
+
+
+static lpel_memory_config_t mem_conf = { 0, LPEL_MEMORY_HIGH_DEFAULT, LPEL_MEMORY_LOW_DEFAULT };
+
+volatile int _lpel_memory_active = 0;
+volatile int _lpel_memory_drain = 0;
+static volatile long usage = 0;
+static long high_mark = 0;
+static long low_mark = 0;
+
+
+/**
+ * Configure the budget, to be called before LpelStart()
+ */
+void LpelMemoryBudgetInit(lpel_memory_config_t *conf)
+{
+	mem_conf = *conf;
+	if (mem_conf.budget < 0) mem_conf.budget = 0;
+	if (mem_conf.high <= 0.0 || mem_conf.high > 1.0)
+		mem_conf.high = LPEL_MEMORY_HIGH_DEFAULT;
+	if (mem_conf.low <= 0.0 || mem_conf.low >= mem_conf.high)
+		mem_conf.low = (mem_conf.high < LPEL_MEMORY_LOW_DEFAULT) ?
+				mem_conf.high / 2 : LPEL_MEMORY_LOW_DEFAULT;
+
+	high_mark = (long) (mem_conf.budget * mem_conf.high);
+	low_mark = (long) (mem_conf.budget * mem_conf.low);
+	_lpel_memory_active = (mem_conf.budget > 0);
+}
+
+
+/**
+ * Bytes, or items without the rec_size callback, in flight
+ */
+long LpelMemoryUsage(void)
+{
+	return usage;
+}
+
+
+/* called by the streams after an item was written (sign 1) or read (sign -1) */
+void LpelMemoryAccount(void *item, int sign)
+{
+	long size = MON_CB(rec_size) ? MON_CB(rec_size)(item) : 1;
+	long used = __sync_add_and_fetch(&usage, sign * size);
+
+	/* only the thread changing the mode notifies the scheduler, it checks
+	 * again as the usage may have crossed the other mark meanwhile */
+	for (;;) {
+		if (used > high_mark && __sync_bool_compare_and_swap(&_lpel_memory_drain, 0, 1))
+			LpelWorkerReprioritise();
+		else if (used < low_mark && __sync_bool_compare_and_swap(&_lpel_memory_drain, 1, 0))
+			LpelWorkerReprioritise();
+		else
+			break;
+		used = usage;
+	}
+}
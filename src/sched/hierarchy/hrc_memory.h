@@ -0,0 +1,15 @@
+#ifndef _HRC_MEMORY_H_
+#define _HRC_MEMORY_H_
+
+/*
+ * Memory budget of the items in flight, see LpelMemoryBudgetInit()
+ */
+
+/* streams only count items if a budget is set */
+extern volatile int _lpel_memory_active;
+/* usage beyond the high mark, entry tasks are held back */
+extern volatile int _lpel_memory_drain;
+
+void LpelMemoryAccount(void *item, int sign);
+
+#endif /* _HRC_MEMORY_H_ */
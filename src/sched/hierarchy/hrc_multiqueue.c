@@ -0,0 +1,183 @@
+/**********************************************************
+ * Desc:		Relaxed concurrent priority queue
+ * 			A set of heaps, each protected by its own lock.
+ * 			Push goes to a random heap, pop takes the head of
+ * 			the better of two random heaps. The popped task is
+ * 			not necessarily the global maximum, but close to it.
+ **********************************************************/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <float.h>
+
+#include "lpelcfg.h"
+#include "lpel_main.h"
+#include "hrc_lpel.h"
+#include "hrc_task.h"
+#include "hrc_taskqueue.h"
+#include "hrc_multiqueue.h"
+
+typedef struct {
+	PRODLOCK_TYPE lock;
+	taskqueue_t *tq;
+	volatile double top;		// priority of the valid head, LPEL_DBL_MIN if none
+	char padding[64];
+} mqueue_t;
+
+struct multiqueue_t {
+	int num;
+	volatile int size;
+	mqueue_t *queues;
+};
+
+/* xorshift, the state is kept by the caller */
+static unsigned int randIndex(unsigned int *seed, int n) {
+	unsigned int x = *seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*seed = x;
+	return x % n;
+}
+
+/* @pre lock of q held */
+static void refreshTop(mqueue_t *q) {
+	lpel_task_t *t = LpelTaskqueuePeek(q->tq);
+	if (t == NULL || t->sched_info.valid == 0)
+		q->top = LPEL_DBL_MIN;
+	else
+		q->top = t->sched_info.prio;
+}
+
+
+multiqueue_t *LpelMultiqueueInit(int nqueues) {
+	int i;
+	multiqueue_t *mq = (multiqueue_t *) malloc(sizeof(multiqueue_t));
+	if (nqueues < 2)
+		nqueues = 2;
+	mq->num = nqueues;
+	mq->size = 0;
+	mq->queues = (mqueue_t *) malloc(nqueues * sizeof(mqueue_t));
+	for (i = 0; i < nqueues; i++) {
+		PRODLOCK_INIT(&mq->queues[i].lock);
+		mq->queues[i].tq = LpelTaskqueueInit();
+		mq->queues[i].top = LPEL_DBL_MIN;
+	}
+	return mq;
+}
+
+void LpelMultiqueueDestroy(multiqueue_t *mq) {
+	int i;
+	for (i = 0; i < mq->num; i++) {
+		PRODLOCK_DESTROY(&mq->queues[i].lock);
+		LpelTaskqueueDestroy(mq->queues[i].tq);
+	}
+	free(mq->queues);
+	free(mq);
+}
+
+
+/*
+ * Insert a ready task, its priority has to be set already
+ */
+void LpelMultiqueuePush(multiqueue_t *mq, lpel_task_t *t, unsigned int *seed) {
+	int i = randIndex(seed, mq->num);
+	mqueue_t *q = &mq->queues[i];
+
+	PRODLOCK_LOCK(&q->lock);
+	t->state = TASK_INQUEUE;
+	t->queue = i;
+	LpelTaskqueuePush(q->tq, t);
+	refreshTop(q);
+	PRODLOCK_UNLOCK(&q->lock);
+	/* full barrier, idle workers are checked afterwards */
+	(void) __sync_fetch_and_add(&mq->size, 1);
+}
+
+
+/* take the head of q if it is valid */
+static lpel_task_t *takeHead(multiqueue_t *mq, mqueue_t *q) {
+	lpel_task_t *t;
+	PRODLOCK_LOCK(&q->lock);
+	t = LpelTaskqueuePeek(q->tq);
+#ifdef _USE_NEG_DEMAND_LIMIT_
+	if (t != NULL && t->sched_info.valid == 0)
+		t = NULL;
+#endif
+	if (t != NULL) {
+		LpelTaskqueueOccupyTask(q->tq, t);
+		t->state = TASK_READY;
+		t->queue = -1;
+		(void) __sync_fetch_and_sub(&mq->size, 1);
+	}
+	refreshTop(q);
+	PRODLOCK_UNLOCK(&q->lock);
+	return t;
+}
+
+/*
+ * Take a task with a high priority
+ * @return NULL if both sampled heaps have no valid task
+ */
+lpel_task_t *LpelMultiqueuePop(multiqueue_t *mq, unsigned int *seed) {
+	int i = randIndex(seed, mq->num);
+	int j = randIndex(seed, mq->num);
+	lpel_task_t *t;
+
+	if (mq->queues[j].top > mq->queues[i].top) {
+		int k = i;
+		i = j;
+		j = k;
+	}
+	t = takeHead(mq, &mq->queues[i]);
+	if (t == NULL && j != i)
+		t = takeHead(mq, &mq->queues[j]);
+	return t;
+}
+
+
+/*
+ * Update validity and priority of a task if it is queued
+ */
+void LpelMultiqueueUpdate(multiqueue_t *mq, lpel_task_t *t, int update_prio) {
+	int i = t->queue;
+	mqueue_t *q;
+
+	if (i < 0)
+		return;
+	q = &mq->queues[i];
+	PRODLOCK_LOCK(&q->lock);
+	/* the task may have been taken meanwhile */
+	if (t->queue == i && t->state == TASK_INQUEUE) {
+		int valid = t->sched_info.valid;
+#ifdef _USE_NEG_DEMAND_LIMIT_
+		LpelTaskUpdateValid(t);
+#endif
+		if (update_prio)
+			LpelTaskqueueUpdatePriority(q->tq, t, LpelTaskCalPriority(t));
+		else if (valid != t->sched_info.valid)
+			LpelTaskqueueUpdatePriority(q->tq, t, t->sched_info.prio);
+		refreshTop(q);
+	}
+	PRODLOCK_UNLOCK(&q->lock);
+}
+
+
+/*
+ * Re-evaluate all queued tasks, heap by heap
+ */
+void LpelMultiqueueRefresh(multiqueue_t *mq) {
+	int i;
+	for (i = 0; i < mq->num; i++) {
+		mqueue_t *q = &mq->queues[i];
+		PRODLOCK_LOCK(&q->lock);
+		LpelTaskqueueRefresh(q->tq);
+		refreshTop(q);
+		PRODLOCK_UNLOCK(&q->lock);
+	}
+}
+
+
+int LpelMultiqueueSize(multiqueue_t *mq) {
+	return mq->size;
+}
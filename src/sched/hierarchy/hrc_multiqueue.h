@@ -0,0 +1,22 @@
+#ifndef _HRC_MULTIQUEUE_H_
+#define _HRC_MULTIQUEUE_H_
+
+#include "lpel_common.h"
+
+/*
+ * Relaxed concurrent priority queue (MultiQueue)
+ * used by the workers in the masterless mode
+ */
+typedef struct multiqueue_t multiqueue_t;
+
+multiqueue_t *LpelMultiqueueInit(int nqueues);
+void LpelMultiqueueDestroy(multiqueue_t *mq);
+
+void LpelMultiqueuePush(multiqueue_t *mq, lpel_task_t *t, unsigned int *seed);
+lpel_task_t *LpelMultiqueuePop(multiqueue_t *mq, unsigned int *seed);
+void LpelMultiqueueUpdate(multiqueue_t *mq, lpel_task_t *t, int update_prio);
+void LpelMultiqueueRefresh(multiqueue_t *mq);
+
+int LpelMultiqueueSize(multiqueue_t *mq);
+
+#endif /* _HRC_MULTIQUEUE_H_ */
@@ -11,6 +11,9 @@
 #include "hrc_task.h"
 #include "hrc_worker.h"
 #include "hrc_stream.h"
+#include "hrc_admission.h"
+#include "hrc_memory.h"
+#include "hrc_critpath.h"
 #include "lpel/monitor.h"
 
 
@@ -23,6 +26,7 @@
 #endif
 
 static atomic_int stream_seq = ATOMIC_VAR_INIT(0);
+static int middle_capacity = 0;
 
 
 
@@ -50,7 +54,9 @@ lpel_stream_t *LpelStreamCreate(int size)
   s->uid = atomic_fetch_add( &stream_seq, 1);
   PRODLOCK_INIT( &s->prod_lock );
   atomic_init( &s->n_sem, 0);
-  atomic_init( &s->e_sem, size);
+  s->size = size;
+  s->capacity = middle_capacity;
+  atomic_init( &s->e_sem, (s->capacity > 0) ? s->capacity : size);
   s->is_poll = 0;
   s->prod_sd = NULL;
   s->cons_sd = NULL;
@@ -81,6 +87,28 @@ void LpelStreamDestroy( lpel_stream_t *s)
 }
 
 
+/**
+ * Capacity of the middle streams created afterwards, 0 for unbounded
+ */
+void LpelStreamCapacityInit(int capacity)
+{
+  middle_capacity = (capacity > 0) ? capacity : 0;
+}
+
+
+/**
+ * Set the capacity of a middle stream, 0 for unbounded
+ *
+ * @pre   nothing has been written to the stream yet
+ */
+void LpelStreamSetCapacity(lpel_stream_t *s, int capacity)
+{
+  assert( LpelStreamFillLevel(s) == 0);
+  s->capacity = (capacity > 0) ? capacity : 0;
+  atomic_store( &s->e_sem, (s->capacity > 0) ? s->capacity : s->size);
+}
+
+
 /**
  * Store arbitrary user data in stream
  * CAUTION use at own risk
@@ -100,6 +128,43 @@ void *LpelStreamGetUsrData(lpel_stream_t *s)
 }
 
 
+/**
+ * Add the items and the entry/exit state of a stream to the
+ * aggregates of its consumer and producer task
+ *
+ * Called with negative values before and positive values after a change
+ * of the ends or the type of the stream.
+ * @param full  change of the number of full output streams of the producer
+ * @pre   prod_lock of the stream is held
+ */
+static void AccountStream( lpel_stream_t *s, int fill, int term, int full)
+{
+  lpel_task_t *t;
+
+  if (s->cons_sd != NULL && s->cons_sd->stream == s && (t = s->cons_sd->task) != NULL) {
+    if (s->type == LPEL_STREAM_ENTRY) {
+      if (term) (void) __sync_fetch_and_add( &t->sched_info.in_term, term);
+    } else if (fill) {
+      (void) __sync_fetch_and_add( &t->sched_info.in_fill, fill);
+    }
+  }
+  if (s->prod_sd != NULL && s->prod_sd->stream == s && (t = s->prod_sd->task) != NULL) {
+    if (s->type == LPEL_STREAM_EXIT) {
+      if (term) (void) __sync_fetch_and_add( &t->sched_info.out_term, term);
+    } else if (fill) {
+      (void) __sync_fetch_and_add( &t->sched_info.out_fill, fill);
+    }
+    if (full) (void) __sync_fetch_and_add( &t->sched_info.out_full, full);
+  }
+}
+
+/* full middle streams prevent their producer from being scheduled */
+#define IsFull(s)         ((s)->type == LPEL_STREAM_MIDDLE && (s)->capacity > 0 \
+                           && LpelStreamFillLevel(s) >= (s)->capacity)
+#define AccountRemove(s)  AccountStream( (s), -LpelStreamFillLevel(s), -1, -IsFull(s))
+#define AccountAdd(s)     AccountStream( (s), LpelStreamFillLevel(s), 1, IsFull(s))
+
+
 /**
   * Open a stream for reading/writing
  *
@@ -136,14 +201,24 @@ lpel_stream_desc_t *LpelStreamOpen( lpel_stream_t *s, char mode)
   sd->mon = NULL;
 #endif
 
+  PRODLOCK_LOCK( &s->prod_lock);
+  AccountRemove( s);
   switch(mode) {
     case 'r': s->cons_sd = sd; break;
     case 'w': s->prod_sd = sd; break;
   }
 
   /* set entry/exit stream */
-  if (LpelTaskIsSoSi(ct))
+  if (LpelTaskIsSoSi(ct)) {
   	s->type = (mode == 'r' ? LPEL_STREAM_EXIT : LPEL_STREAM_ENTRY);
+  	/* the source is the producer, it has not written yet */
+  	if (mode == 'w' && s->capacity > 0) {
+  	  s->capacity = 0;
+  	  atomic_store( &s->e_sem, s->size - LpelStreamFillLevel(s));
+  	}
+  }
+  AccountAdd( s);
+  PRODLOCK_UNLOCK( &s->prod_lock);
 
   STREAM_DBG("task %d open stream %d, mode %c\n", ct->uid, s->uid, mode);
   LpelTaskAddStream(ct, sd, mode);
@@ -168,6 +243,10 @@ void LpelStreamClose( lpel_stream_desc_t *sd, int destroy_s)
 
   STREAM_DBG("task %d close one stream, mode %c\n", sd->task->uid, sd->mode);
   workerctx_t *wc = sd->task->worker_context;
+  lpel_task_t *prod;
+  /* before the stream is torn down, the critical path has to see
+   * the producer of a destroyed stream to recalculate its depth */
+  LpelTaskRemoveStream(sd->task, sd, sd->mode);
   if (destroy_s) {
   	STREAM_DBG("task %d destroy stream %d, mode %c\n", sd->task->uid, sd->stream->uid, sd->mode);
   	assert(sd->mode == 'r');
@@ -175,14 +254,30 @@ void LpelStreamClose( lpel_stream_desc_t *sd, int destroy_s)
   	assert(LpelBufferIsEmpty(&s->buffer));
 
   	/* free the stream structure */
+  	PRODLOCK_LOCK( &s->prod_lock);
+  	AccountRemove( s);
+  	/* this task no longer updates the producer when it is returned */
+  	if ((prod = LpelStreamProducer( s)) != NULL)
+  		LpelWorkerTaskUpdate(prod);
   	s->prod_sd->stream = NULL;			// unset the stream pointer of producer
   	s->prod_sd = NULL;							// unset producer
   	s->cons_sd = NULL;							// unset consumer
+  	PRODLOCK_UNLOCK( &s->prod_lock);
   	LpelWorkerPutStream(wc, s);				// put back to worker's free list
   	sd->stream = NULL;
   }
-  LpelTaskRemoveStream(sd->task, sd, sd->mode);
-  sd->task = NULL;								// unset only the pointer to task
+  if (sd->stream != NULL) {
+  	lpel_stream_t *s = sd->stream;
+  	PRODLOCK_LOCK( &s->prod_lock);
+  	AccountRemove( s);
+  	sd->task = NULL;								// unset only the pointer to task
+  	AccountAdd( s);
+  	/* this task no longer updates the producer when it is returned */
+  	if (sd->mode == 'r' && (prod = LpelStreamProducer( s)) != NULL)
+  		LpelWorkerTaskUpdate(prod);
+  	PRODLOCK_UNLOCK( &s->prod_lock);
+  } else
+  	sd->task = NULL;								// unset only the pointer to task
   LpelWorkerPutSd(wc, sd);				// put back to worker's free list
 }
 
@@ -202,20 +297,34 @@ void LpelStreamReplace( lpel_stream_desc_t *sd, lpel_stream_t *snew)
 
   workerctx_t *wc = sd->task->worker_context;
   lpel_stream_t *s = sd->stream;
-  snew->type = s->type;
 
   /* free the old stream */
+  PRODLOCK_LOCK( &s->prod_lock);
+  AccountRemove( s);
   s->prod_sd->stream = NULL;
   s->prod_sd = NULL;
   s->cons_sd = NULL;
+  PRODLOCK_UNLOCK( &s->prod_lock);
   assert(LpelBufferIsEmpty(&s->buffer));
-  LpelWorkerPutStream(wc, s);
 
   /* assign new stream */
+  PRODLOCK_LOCK( &snew->prod_lock);
+  AccountRemove( snew);
+  snew->type = s->type;
   lpel_stream_desc_t *old_cons = snew->cons_sd;
   old_cons->stream = NULL;			// unset the stream pointer of the old consumer
   snew->cons_sd = sd;
   sd->stream = snew;
+  AccountAdd( snew);
+  PRODLOCK_UNLOCK( &snew->prod_lock);
+  LpelWorkerPutStream(wc, s);
+
+  /* the producer of snew has a new consumer */
+  if (LpelCritPathActive()) {
+    LpelCritPathLock();
+    LpelCritPathUpdate(sd->task, sd, 'r');
+    LpelCritPathUnlock();
+  }
 
   /* MONITORING CALLBACK */
 #ifdef USE_TASK_EVENT_LOGGING
@@ -267,6 +376,9 @@ void *LpelStreamRead( lpel_stream_desc_t *sd)
 {
   void *item;
   lpel_task_t *self = sd->task;
+  lpel_task_t *prod;
+  int on_wrapper = (self->worker_context->wid < 0);
+  int was_full;
   assert( sd->mode == 'r');
 
   /* MONITORING CALLBACK */
@@ -286,6 +398,10 @@ void *LpelStreamRead( lpel_stream_desc_t *sd)
     }
 #endif
 
+    /* the producer may have been held back by the items read before */
+    if (on_wrapper && (prod = LpelStreamProducer( sd->stream)) != NULL)
+      LpelWorkerTaskUpdate(prod);
+
     /* wait on stream: */
     LpelTaskBlockStream( self);
   }
@@ -296,9 +412,26 @@ void *LpelStreamRead( lpel_stream_desc_t *sd)
   assert( item != NULL);
   /* pop off the top element */
   LpelBufferPop( &sd->stream->buffer);
+  self->sched_info.svc_recs++;
+  PRODLOCK_LOCK( &sd->stream->prod_lock);
+  was_full = IsFull( sd->stream);
+  AccountStream( sd->stream, -1, 0, -was_full);
   sd->stream->read_cnt++;
-  /* only entry stream is bounded */
-  if (sd->stream->type == LPEL_STREAM_ENTRY) {
+  prod = LpelStreamProducer( sd->stream);
+  /* the producer may be queued as invalid while the stream was full, this
+   * task may close the stream before it is returned to update its neighbours;
+   * tasks on wrappers are never returned. The producer cannot exit while
+   * the lock is held.
+   */
+  if (prod != NULL && (was_full || (on_wrapper && prod->sched_info.valid == 0)))
+    LpelWorkerTaskUpdate(prod);
+  PRODLOCK_UNLOCK( &sd->stream->prod_lock);
+  if (_lpel_admission_active && sd->stream->type == LPEL_STREAM_MIDDLE)
+    LpelAdmissionMiddle(-1);
+  if (_lpel_memory_active && sd->stream->type != LPEL_STREAM_ENTRY)
+    LpelMemoryAccount(item, -1);
+  /* only entry streams and middle streams with a capacity are bounded */
+  if (LpelStreamIsBounded(sd->stream)) {
   	/* quasi V(e_sem) */
   	if ( atomic_fetch_add( &sd->stream->e_sem, 1) < 0) {
   		/* e_sem was -1 */
@@ -315,6 +448,8 @@ void *LpelStreamRead( lpel_stream_desc_t *sd)
 
   	}
   }
+  /* a producer woken up above is kept only if this task stops soon */
+  LpelWorkerReleaseCont(self);
 
 
   /* MONITORING CALLBACK */
@@ -355,8 +490,8 @@ void LpelStreamWrite( lpel_stream_desc_t *sd, void *item)
   }
 #endif
 
-  /* only entry stream is bounded */
-  if (sd->stream->type == LPEL_STREAM_ENTRY) {
+  /* only entry streams and middle streams with a capacity are bounded */
+  if (LpelStreamIsBounded(sd->stream)) {
   	/* quasi P(e_sem) */
   	if ( atomic_fetch_sub( &sd->stream->e_sem, 1)== 0) {
 
@@ -380,6 +515,14 @@ void LpelStreamWrite( lpel_stream_desc_t *sd, void *item)
     /* put item into buffer */
     LpelBufferPut( &sd->stream->buffer, item);
     sd->stream->write_cnt++;
+    AccountStream( sd->stream, 1, 0,
+        IsFull( sd->stream) && LpelStreamFillLevel(sd->stream) == sd->stream->capacity);
+    if (_lpel_admission_active) {
+      if (sd->stream->type == LPEL_STREAM_MIDDLE)
+        LpelAdmissionMiddle(1);
+      else if (sd->stream->type == LPEL_STREAM_EXIT)
+        LpelAdmissionExit();
+    }
     if ( sd->stream->is_poll) {
       /* get consumer's poll token */
       poll_wakeup = atomic_exchange( &sd->stream->cons_sd->task->poll_token, 0);
@@ -387,7 +530,8 @@ void LpelStreamWrite( lpel_stream_desc_t *sd, void *item)
     }
   }
   PRODLOCK_UNLOCK( &sd->stream->prod_lock);
-
+  if (_lpel_memory_active && sd->stream->type != LPEL_STREAM_ENTRY)
+    LpelMemoryAccount(item, 1);
 
 
   /* quasi V(n_sem) */
@@ -426,6 +570,9 @@ void LpelStreamWrite( lpel_stream_desc_t *sd, void *item)
   }
 #endif
 
+  /* entry tasks give up the worker as soon as the network drains */
+  if (_lpel_memory_drain && LpelTaskDrainYield(self))
+    return;
 
 #ifdef USE_LOGGING
   if (MON_CB(rectype_data))		/* apply limit check on data only if possible */
@@ -450,6 +597,9 @@ int LpelStreamTryWrite( lpel_stream_desc_t *sd, void *item)
   if (!LpelBufferIsSpace(&sd->stream->buffer)) {
     return -1;
   }
+  if (LpelStreamIsBounded(sd->stream) && atomic_load( &sd->stream->e_sem) <= 0) {
+    return -1;
+  }
   LpelStreamWrite( sd, item );
   return 0;
 }
@@ -36,8 +36,13 @@ struct lpel_stream_t {
   lpel_stream_type type;			/* stream type (entry/exit/middle) */
   int read_cnt;								/* read counter, to calculate fill level */
   int write_cnt;							/* write counter, to calculate fill level */
+  int size;										/* capacity of an entry stream */
+  int capacity;								/* capacity of a middle stream, 0 if unbounded */
 };
 
+/* entry streams and middle streams with a capacity block the producer */
+#define LpelStreamIsBounded(s)	((s)->type == LPEL_STREAM_ENTRY || (s)->capacity > 0)
+
 
 int LpelStreamFillLevel(lpel_stream_t *s);
 lpel_task_t *LpelStreamConsumer(lpel_stream_t *s);
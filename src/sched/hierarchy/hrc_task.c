@@ -3,15 +3,20 @@
 #include <stdio.h>
 #include "arch/atomic.h"
 #include <float.h>
+#include <limits.h>
 
 #include "hrc_task.h"
 #include "hrc_stream.h"
 #include "lpelcfg.h"
 #include "hrc_worker.h"
+#include "hrc_admission.h"
+#include "hrc_memory.h"
+#include "hrc_critpath.h"
 #include "lpel/monitor.h"
 #include "taskpriority.h"
 
 static atomic_int taskseq = ATOMIC_VAR_INIT(0);
+static int slice_us = LPEL_TASK_SLICE_DEFAULT;
 
 static void TaskStartup( void *arg);
 
@@ -70,6 +75,9 @@ lpel_task_t *LpelTaskCreate( int map, lpel_taskfunc_t func,
 
 	t->state = TASK_CREATED;
 	t->wakenup = 0;
+	t->home = 0;
+	t->last_worker = -1;
+	t->queue = -1;
 
 	t->prev = t->next = NULL;
 
@@ -92,9 +100,25 @@ lpel_task_t *LpelTaskCreate( int map, lpel_taskfunc_t func,
 	t->sched_info.rec_cnt = 0;
 	t->sched_info.rec_limit = 0;
 	t->sched_info.rec_limit_factor = -1;
-	t->sched_info.in_streams = NULL;
-	t->sched_info.out_streams = NULL;
+	t->sched_info.slice_limit = 1;
+	t->sched_info.slice_start = 0;
+	t->sched_info.rec_cost = 0;
+	t->sched_info.svc_start = 0;
+	t->sched_info.svc_cycles = 0;
+	t->sched_info.svc_recs = 0;
+	t->sched_info.svc_cost = 0;
+	t->sched_info.in_streams.sds = NULL;
+	t->sched_info.in_streams.count = t->sched_info.in_streams.alloc = 0;
+	t->sched_info.out_streams.sds = NULL;
+	t->sched_info.out_streams.count = t->sched_info.out_streams.alloc = 0;
+	t->sched_info.in_fill = t->sched_info.out_fill = 0;
+	t->sched_info.in_term = t->sched_info.out_term = 0;
+	t->sched_info.out_full = 0;
+	t->sched_info.dirty = 0;
+	t->sched_info.cp_depth = CRITPATH_MAX_DEPTH;
+	t->sched_info.cp_backlog = 0;
 	t->sched_info.valid = 1;
+	t->sched_info.qpos = -1;
 
 	return t;
 }
@@ -124,8 +148,10 @@ void LpelTaskDestroy( lpel_task_t *t)
 #endif
 
 
-	assert(t->sched_info.in_streams == NULL);
-	assert(t->sched_info.out_streams == NULL);
+	assert(t->sched_info.in_streams.count == 0);
+	assert(t->sched_info.out_streams.count == 0);
+	free(t->sched_info.in_streams.sds);
+	free(t->sched_info.out_streams.sds);
 	/* free the TCB itself*/
 	assert(t->prev == NULL && t->next == NULL);
 	if(t->sched_info.rts_prio && PRIO_CFG(rts_del_prio))
@@ -278,6 +304,59 @@ static void TaskStartup( void *data)
 }
 
 
+/* number of records expected to fit into the given time */
+static int SliceRecords( lpel_task_t *t, lpel_cycles_t cycles)
+{
+	lpel_cycles_t n;
+	if (t->sched_info.rec_cost == 0)
+		return 1;		// not measured yet, read the clock after the first record
+	n = cycles / t->sched_info.rec_cost;
+	if (n < 1)
+		return 1;
+	return (n > INT_MAX / 2) ? INT_MAX / 2 : (int) n;
+}
+
+/*
+ * Called with the adaptive record limit reached: measure the cost per
+ * record and extend the limit if the slice is not used up yet
+ * @return 1 if the slice is used up
+ */
+static int SliceExpired( lpel_task_t *t)
+{
+	sched_task_t *si = &t->sched_info;
+	lpel_cycles_t slice = LPEL_US_TO_CYCLES(slice_us);
+	lpel_cycles_t elapsed = LpelCyclesNow() - si->slice_start;
+	lpel_cycles_t cost = elapsed / si->rec_cnt;
+
+	si->rec_cost = (si->rec_cost == 0) ? cost : (3 * si->rec_cost + cost) / 4;
+	if (si->rec_cost == 0)
+		si->rec_cost = 1;
+	if (elapsed >= slice)
+		return 1;
+	si->slice_limit = si->rec_cnt + SliceRecords(t, slice - elapsed);
+	return 0;
+}
+
+/*
+ * Account the time of the dispatch to the records read, dispatches
+ * without a record are added to the next one
+ */
+static void ServiceTime( lpel_task_t *t)
+{
+	sched_task_t *si = &t->sched_info;
+	lpel_cycles_t cost;
+
+	si->svc_cycles += LpelCyclesNow() - si->svc_start;
+	if (si->svc_recs == 0)
+		return;
+	cost = si->svc_cycles / si->svc_recs;
+	si->svc_cost = (si->svc_cost == 0) ? cost : (3 * si->svc_cost + cost) / 4;
+	if (si->svc_cost == 0)
+		si->svc_cost = 1;
+	si->svc_cycles = 0;
+	si->svc_recs = 0;
+}
+
 static void TaskStart( lpel_task_t *t)
 {
 	// TODO reset task scheduling info
@@ -291,6 +370,11 @@ static void TaskStart( lpel_task_t *t)
 #endif
 
 	t->sched_info.rec_cnt = 0;	// reset rec_cnt
+	t->sched_info.svc_start = LpelCyclesNow();
+	if (slice_us > 0) {
+		t->sched_info.slice_start = LpelCyclesNow();
+		t->sched_info.slice_limit = SliceRecords(t, LPEL_US_TO_CYCLES(slice_us));
+	}
 	t->state = TASK_RUNNING;
 }
 
@@ -304,6 +388,7 @@ static void TaskStop( lpel_task_t *t)
 	}
 #endif
 
+	ServiceTime(t);
 }
 
 
@@ -315,7 +400,20 @@ void LpelTaskCheckYield(lpel_task_t *t) {
 
 	assert( t->state == TASK_RUNNING );
 
-	if (t->sched_info.rec_limit < 0) {		//limit < 0 --> no yield
+	if (t->sched_info.rec_limit < 0) {		//limit < 0 --> no yield, also with a time slice
+		LpelWorkerReleaseCont(t);
+		return;
+	}
+
+	if (slice_us > 0) {		// time-based quantum replaces the record limit
+		t->sched_info.rec_cnt ++;
+		if (t->sched_info.rec_cnt >= t->sched_info.slice_limit && SliceExpired(t)) {
+			t->state = TASK_READY;
+			TaskStop( t);
+			LpelWorkerTaskYield(t);
+			TaskStart( t);
+		} else
+			LpelWorkerReleaseCont(t);
 		return;
 	}
 
@@ -324,96 +422,154 @@ void LpelTaskCheckYield(lpel_task_t *t) {
 		TaskStop( t);
 		LpelWorkerTaskYield(t);
 		TaskStart( t);
-	}
+	} else
+		LpelWorkerReleaseCont(t);
 	t->sched_info.rec_cnt ++;
 
 }
 
+/*
+ * Yield if the task would not be scheduled any more, i.e. an entry task
+ * once the network drains
+ * @return 1 if the task yielded
+ */
+int LpelTaskDrainYield(lpel_task_t *t) {
+	assert( t->state == TASK_RUNNING );
+	if (t->worker_context->wid < 0 || LpelTaskUpdateValid(t) != 0)
+		return 0;
+	t->state = TASK_READY;
+	TaskStop( t);
+	LpelWorkerTaskYield(t);
+	TaskStart( t);
+	return 1;
+}
+
 void LpelTaskSetRecLimit(lpel_task_t *t, int lim) {
 	t->sched_info.rec_limit_factor = lim;
 }
 
+void LpelTaskSliceInit(int us) {
+	slice_us = (us > 0) ? us : 0;
+}
+
 void LpelTaskSetPrior(lpel_task_t *t, double p) {
 	t->sched_info.prio = p;
 }
 
 
 void LpelTaskAddStream( lpel_task_t *t, lpel_stream_desc_t *des, char mode) {
-	stream_elem_t **list;
-	stream_elem_t *head;
+	sd_array_t *arr;
+	int cp;
 	switch (mode) {
 	case 'r':
-		list = &t->sched_info.in_streams;
+		arr = &t->sched_info.in_streams;
 		break;
 	case 'w':
-		list = &t->sched_info.out_streams;
+		arr = &t->sched_info.out_streams;
 		t->sched_info.rec_limit += t->sched_info.rec_limit_factor;
 		break;
+	default:
+		assert(0);
+		return;
+	}
+	/* the arrays are walked by the critical-path update,
+	 * the priority may be switched meanwhile */
+	cp = LpelCritPathActive();
+	if (cp)
+		LpelCritPathLock();
+	if (arr->count == arr->alloc) {
+		arr->alloc = (arr->alloc == 0) ? 4 : 2 * arr->alloc;
+		arr->sds = (lpel_stream_desc_t **) realloc(arr->sds, arr->alloc * sizeof(lpel_stream_desc_t *));
+	}
+	arr->sds[arr->count++] = des;
+	if (cp) {
+		LpelCritPathUpdate(t, des, mode);
+		LpelCritPathUnlock();
 	}
-	head = *list;
-	stream_elem_t *new = (stream_elem_t *) malloc(sizeof(stream_elem_t));
-	new->stream_desc = des;
-	if (head)
-		new->next = head;
-  else
-		new->next = NULL;
-	*list = new;
 }
 
 
 void LpelTaskRemoveStream( lpel_task_t *t, lpel_stream_desc_t *des, char mode) {
-	stream_elem_t **list;
-	stream_elem_t *head;
+	sd_array_t *arr;
+	int i, cp;
 	switch (mode) {
 	case 'r':
-		list = &t->sched_info.in_streams;
+		arr = &t->sched_info.in_streams;
 		break;
 	case 'w':
-		list = &t->sched_info.out_streams;
+		arr = &t->sched_info.out_streams;
 		t->sched_info.rec_limit -= t->sched_info.rec_limit_factor;
 		break;
+	default:
+		assert(0);
+		return;
 	}
-	head = *list;
 
-	stream_elem_t *prev = NULL;
-
-	while (head != NULL) {
-		if (head->stream_desc == des)
+	cp = LpelCritPathActive();
+	if (cp)
+		LpelCritPathLock();
+	for (i = 0; i < arr->count; i++) {
+		if (arr->sds[i] == des)
 			break;
-		prev = head;
-		head = head->next;
 	}
+	assert(i < arr->count);		//item must be in the array
+	arr->sds[i] = arr->sds[--arr->count];
+	if (cp) {
+		LpelCritPathUpdate(t, des, mode);
+		LpelCritPathUnlock();
+	}
+}
 
-	assert(head != NULL);		//item must be in the list
-	if (prev == NULL)
-		*list = head->next;
-	else
-		prev->next = head->next;
 
-	free(head);
+/*
+ * number of records in the input/output streams
+ * -1 if there are no streams, or only entry/exit streams which are empty
+ */
+static int countRec(sd_array_t *arr, int fill, int term) {
+	if (arr->count == 0)
+		return -1;
+	if (term > 0 && fill == 0)
+		return -1;
+	return fill;
 }
 
+static inline int countIn(lpel_task_t *t) {
+	return countRec(&t->sched_info.in_streams, t->sched_info.in_fill, t->sched_info.in_term);
+}
 
+static inline int countOut(lpel_task_t *t) {
+	return countRec(&t->sched_info.out_streams, t->sched_info.out_fill, t->sched_info.out_term);
+}
 
-int countRec(stream_elem_t *list, char inout) {
-	if (list == NULL)
-		return -1;
-	int cnt = 0;
-	int flag = 0;
-	while (list != NULL) {
-		if (list->stream_desc->stream) {
-			if ((inout == 'i' && list->stream_desc->stream->type == LPEL_STREAM_ENTRY)
-					|| (inout == 'o' && list->stream_desc->stream->type == LPEL_STREAM_EXIT)) {
-				// if input stream is entry or output stream is exit --> not count
-				flag = 1;
-			} else
-				cnt += LpelStreamFillLevel(list->stream_desc->stream);
-		}
-		list = list->next;
+/* measured time per input record in us, 1 us if not measured yet */
+static inline double recordTime(lpel_task_t *t) {
+	if (t == NULL || t->sched_info.svc_cost == 0)
+		return 1.0;
+	return (double) t->sched_info.svc_cost / _lpel_cycles_per_us;
+}
+
+/* estimated work of the records in the input streams of t, -1 as countIn */
+static double inWork(lpel_task_t *t, int in) {
+	if (in < 0)
+		return -1.0;
+	return in * recordTime(t);
+}
+
+/* estimated work of the records in the output streams, for their consumers */
+static double outWork(lpel_task_t *t, int out) {
+	sd_array_t *arr = &t->sched_info.out_streams;
+	lpel_stream_t *s;
+	double work = 0.0;
+	int i;
+	if (out < 0)
+		return -1.0;
+	for (i = 0; i < arr->count; i++) {
+		s = arr->sds[i]->stream;
+		if (s == NULL || s->type == LPEL_STREAM_EXIT)
+			continue;
+		work += LpelStreamFillLevel(s) * recordTime(LpelStreamConsumer(s));
 	}
-	if (flag == 1 && cnt == 0)
-		cnt = -1;
-	return cnt;
+	return work;
 }
 
 double LpelTaskInitPriority() {
@@ -428,16 +584,26 @@ double LpelTaskInitPriority() {
 }
 
 int LpelTaskUpdateValid(lpel_task_t *t) {
-	int in, out;
-	in = countRec(t->sched_info.in_streams, 'i');
-	out = countRec(t->sched_info.out_streams, 'o');
+	int in, out, lim;
+	in = countIn(t);
+	out = countOut(t);
+	/* credit of the entry tasks, adapted by the admission controller if it runs */
+	lim = LpelAdmissionCredit();
+	if (lim < 0)
+		lim = PRIO_CFG(neg_demand_lim);
+	/* if all output streams are full, the task would block on its next write */
+	if (t->sched_info.out_full > 0 && t->sched_info.out_full == t->sched_info.out_streams.count)
+		t->sched_info.valid = 0;
 	/* if t is entry task and already produced too many ouput, set it to invalid and it will not be scheduled */
-	if (in == -1 && PRIO_CFG(neg_demand_lim) > 0) {
-		if (out > PRIO_CFG(neg_demand_lim))
+	else if (in == -1) {
+		if (_lpel_memory_drain)		// no new items while the network drains
+			t->sched_info.valid = 0;
+		else if (lim > 0 && out > lim)
 			t->sched_info.valid = 0;
 		else
 			t->sched_info.valid = 1;
-	}
+	} else
+		t->sched_info.valid = 1;
 
 	return t->sched_info.valid;
 }
@@ -447,8 +613,15 @@ double LpelTaskCalPriority(lpel_task_t *t) {
 		return t->sched_info.prio;
 
 	int in, out;
-	in = countRec(t->sched_info.in_streams, 'i');
-	out = countRec(t->sched_info.out_streams, 'o');
+	in = countIn(t);
+	out = countOut(t);
+	/* draining: the consumers of the fullest streams first */
+	if (_lpel_memory_drain)
+		return in;
+	if (LpelCritPathActive())
+		return LpelCritPathPriority(t, in, out);
+	if (PRIO_CFG(prio_index) == LPEL_PRIO_WORK_BALANCE || PRIO_CFG(prio_index) == LPEL_PRIO_WORK_RATIO)
+		return priorwork(PRIO_CFG(prio_index), inWork(t, in), outWork(t, out));
 	return PRIO_CFG(prio_func)(in, out);
 }
 
@@ -7,6 +7,7 @@
 
 
 #include "arch/atomic.h"
+#include "arch/cycles.h"
 
 #define LPEL_DBL_MIN (0.0 - DBL_MAX)
 
@@ -19,26 +20,50 @@
 struct workerctx_t;
 struct mon_task_t;
 
-struct stream_elem_t {
-	struct lpel_stream_desc_t *stream_desc;
-	struct stream_elem_t *next;
-};
-
-typedef struct stream_elem_t stream_elem_t;
+/* stream descriptors opened by a task, in one direction */
+typedef struct {
+	struct lpel_stream_desc_t **sds;
+	int count;
+	int alloc;
+} sd_array_t;
 
 typedef struct {
 	int rec_cnt;
 	int rec_limit_factor;
 	int rec_limit;
 
+	/* time-based quantum */
+	int slice_limit;				// records after which the clock is read
+	lpel_cycles_t slice_start;	// start of the current slice
+	lpel_cycles_t rec_cost;		// smoothed cycles per record, 0 if not measured yet
+
+	/* service time, measured over the dispatches */
+	lpel_cycles_t svc_start;		// start of the current dispatch
+	lpel_cycles_t svc_cycles;		// cycles run since the last record was read
+	int svc_recs;								// records read since then
+	lpel_cycles_t svc_cost;			// smoothed cycles per input record, 0 if not measured yet
+
 	/* rts priority info */
 	void *rts_prio;
 
 	/* lpel priority info */
 	double prio;
 	int valid;		// not valid for schedule at the moment (e.g. when #out rec of entry task < neg_demand_lim)
-	stream_elem_t *in_streams;
-	stream_elem_t *out_streams;
+	int qpos;			// position in the ready queue, -1 if not queued
+	sd_array_t in_streams;
+	sd_array_t out_streams;
+
+	/* aggregates over the streams, maintained as items move (see hrc_stream.c) */
+	volatile int in_fill;		// items in the input streams, except entry streams
+	volatile int out_fill;	// items in the output streams, except exit streams
+	volatile int in_term;		// number of entry input streams
+	volatile int out_term;	// number of exit output streams
+	volatile int out_full;	// number of bounded output streams at capacity
+	volatile int dirty;			// domain+1 of the master with a pending update, 0 if none
+
+	/* critical path, see hrc_critpath.c */
+	int cp_depth;		// hops to an exit stream
+	int cp_backlog;	// items downstream along the shortest path
 } sched_task_t;
 
 
@@ -53,6 +78,9 @@ struct lpel_task_t {
   int wakenup;						/** to keep track that the task has been waked up before returned */
 
   struct workerctx_t *worker_context;  /** worker context for this task */
+  int home;							/** scheduling domain whose master owns the task */
+  int last_worker;				/** worker which ran the task last, -1 if none */
+  int queue;						/** heap of the shared queue holding the task, masterless mode */
 
   /**
    * indicates the SD which points to the stream which has new data
@@ -95,5 +123,6 @@ void LpelTaskRemoveStream(lpel_task_t *t, lpel_stream_desc_t *des, char mode);
 double LpelTaskCalPriority(lpel_task_t *t);
 double LpelTaskInitPriority();
 int LpelTaskUpdateValid(lpel_task_t *t) ;
+int LpelTaskDrainYield(lpel_task_t *t);
 
 #endif
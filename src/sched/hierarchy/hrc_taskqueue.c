@@ -2,9 +2,11 @@
  * Author: 	Nga
  *
  * Desc:		Priority task queue
- * 			Implemented by a heap structure
- * 			Tasks are stored in an array initialsed with fix size.
- * 			When the array is full, it is reallocated.
+ * 			Implemented by an indexed 4-ary heap.
+ * 			Each task keeps its position in the heap (sched_info.qpos),
+ * 			so that its priority can be updated and it can be removed
+ * 			in O(log n) without searching.
+ * 			The array doubles its size when it is full.
  **********************************************************/
 
 
@@ -16,9 +18,11 @@
 #include "hrc_taskqueue.h"
 #include "hrc_task.h"
 
-#ifdef USE_HEAP_QUEUE
+#define ARITY 4
+#define INITSIZE 64
 
-#define BLOCKSIZE 50
+#define PARENT(i)	(((i) - 1) / ARITY)
+#define CHILD(i)	((i) * ARITY + 1)
 
 struct taskqueue_t{
   lpel_task_t **heap;
@@ -27,71 +31,81 @@ struct taskqueue_t{
 };
 
 
-int comparePrior(lpel_task_t *t1, lpel_task_t *t2) {
+/*
+ * > 0 if t1 has to be scheduled before t2, 0 if equal
+ * invalid tasks are behind all valid tasks
+ */
+static int comparePrior(lpel_task_t *t1, lpel_task_t *t2) {
+	int (*cmp)(void *, void *);
 	int valid = t1->sched_info.valid - t2->sched_info.valid;
 	if (valid != 0)	/* one of the two task is invalid */
 		return valid;
 	else if (t1->sched_info.valid == 0)	/* both of the task are invalid, consider they equal */
 		return 0;
 
-	if (PRIO_CFG(rts_prio_cmp) == NULL)
-		return (t1->sched_info.prio - t2->sched_info.prio);
+	/* read once, the configuration may be switched meanwhile */
+	cmp = PRIO_CFG(rts_prio_cmp);
+	if (cmp == NULL) {
+		double d = t1->sched_info.prio - t2->sched_info.prio;
+		return (d > 0) - (d < 0);
+	}
 
 	assert(t1->sched_info.rts_prio && t2->sched_info.rts_prio);
-	return (double)PRIO_CFG(rts_prio_cmp)(t1->sched_info.rts_prio, t2->sched_info.rts_prio);
+	return cmp(t1->sched_info.rts_prio, t2->sched_info.rts_prio);
 }
 
 /******************** private functions ********************/
-void upHeap(taskqueue_t *tq, int pos) {
+static inline void place(taskqueue_t *tq, int pos, lpel_task_t *t) {
+	tq->heap[pos] = t;
+	t->sched_info.qpos = pos;
+}
+
+static void upHeap(taskqueue_t *tq, int pos) {
 	int parent;
 	lpel_task_t *t = tq->heap[pos];
-	  /* append at end, then up heap */
-	  while ((parent = pos / 2) &&  comparePrior(t, tq->heap[parent]) > 0) {
-	  	//p > tq->heap[parent]->sched_info.prio)
-	    tq->heap[pos] = tq->heap[parent];
-	    pos = parent;
-	  }
-	  tq->heap[pos] = t;
+	while (pos > 0 && comparePrior(t, tq->heap[parent = PARENT(pos)]) > 0) {
+		place(tq, pos, tq->heap[parent]);
+		pos = parent;
+	}
+	place(tq, pos, t);
 }
 
-void downHeap(taskqueue_t *tq, int pos) {
-	  int child;
-		lpel_task_t *t = tq->heap[pos];
-		while( (child = pos * 2) < tq->count) {
-			if (child + 1 < tq->count && comparePrior(tq->heap[child], tq->heap[child + 1]) < 0)
-					//tq->heap[child]->sched_info.prio < tq->heap[child+1]->sched_info.prio)
-				child++;
-
-			if (comparePrior(t, tq->heap[child]) >= 0)
-			//if (p >= tq->heap[child]->sched_info.prio)
-				break;
-
-			tq->heap[pos] = tq->heap[child];
-			pos = child;
+static void downHeap(taskqueue_t *tq, int pos) {
+	int child, best, last;
+	lpel_task_t *t = tq->heap[pos];
+	while ((child = CHILD(pos)) < tq->count) {
+		/* highest of the children */
+		best = child;
+		last = child + ARITY;
+		if (last > tq->count)
+			last = tq->count;
+		for (child++; child < last; child++) {
+			if (comparePrior(tq->heap[child], tq->heap[best]) > 0)
+				best = child;
 		}
-		tq->heap[pos] = t;
-
-}
-
-
-int searchItem(taskqueue_t *tq, lpel_task_t *t) {
-	int i;
-	for (i = 1; i < tq->count; i++) {
-		if (tq->heap[i] == t)
-			return i;
+		if (comparePrior(t, tq->heap[best]) >= 0)
+			break;
+		place(tq, pos, tq->heap[best]);
+		pos = best;
 	}
-	return -1;
+	place(tq, pos, t);
 }
 
+/* remove the task at pos, the last one takes its place */
+static void removeAt(taskqueue_t *tq, int pos) {
+	lpel_task_t *t = tq->heap[pos];
+	lpel_task_t *last;
 
-/*
- * remove the head (highest priority) of the queue
- */
-void removeHead(taskqueue_t *tq){
-  /* pull last item to top, then down heap. */
-  tq->count--;
-  tq->heap[1] = tq->heap[tq->count];
-  downHeap(tq, 1);
+	t->sched_info.qpos = -1;
+	tq->count--;
+	if (pos == tq->count)
+		return;
+	last = tq->heap[tq->count];
+	place(tq, pos, last);
+	if (pos > 0 && comparePrior(last, tq->heap[PARENT(pos)]) > 0)
+		upHeap(tq, pos);
+	else
+		downHeap(tq, pos);
 }
 
 /**************************************************************/
@@ -101,8 +115,8 @@ void removeHead(taskqueue_t *tq){
  */
 taskqueue_t* LpelTaskqueueInit() {
   taskqueue_t *tq = (taskqueue_t *)malloc(sizeof(taskqueue_t));
-  tq->alloc = BLOCKSIZE;
-  tq->count = 1;  /* first element in array is not used to simplify indices */
+  tq->alloc = INITSIZE;
+  tq->count = 0;
   tq->heap = (lpel_task_t **) malloc(tq->alloc * sizeof(lpel_task_t *));
   return tq;
 }
@@ -111,17 +125,17 @@ taskqueue_t* LpelTaskqueueInit() {
  * Add a task to the task queue
  */
 void LpelTaskqueuePush( taskqueue_t *tq, lpel_task_t *t){
+  assert(t->sched_info.qpos < 0);
 
   //allocate more memory if needed
   if (tq->count >= tq->alloc) {
-    tq->alloc = tq->alloc + BLOCKSIZE;
-    tq->heap = realloc(tq->heap, tq->alloc *sizeof(taskqueue_t*));
+    tq->alloc *= 2;
+    tq->heap = (lpel_task_t **) realloc(tq->heap, tq->alloc * sizeof(lpel_task_t *));
   }
 
-  tq->heap[tq->count] = t;
-  if (t->sched_info.valid == 1)		//otherwise, it should be in the last position
-  	upHeap(tq, tq->count);
+  place(tq, tq->count, t);
   tq->count++;
+  upHeap(tq, tq->count - 1);
 }
 
 
@@ -129,10 +143,22 @@ void LpelTaskqueuePush( taskqueue_t *tq, lpel_task_t *t){
  * retrieve head (highest priority) of the queue
  */
 lpel_task_t *LpelTaskqueuePeek( taskqueue_t *tq){
-  if (tq->count == 1)
+  if (tq->count == 0)
     return NULL;
 
-  return tq->heap[1];
+  return tq->heap[0];
+}
+
+/*
+ * Task at a position of the heap, NULL beyond the end
+ * position 0 is the head, positions 1..ARITY hold its children,
+ * i.e. the next best tasks
+ */
+lpel_task_t *LpelTaskqueueAt( taskqueue_t *tq, int pos){
+  if (pos >= tq->count)
+    return NULL;
+
+  return tq->heap[pos];
 }
 
 
@@ -140,11 +166,11 @@ lpel_task_t *LpelTaskqueuePeek( taskqueue_t *tq){
  * pop the task with highest priority
  */
 lpel_task_t *LpelTaskqueuePop( taskqueue_t *tq) {
-	if (tq->count == 1)
+	if (tq->count == 0)
 		return NULL;
 
-	lpel_task_t *t = tq->heap[1];
-	removeHead(tq);
+	lpel_task_t *t = tq->heap[0];
+	removeAt(tq, 0);
 	return t;
 }
 
@@ -152,7 +178,7 @@ lpel_task_t *LpelTaskqueuePop( taskqueue_t *tq) {
  * Get queue size
  */
 int LpelTaskqueueSize(taskqueue_t *tq){
-  return tq->count - 1;
+  return tq->count;
 }
 
 /*
@@ -165,16 +191,35 @@ void LpelTaskqueueDestroy(taskqueue_t *tq){
 
 /*
  * Update priority for a task in the queue
+ * validity of the task may have changed as well
  */
 void LpelTaskqueueUpdatePriority(taskqueue_t *tq, lpel_task_t *t, double np){
-	int pos = searchItem(tq, t);
-	assert(pos > 0);
-	double p = t->sched_info.prio;
+	int pos = t->sched_info.qpos;
+	assert(pos >= 0 && pos < tq->count && tq->heap[pos] == t);
 	t->sched_info.prio = np;
-	if (np < p || t->sched_info.valid == 0)
-		downHeap(tq, pos);
-	else if (np > p)
+	if (pos > 0 && comparePrior(t, tq->heap[PARENT(pos)]) > 0)
 		upHeap(tq, pos);
+	else
+		downHeap(tq, pos);
+}
+
+/*
+ * Re-evaluate validity and priority of all tasks in the queue
+ * and rebuild the heap, e.g. after the priority function changed
+ */
+void LpelTaskqueueRefresh(taskqueue_t *tq) {
+	int i;
+	for (i = 0; i < tq->count; i++) {
+		lpel_task_t *t = tq->heap[i];
+#ifdef _USE_NEG_DEMAND_LIMIT_
+		LpelTaskUpdateValid(t);
+#endif
+		t->sched_info.prio = LpelTaskCalPriority(t);
+	}
+	if (tq->count < 2)
+		return;
+	for (i = PARENT(tq->count - 1); i >= 0; i--)
+		downHeap(tq, i);
 }
 
 /*
@@ -182,12 +227,7 @@ void LpelTaskqueueUpdatePriority(taskqueue_t *tq, lpel_task_t *t, double np){
  *
  */
 void LpelTaskqueueOccupyTask (taskqueue_t *tq, lpel_task_t *t) {
-	int pos = searchItem(tq, t);
-	assert(pos > 0);
-	tq->count--;
-	tq->heap[pos] = tq->heap[tq->count];
-	downHeap(tq, 1);
+	int pos = t->sched_info.qpos;
+	assert(pos >= 0 && pos < tq->count && tq->heap[pos] == t);
+	removeAt(tq, pos);
 }
-
-
-#endif  /* USE_HEAP_QUEUE */
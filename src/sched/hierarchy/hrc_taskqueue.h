@@ -3,9 +3,6 @@
 
 #include "lpel_common.h"
 
-//#define USE_STATIC_QUEUE
-#define USE_HEAP_QUEUE
-
 typedef struct taskqueue_t taskqueue_t;
 
 taskqueue_t* LpelTaskqueueInit();
@@ -17,10 +14,12 @@ lpel_task_t *LpelTaskqueuePop(taskqueue_t *tq);
 void LpelTaskqueueDestroy(taskqueue_t *tq);
 
 lpel_task_t *LpelTaskqueuePeek(taskqueue_t *tq);
+lpel_task_t *LpelTaskqueueAt(taskqueue_t *tq, int pos);
 void LpelTaskqueueOccupyTask(taskqueue_t *tq, lpel_task_t *t);
 
 int LpelTaskqueueSize(taskqueue_t *tq);
 
 void LpelTaskqueueUpdatePriority(taskqueue_t *tq, lpel_task_t *t, double np);
+void LpelTaskqueueRefresh(taskqueue_t *tq);
 
 #endif /* _HRC_TASKQUEUE_H_ */
@@ -5,9 +5,11 @@
 #include <hrc_lpel.h>
 #include "lpel_main.h"
 #include "arch/mctx.h"
+#include "arch/cycles.h"
 #include "hrc_task.h"
 #include "mailbox.h"
 #include "hrc_taskqueue.h"
+#include "hrc_multiqueue.h"
 #include "hrc_stream.h"
 
 #define  WORKER_MSG_TERMINATE 	1
@@ -15,6 +17,12 @@
 #define  WORKER_MSG_ASSIGN			3
 #define  WORKER_MSG_REQUEST			4		// worker request task
 #define  WORKER_MSG_RETURN			5		// worker return tasks
+#define  WORKER_MSG_RESIZE			6		// number of active workers changed
+#define  WORKER_MSG_TRANSFER		7		// task moved to another domain
+#define  WORKER_MSG_UPDATE			8		// update neighbour of another domain
+#define  WORKER_MSG_HUNGRY			9		// domain ran out of tasks, to balancer
+#define  WORKER_MSG_GIVE				10	// balancer asks to give tasks away
+#define  WORKER_MSG_REPRIO			11	// priority function changed, re-evaluate the queue
 
 
 typedef struct workerctx_t {
@@ -29,6 +37,14 @@ typedef struct workerctx_t {
   lpel_stream_t *free_stream;
   lpel_stream_desc_t *free_sd;
   struct workerctx_t *next;		// to organise the list of free wrappers
+  lpel_cycles_t idle_cycles;		// time waited for tasks
+  volatile lpel_cycles_t idle_since;	// start of the current wait or 0
+  int domain;		// scheduling domain of the worker
+  int core;			// core the worker is assigned to
+  unsigned int seed;	// random state for the shared queue
+  lpel_task_t  *cont;	// woken task to continue with when the current one stops
+  int           cont_fresh;	// cont has been woken up during the current record
+  unsigned long long slice_hist[LPEL_SLICE_BUCKETS];	// time tasks ran, see LpelTaskSliceHistogram()
 } workerctx_t;
 
 
@@ -43,6 +59,14 @@ typedef struct masterctx_t {
   int *waitworkers;
   int num_workers;
   workerctx_t **workers;
+  int domain;		// scheduling domain served by this master
+  int core;			// core the master is assigned to
+  int wfirst;		// workers wfirst..wfirst+wcount-1 belong to the domain
+  int wcount;
+  int hungry;		// balancer has been told that the domain is out of tasks
+  lpel_task_t **dirty;	// queued tasks to update at the end of the batch
+  int num_dirty;
+  int alloc_dirty;
 } masterctx_t;
 
 
@@ -56,6 +80,9 @@ void LpelWorkerTaskExit(lpel_task_t *t);
 void LpelWorkerTaskYield(lpel_task_t *t);
 void LpelWorkerTaskBlock(lpel_task_t *t);
 void LpelWorkerRunTask( lpel_task_t *t);
+void LpelWorkerReleaseCont(lpel_task_t *t);
+void LpelWorkerTaskUpdate(lpel_task_t *t);
+void LpelWorkerReprioritise(void);
 
 void LpelWorkerBroadcast(workermsg_t *msg);
 
@@ -81,8 +108,12 @@ void *MasterThread(void *arg);
 void *WrapperThread(void *arg);
 
 /******************* INI local vars *****************************/
-void initLocalVar(int size);
+void initLocalVar(int size, int domains);
+void initLocality(workerctx_t **workers);
 void cleanupLocalVar();
-void setupMailbox(mailbox_t **mastermb, mailbox_t **workermbs);
+void spawnParkedWrappers(void);
+void setupMailbox(mailbox_t **mastermbs, mailbox_t **workermbs);
+void spawnBalancer(void);
+void terminateBalancer(void);
 
 #endif /* _HRC_WORKER_H_ */
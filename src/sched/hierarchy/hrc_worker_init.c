@@ -23,6 +23,7 @@
 #include "arch/atomic.h"
 
 #include "hrc_worker.h"
+#include "hrc_admission.h"
 #include "hrc_task.h"
 #include "lpel_hwloc.h"
 #include "lpelcfg.h"
@@ -30,6 +31,7 @@
 #include "mailbox.h"
 #include "lpel/monitor.h"
 #include "lpel_main.h"
+#include "taskpriority.h"
 
 
 //#define _USE_WORKER_DBG__
@@ -40,43 +42,78 @@
 #define WORKER_DBG	//
 #endif
 
-static void cleanupMasterMb();
+static void cleanupMasterMb(masterctx_t *master);
+static int layoutDomains(int size, int domains, int *first);
 
 static int num_workers = -1;
-static masterctx_t *master;
+static int num_domains = -1;
+static masterctx_t **masters;
 static workerctx_t **workers;
+static int *waitworkers;
 /**
  * Initialise worker globally
  *
+ * The cores are split into num_domains contiguous blocks, the first core
+ * of each block runs the sub-master of the domain, the others run its workers.
+ * In the masterless mode all cores run workers.
  *
- * @param size    size of the worker set, i.e., the total number of workers including master
+ * @param size    size of the worker set, i.e., the total number of workers including masters
  */
 void LpelWorkersInit(lpel_config_t *conf) {
 
-	int i;
+	int i, d;
 	int size = conf->num_workers;
+	int *first;
 	assert(0 <= size);
-	num_workers = size - 1;
+
+	/* first core of each domain, plus the end */
+	first = (int *) malloc((size + 1) * sizeof(int));
+	if (conf->flags & LPEL_FLAG_MASTERLESS) {
+		num_domains = 0;
+		first[0] = -1;		// no master core
+		first[1] = size;
+	} else
+		num_domains = layoutDomains(size, conf->num_domains, first);
+	num_workers = size - num_domains;
 
 	/* set up for task priority */
 	LpelTaskPrioInit(&conf->prio_config);
 
-	/** create master */
-	master = (masterctx_t *) malloc(sizeof(masterctx_t));
-	master->mailbox = LpelMailboxCreate();
-	master->ready_tasks = LpelTaskqueueInit();
-	master->num_workers = num_workers;
-
 	/* allocate worker context table */
 	workers = (workerctx_t **) malloc(num_workers * sizeof(workerctx_t*) );
-	/* allocate waiting table */
-	master->waitworkers = (int *) malloc(num_workers * sizeof(int));
+	/* allocate waiting table, each master uses the entries of its workers */
+	waitworkers = (int *) malloc(num_workers * sizeof(int));
+
+	/** create masters */
+	masters = (masterctx_t **) malloc(num_domains * sizeof(masterctx_t *));
+	for (d=0; d<num_domains; d++) {
+		masterctx_t *master = (masterctx_t *) malloc(sizeof(masterctx_t));
+		master->mailbox = LpelMailboxCreate();
+		master->ready_tasks = LpelTaskqueueInit();
+		master->num_workers = num_workers;
+		master->waitworkers = waitworkers;
+		master->workers = workers;
+		master->domain = d;
+		master->core = first[d];
+		master->wfirst = first[d] - d;
+		master->wcount = first[d+1] - first[d] - 1;
+		master->hungry = 0;
+		master->dirty = NULL;
+		master->num_dirty = master->alloc_dirty = 0;
+		masters[d] = master;
+	}
+
 	/* allocate worker contexts */
+	d = 0;
 	for (i=0; i<num_workers; i++) {
 		workers[i] = (workerctx_t *) malloc(sizeof(workerctx_t) );
-		master->waitworkers[i] = 0;
+		waitworkers[i] = 0;
     
 		workers[i]->wid = i;
+		while (d < num_domains && i >= masters[d]->wfirst + masters[d]->wcount) d++;
+		workers[i]->domain = d;
+		workers[i]->core = (num_domains > 0) ? i + d + 1 : i;
+		workers[i]->seed = 2654435761u * (i + 1);
 
 #ifdef USE_LOGGING
 		if (MON_CB(worker_create)) {
@@ -92,18 +129,26 @@ void LpelWorkersInit(lpel_config_t *conf) {
 	workers[i]->mailbox = LpelMailboxCreate();
 	workers[i]->free_sd = NULL;
 	workers[i]->free_stream = NULL;
+	workers[i]->idle_cycles = 0;
+	workers[i]->idle_since = 0;
+	workers[i]->cont = NULL;
+	workers[i]->cont_fresh = 0;
+	memset(workers[i]->slice_hist, 0, sizeof(workers[i]->slice_hist));
 	}
+	free(first);
 
 	/* local variables used in worker operations */
-	initLocalVar(num_workers);
+	initLocalVar(num_workers, num_domains);
+	initLocality(workers);
 
 
 }
 
 
-void setupMailbox(mailbox_t **mastermb, mailbox_t **workermbs) {
-  *mastermb = master->mailbox;
+void setupMailbox(mailbox_t **mastermbs, mailbox_t **workermbs) {
   int i;
+  for (i = 0; i < num_domains; i++)
+    mastermbs[i] = masters[i]->mailbox;
   for (i = 0; i < num_workers; i++)
     workermbs[i] = workers[i]->mailbox;
 }
@@ -120,14 +165,17 @@ void LpelWorkersCleanup(void) {
 		/* wait for the worker to finish */
 		(void) pthread_join(wc->thread, NULL);
 	}
-	/* wait for the master to finish */
-	(void) pthread_join(master->thread, NULL);
+	/* wait for the masters to finish */
+	for (i=0; i<num_domains; i++)
+		(void) pthread_join(masters[i]->thread, NULL);
 
-	/* clean up master's mailbox */
-	cleanupMasterMb();
+	for (i=0; i<num_domains; i++) {
+		/* clean up master's mailbox */
+		cleanupMasterMb(masters[i]);
 
-	LpelMailboxDestroy(master->mailbox);
-	LpelTaskqueueDestroy(master->ready_tasks);
+		LpelMailboxDestroy(masters[i]->mailbox);
+		LpelTaskqueueDestroy(masters[i]->ready_tasks);
+	}
 
 
 	/* cleanup the data structures */
@@ -141,52 +189,113 @@ void LpelWorkersCleanup(void) {
 
 	/* free workers tables */
 		free(workers);
-		free(master->waitworkers);
+		free(waitworkers);
 
 		/* clean up local vars used in worker operations */
 		cleanupLocalVar();
 		    
-    free(master);
+	for (i=0; i<num_domains; i++) {
+		free(masters[i]->dirty);
+		free(masters[i]);
+	}
+	free(masters);
+
+	LpelTaskPrioCleanup();
 }
 
 
 /*
- * Spawn master and workers
+ * Spawn masters and workers
  */
 void LpelWorkersSpawn(void) {
 	int i;
-	/* master */
-	(void) pthread_create(&master->thread, NULL, MasterThread, master); 	/* spawn joinable thread */
+	/* masters */
+	for (i=0; i<num_domains; i++)
+		(void) pthread_create(&masters[i]->thread, NULL, MasterThread, masters[i]); 	/* spawn joinable thread */
 
 	/* workers */
 	for(i=0; i<num_workers; i++) {
 		workerctx_t *wc = workers[i];
 		(void) pthread_create(&wc->thread, NULL, WorkerThread, wc);
 	}
+
+	/* balancer between the domains */
+	spawnBalancer();
+	LpelAdmissionStart();
+
+	/* wrappers */
+	spawnParkedWrappers();
 }
 
 
 /*
- * Terminate master and workers
+ * Terminate masters and workers
  */
 void LpelWorkersTerminate(void) {
+	int i;
 	workermsg_t msg;
+	/* no more tasks are moved between the domains */
+	terminateBalancer();
+	LpelAdmissionStop();
+
 	msg.type = WORKER_MSG_TERMINATE;
-	LpelMailboxSend(master->mailbox, &msg);
+	for (i=0; i<num_domains; i++)
+		LpelMailboxSend(masters[i]->mailbox, &msg);
+	/* without masters, the workers terminate once the queue is empty */
+	if (num_domains == 0)
+		LpelWorkerBroadcast(&msg);
 }
 
 /************************ Private functions ***********************************/
+/*
+ * Split the cores 0..size-1 into domains
+ * With LPEL_HRC_DOMAINS_SOCKET a domain starts at each socket boundary,
+ * if a socket has not enough cores for a master and a worker, the cores are
+ * split evenly. A single domain keeps the master on core 0.
+ *
+ * @param first   set to the first core of each domain, first[domains] = size
+ * @return        number of domains
+ */
+static int layoutDomains(int size, int domains, int *first) {
+	int d, i;
+
+	if (domains == LPEL_HRC_DOMAINS_SOCKET) {
+		domains = 0;
+		for (i=0; i<size; i++) {
+			if (i == 0 || LpelHwLocSocket(i) != LpelHwLocSocket(i-1))
+				first[domains++] = i;
+		}
+		first[domains] = size;
+		for (d=0; d<domains; d++) {
+			if (first[d+1] - first[d] < 2) break;
+		}
+		if (d == domains)
+			return domains;
+	}
+
+	if (domains < 1 || size < 2*domains)
+		domains = 1;
+	for (d=0; d<=domains; d++)
+		first[d] = d * size / domains;
+	return domains;
+}
+
 /*
  * clean up master's mailbox before terminating master
  * last messages including: task request from worker, and return zombie task
  */
-static void cleanupMasterMb() {
+static void cleanupMasterMb(masterctx_t *master) {
 	workermsg_t msg;
 	lpel_task_t *t;
 	while (LpelMailboxHasIncoming(master->mailbox)) {
 		LpelMailboxRecv(master->mailbox, &msg);
 		switch(msg.type) {
 		case WORKER_MSG_REQUEST:
+		case WORKER_MSG_RESIZE:
+		case WORKER_MSG_UPDATE:
+		case WORKER_MSG_GIVE:
+		case WORKER_MSG_TRANSFER:
+		case WORKER_MSG_REPRIO:
 			break;
 		case WORKER_MSG_RETURN:
 			t = msg.body.task;
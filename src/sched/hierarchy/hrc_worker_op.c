@@ -42,16 +42,57 @@
 
 
 /******************* PRIVATE FUNCTIONS *****************************/
-static void addFreeWrapper(workerctx_t *wp);
+static int addFreeWrapper(workerctx_t *wp);
 static workerctx_t *getFreeWrapper();
+static workerctx_t *createWrapper(int wid, int parked);
 
 /******************************************************************************/
 static int num_workers = -1;
-static mailbox_t *mastermb;
+static volatile int num_active = -1;	/* workers num_active.. are retired */
+static int num_domains = -1;
+static mailbox_t **mastermbs;
 static mailbox_t **workermbs;
-
+static workerctx_t **workerctxs;
+
+/* summary published by each master after every batch, read by the balancer and the workers */
+typedef struct {
+	volatile int size;			// tasks in the queue
+	volatile int waiting;		// active workers waiting for a task
+	volatile int active;		// active workers of the domain
+	volatile double top;		// priority of the head of the queue
+	char padding[64];
+} domainsum_t;
+
+static domainsum_t *domainsums;
+static mailbox_t *balancermb;
+static pthread_t balancer;
+static int next_home = 0;		// round robin home of tasks created outside workers
+
+/* masterless mode: shared ready queue and the stack of idle workers */
+static int masterless = 0;
+static multiqueue_t *readyq;
+static volatile int num_idle;
+static int *idlestack;
+static int *idlepos;
+static PRODLOCK_TYPE lockidle;
+static unsigned int seedseq = 0;
+
+/* tasks assigned to a worker ahead, the entries of waitworkers count the free slots */
+static int prefetch = 1;
+static double prefetch_stale = LPEL_PREFETCH_STALE_DEFAULT;
+
+/* cache-affine dispatch */
+static double locality_tolerance = LPEL_LOCALITY_TOLERANCE_DEFAULT;
+static unsigned char *wdist;		// topological distance between workers, LPEL_HW_DIST_*
+#define LOCALITY_WINDOW		5		// head of the heap and its children
+
+/* parked wrapper threads, waiting to be reused */
 static workerctx_t *freewrappers;
 static PRODLOCK_TYPE lockwrappers;
+static int num_freewrappers;
+static int wrappers_terminate;
+static int wrappers_min = 0;
+static int wrappers_max = LPEL_WRAPPER_POOL_MAX_DEFAULT;
 
 
 #ifdef HAVE___THREAD
@@ -61,7 +102,8 @@ static pthread_key_t workerctx_key;
 #endif /* HAVE___THREAD */
 /******************************************************************************/
 
-void initLocalVar(int size){
+void initLocalVar(int size, int domains){
+	int i;
 #ifndef HAVE___THREAD
 	/* init key for thread specific data */
 	pthread_key_create(&workerctx_key, NULL);
@@ -69,11 +111,42 @@ void initLocalVar(int size){
 
 	/* free wrappers */
 	freewrappers = NULL;
+	num_freewrappers = 0;
+	wrappers_terminate = 0;
 	PRODLOCK_INIT(&lockwrappers);
 	num_workers = size;
+	num_active = size;
+	num_domains = domains;
+	/* worker contexts register themselves when they start */
+	workerctxs = (workerctx_t **) calloc(num_workers, sizeof(workerctx_t *));
 	/* mailboxes */
 	workermbs = (mailbox_t **) malloc(sizeof(mailbox_t *) * num_workers);
-	setupMailbox(&mastermb, workermbs);
+	mastermbs = (mailbox_t **) malloc(sizeof(mailbox_t *) * num_domains);
+	setupMailbox(mastermbs, workermbs);
+	domainsums = (domainsum_t *) calloc(num_domains, sizeof(domainsum_t));
+	for (i = 0; i < num_domains; i++)
+		domainsums[i].top = LPEL_DBL_MIN;
+	balancermb = NULL;
+
+	masterless = (num_domains == 0);
+	if (masterless) {
+		readyq = LpelMultiqueueInit(2 * num_workers);
+		num_idle = 0;
+		idlestack = (int *) malloc(num_workers * sizeof(int));
+		idlepos = (int *) malloc(num_workers * sizeof(int));
+		for (i = 0; i < num_workers; i++)
+			idlepos[i] = -1;
+		PRODLOCK_INIT(&lockidle);
+	}
+}
+
+/* distances between the cores of the workers */
+void initLocality(workerctx_t **workers) {
+	int i, j;
+	wdist = (unsigned char *) malloc(num_workers * num_workers);
+	for (i = 0; i < num_workers; i++)
+		for (j = 0; j < num_workers; j++)
+			wdist[i * num_workers + j] = LpelHwLocWorkerDistance(workers[i]->core, workers[j]->core);
 }
 
 void cleanupLocalVar(){
@@ -81,24 +154,50 @@ void cleanupLocalVar(){
 	pthread_key_delete(workerctx_key);
 #endif /* HAVE___THREAD */
 
-	/* free wrappers */
-	workerctx_t *wp = freewrappers;
-	workerctx_t *next;
-	while (wp != NULL) {
-		next = wp->next;
-		LpelMailboxDestroy(wp->mailbox);
-		LpelWorkerDestroyStream(wp);
-		LpelWorkerDestroySd(wp);
-		free(wp);
-		wp = next;
-	}
-	PRODLOCK_DESTROY(&lockwrappers);
+	/* terminate parked wrappers, they clean up themselves */
+	workermsg_t msg;
+	workerctx_t *wp;
+	msg.type = WORKER_MSG_TERMINATE;
+	PRODLOCK_LOCK(&lockwrappers);
+	wrappers_terminate = 1;
+	while (freewrappers != NULL) {
+		wp = freewrappers;
+		freewrappers = wp->next;
+		LpelMailboxSend(wp->mailbox, &msg);
+	}
+	num_freewrappers = 0;
+	PRODLOCK_UNLOCK(&lockwrappers);
+	/* lockwrappers is kept, wrappers may still be parking */
+
+	/* hungry messages sent after the balancer terminated */
+	if (balancermb != NULL) {
+		while (LpelMailboxHasIncoming(balancermb))
+			LpelMailboxRecv(balancermb, &msg);
+		LpelMailboxDestroy(balancermb);
+		balancermb = NULL;
+	}
 
 	/* mailboxes */
 	free(workermbs);
+	free(mastermbs);
+	free(workerctxs);
+	free(domainsums);
+	free(wdist);
+
+	if (masterless) {
+		LpelMultiqueueDestroy(readyq);
+		free(idlestack);
+		free(idlepos);
+		PRODLOCK_DESTROY(&lockidle);
+	}
+	num_domains = -1;
 }
 
 
+static void pushShared(lpel_task_t *t);
+static void wakeupShared(lpel_task_t *t);
+static void SharedWorkerLoop(workerctx_t *wc);
+
 /**
  * Assign a task to the worker by sending an assign message to that worker
  */
@@ -109,31 +208,36 @@ void LpelWorkerRunTask(lpel_task_t *t) {
 
 	if (t->worker_context != NULL) {	// wrapper
 		LpelMailboxSend(t->worker_context->mailbox, &msg);
+	}	else if (masterless) {
+		t->state = TASK_READY;
+		pushShared(t);
 	}	else {
-		LpelMailboxSend(mastermb, &msg);
+		/* tasks stay in the domain of their creator */
+		workerctx_t *wc = LpelWorkerSelf();
+		if (wc != NULL && wc->wid >= 0)
+			t->home = wc->domain;
+		else
+			t->home = (unsigned int) __sync_fetch_and_add(&next_home, 1) % num_domains;
+		LpelMailboxSend(mastermbs[t->home], &msg);
 	}
 }
 
 
-static void returnTask(lpel_task_t *t) {
+static void returnTask(workerctx_t *wc, lpel_task_t *t) {
 	workermsg_t msg;
 	msg.type = WORKER_MSG_RETURN;
 	msg.body.task = t;
-	LpelMailboxSend(mastermb, &msg);
+	LpelMailboxSend(mastermbs[wc->domain], &msg);
 }
 
 
+/* ask for a task for one free slot of the worker */
 static void requestTask(workerctx_t *wc) {
 	WORKER_DBG("worker %d: request task\n", wc->wid);
 	workermsg_t msg;
 	msg.type = WORKER_MSG_REQUEST;
 	msg.body.from_worker = wc->wid;
-	LpelMailboxSend(mastermb, &msg);
-#ifdef USE_LOGGING
-	if (wc->mon && MON_CB(worker_waitstart)) {
-		MON_CB(worker_waitstart)(wc->mon);
-	}
-#endif
+	LpelMailboxSend(mastermbs[wc->domain], &msg);
 }
 
 
@@ -156,56 +260,115 @@ static void sendWakeup(mailbox_t *mb, lpel_task_t *t)
 /*******************************************************************************
  * MASTER FUNCTION
  ******************************************************************************/
+/*
+ * distance of a worker to the data of the task, i.e. to the worker which
+ * ran the task last or the closest one which ran one of its producers
+ * @return LPEL_HW_DIST_NUM if the task has not run yet
+ */
+static int taskDistance(lpel_task_t *t, int wid) {
+	sd_array_t *in = &t->sched_info.in_streams;
+	lpel_task_t *p;
+	int i, w, d, best = LPEL_HW_DIST_NUM;
+	if (t->last_worker >= 0)
+		best = wdist[t->last_worker * num_workers + wid];
+	for (i = 0; i < in->count && best > LPEL_HW_DIST_CORE; i++) {
+		p = LpelStreamProducer(in->sds[i]->stream);
+		if (p != NULL && (w = p->last_worker) >= 0) {
+			d = wdist[w * num_workers + wid];
+			if (d < best)
+				best = d;
+		}
+	}
+	return best;
+}
+
+/*
+ * send the task to an idle worker if any, among those to the closest one
+ * to the data of the task, then to the one with most free slots
+ */
 static int servePendingReq(masterctx_t *master, lpel_task_t *t) {
-	int i;
-	//t->sched_info.prio = LpelTaskCalPriority(t);
-	for (i = 0; i < num_workers; i++){
-		if (master->waitworkers[i] == 1) {
-			master->waitworkers[i] = 0;
-			WORKER_DBG("master: serve pending request, send task %d to worker %d\n", t->uid, i);
-			sendTask(i, t);
-			return i;
+	int i, d, best = -1, bestdist = LPEL_HW_DIST_NUM + 1;
+	int slots, bestslots = 0;
+	for (i = master->wfirst; i < master->wfirst + master->wcount && i < num_active; i++){
+		slots = master->waitworkers[i];
+		if (slots == 0 || (bestslots == prefetch && slots < prefetch))
+			continue;
+		d = taskDistance(t, i);
+		if (best < 0 || (slots == prefetch && bestslots < prefetch) || d < bestdist
+				|| (d == bestdist && slots > bestslots)) {
+			best = i;
+			bestdist = d;
+			bestslots = slots;
+			if (slots == prefetch && d == LPEL_HW_DIST_CORE)
+				break;
 		}
 	}
-	return -1;
+	if (best >= 0) {
+		master->waitworkers[best]--;
+		WORKER_DBG("master: serve pending request, send task %d to worker %d\n", t->uid, best);
+		sendTask(best, t);
+	}
+	return best;
 }
 
-static void updatePriorityList(taskqueue_t *tq, stream_elem_t *list, char mode, int update_prio) {
+/* update validity and priority of a task queued by this master */
+static void updateTask(masterctx_t *master, lpel_task_t *t, int update_prio) {
 	double np;
-	lpel_task_t *t;
+	int valid;
+	if (t->state == TASK_INQUEUE) {
+		valid = t->sched_info.valid;
+#ifdef _USE_NEG_DEMAND_LIMIT_
+		LpelTaskUpdateValid(t);
+#endif
+		if (update_prio) {		//only update priority when necessary
+			np = LpelTaskCalPriority(t);
+			LpelTaskqueueUpdatePriority(master->ready_tasks, t, np);
+		} else if (valid != t->sched_info.valid)		// keep the heap order
+			LpelTaskqueueUpdatePriority(master->ready_tasks, t, t->sched_info.prio);
+	}
+}
+
+/* a task owned by another master is updated by its owner */
+static void sendUpdate(lpel_task_t *t) {
+	workermsg_t msg;
+	msg.type = WORKER_MSG_UPDATE;
+	msg.body.task = t;
+	LpelMailboxSend(mastermbs[t->home], &msg);
+}
+
+/* remember to update the task at the end of the batch, once */
+static void markDirty(masterctx_t *master, lpel_task_t *t) {
+	if (t->state != TASK_INQUEUE || t->sched_info.dirty == master->domain + 1)
+		return;
+	t->sched_info.dirty = master->domain + 1;
+	if (master->num_dirty == master->alloc_dirty) {
+		master->alloc_dirty = (master->alloc_dirty == 0) ? 64 : 2 * master->alloc_dirty;
+		master->dirty = (lpel_task_t **) realloc(master->dirty, master->alloc_dirty * sizeof(lpel_task_t *));
+	}
+	master->dirty[master->num_dirty++] = t;
+}
+
+static void updatePriorityList(masterctx_t *master, sd_array_t *arr, char mode) {
+	lpel_task_t *t = NULL;
 	lpel_stream_t *s;
-	while (list != NULL) {
-		s = list->stream_desc->stream;
+	int i;
+	for (i = 0; i < arr->count; i++) {
+		s = arr->sds[i]->stream;
 		if (mode == 'r')
 			t = LpelStreamProducer(s);
 		else if (mode == 'w')
 			t = LpelStreamConsumer(s);
-		if (t && t->state == TASK_INQUEUE) {
-#ifdef _USE_NEG_DEMAND_LIMIT_
-			LpelTaskUpdateValid(t);
-#endif
-			if (update_prio) {		//only update priority when necessary
-				np = LpelTaskCalPriority(t);
-				LpelTaskqueueUpdatePriority(tq, t, np);
-			}
-		}
-		list = list->next;
+		if (t && t->worker_context == NULL && t->home != master->domain)
+			sendUpdate(t);
+		else if (t)
+			markDirty(master, t);
 	}
 }
 
-/* update priority and validity for neighbors of t
- * validity only applies for previous neighbours, i.e. neighbours from input stream list
- * @cond: called only by master to avoid concurrent access
- */
-static void updateNeighours(masterctx_t *master, lpel_task_t *t, int update_prio) {
-	taskqueue_t *tq = master->ready_tasks;
-	updatePriorityList(tq, t->sched_info.in_streams, 'r', update_prio);
-	if (update_prio)
-		updatePriorityList(tq, t->sched_info.out_streams, 'w', update_prio);
-
+/* serve a pending request with the head of the queue if it became valid */
+static void serveValidHead(masterctx_t *master) {
 #ifdef _USE_NEG_DEMAND_LIMIT_
-	// check if the head is valid and any pending request
-	WORKER_DBG("master: after update neighbor\n");
+	taskqueue_t *tq = master->ready_tasks;
 	lpel_task_t *top = LpelTaskqueuePeek(tq);
 	if (top != NULL) {
 		if (top->sched_info.valid == 1) {
@@ -218,9 +381,42 @@ static void updateNeighours(masterctx_t *master, lpel_task_t *t, int update_prio
 			}
 		}
 	}
+#else
+	(void) master;
 #endif
 }
 
+/* neighbours of t have to be updated
+ * validity only applies for previous neighbours, i.e. neighbours from input stream list
+ * @cond: called only by master to avoid concurrent access
+ */
+static void updateNeighours(masterctx_t *master, lpel_task_t *t, int update_prio) {
+	updatePriorityList(master, &t->sched_info.in_streams, 'r');
+	if (update_prio)
+		updatePriorityList(master, &t->sched_info.out_streams, 'w');
+}
+
+/* apply the updates collected in the batch, each task is re-heapified once */
+static void flushUpdates(masterctx_t *master) {
+	lpel_task_t *t;
+	int i;
+	if (master->num_dirty == 0)
+		return;
+	for (i = 0; i < master->num_dirty; i++) {
+		t = master->dirty[i];
+		if (t->sched_info.dirty != master->domain + 1)		// marked by the new owner
+			continue;
+		t->sched_info.dirty = 0;
+		if (t->home == master->domain)
+			updateTask(master, t, PRIO_CFG(update_neigh_prio));
+	}
+	master->num_dirty = 0;
+
+	// check if the head is valid and any pending request
+	WORKER_DBG("master: after update neighbor\n");
+	serveValidHead(master);
+}
+
 /*
 	process when a task becomes ready, could be waken up or return ready, or returned with waken status
 	*
@@ -244,105 +440,243 @@ static void processTaskReady(masterctx_t *master, lpel_task_t *t) {
 }
 
 
-static void processTaskReq(masterctx_t *master, int wid) {
-	lpel_task_t *t;
-	t = LpelTaskqueuePeek(master->ready_tasks);
-	if (t == NULL) {
-		master->waitworkers[wid] = 1;
-	} else {
+/*
+ * next task for the worker: among the tasks close to the head of the queue
+ * within the priority tolerance, the one closest to the worker
+ */
+static lpel_task_t *selectTask(masterctx_t *master, int wid) {
+	lpel_task_t *head, *t, *best;
+	int i, d, bestdist;
+	double min;
+
+	head = LpelTaskqueuePeek(master->ready_tasks);
+	if (head == NULL)
+		return NULL;
 #ifdef _USE_NEG_DEMAND_LIMIT_
-		//if (LpelTaskUpdateValid(t) == 0) {		// if not schedule task if it is invalid
-		if (t->sched_info.valid == 0) {
-			master->waitworkers[wid] = 1;
-			return;
-		}
+	if (head->sched_info.valid == 0)
+		return NULL;
 #endif
+	best = head;
+	bestdist = taskDistance(head, wid);
+	min = head->sched_info.prio - locality_tolerance;
+	for (i = 1; i < LOCALITY_WINDOW && bestdist > LPEL_HW_DIST_CORE; i++) {
+		t = LpelTaskqueueAt(master->ready_tasks, i);
+		if (t == NULL)
+			break;
+#ifdef _USE_NEG_DEMAND_LIMIT_
+		if (t->sched_info.valid == 0)
+			continue;
+#endif
+		if (t->sched_info.prio < min)
+			continue;
+		d = taskDistance(t, wid);
+		if (d < bestdist || (d == bestdist && t->sched_info.prio > best->sched_info.prio)) {
+			best = t;
+			bestdist = d;
+		}
+	}
+	return best;
+}
+
+/* fill the free slots of the worker with the top valid tasks */
+static void serveWorker(masterctx_t *master, int wid) {
+	lpel_task_t *t;
+	while (master->waitworkers[wid] > 0) {
+		t = selectTask(master, wid);
+		if (t == NULL)
+			break;
 		t->state = TASK_READY;
 		sendTask(wid, t);
 		LpelTaskqueueOccupyTask(master->ready_tasks, t);
+		master->waitworkers[wid]--;
 	}
 }
 
-static void MasterLoop(masterctx_t *master)
-{
-	WORKER_DBG("start master\n");
-	do {
-		workermsg_t msg;
+static void processTaskReq(masterctx_t *master, int wid) {
+	master->waitworkers[wid]++;
+	if (wid < num_active)		// retired workers wait until activated again
+		serveWorker(master, wid);
+	if (master->waitworkers[wid] > 0) {
+		if (LpelTaskqueueSize(master->ready_tasks) == 0 && balancermb != NULL && !master->hungry) {
+			/* ask the balancer for tasks of other domains, once until served */
+			workermsg_t msg;
+			msg.type = WORKER_MSG_HUNGRY;
+			msg.body.balance.domain = master->domain;
+			msg.body.balance.count = 0;
+			master->hungry = 1;
+			LpelMailboxSend(balancermb, &msg);
+		}
+	}
+}
 
-		LpelMailboxRecv(mastermb, &msg);
-		lpel_task_t *t;
-		int wid;
-		switch(msg.type) {
-		case WORKER_MSG_ASSIGN:
-			/* master receive a new task */
-			t = msg.body.task;
-			assert (t->state == TASK_CREATED);
-			t->state = TASK_READY;
-			WORKER_DBG("master: get task %d, priof = %lf\n", t->uid, t->sched_info.prio);
-			if (servePendingReq(master, t) < 0) {		 // no pending request
-				t->state = TASK_INQUEUE;
-				LpelTaskqueuePush(master->ready_tasks, t);
-				WORKER_DBG("no pending request, push task %d to queue\n", t->uid);
-			}
+/* move up to count tasks from the head of the queue to another domain */
+static void giveTasks(masterctx_t *master, int to, int count) {
+	workermsg_t msg;
+	lpel_task_t *t;
+	/* the batch must not refer to tasks of other domains */
+	flushUpdates(master);
+	msg.type = WORKER_MSG_TRANSFER;
+	while (count-- > 0) {
+		t = LpelTaskqueuePeek(master->ready_tasks);
+		if (t == NULL)
+			break;
+#ifdef _USE_NEG_DEMAND_LIMIT_
+		if (t->sched_info.valid == 0)
 			break;
-
-		case WORKER_MSG_RETURN:
-			t = msg.body.task;
-			WORKER_DBG("master: get returned task %d, state %c\n", t->uid, t->state);
-#ifdef USE_HEAP_QUEUE
-			// when USE_STATIC_QUEUE, support static priority only --> do not need to update priority and validity of neighbours
-			// when USE_HEAP_QUEUE, support both static/dynamic priority --> dynamic priority: update both priority and validity of neighbours, static priority: update only valididity
-				updateNeighours(master, t, PRIO_CFG(update_neigh_prio));
 #endif
-			switch(t->state) {
-			case TASK_BLOCKED:
-				if (t->wakenup == 1) {	/* task has been waked up, considered as return ready */
-					t->wakenup = 0;
-					t->state = TASK_READY;
-					WORKER_DBG("task %d has been woken up, now make it ready\n", t->uid);
-					processTaskReady(master, t);
-				} else
-					t->state = TASK_RETURNED;
-				break;
+		LpelTaskqueueOccupyTask(master->ready_tasks, t);
+		t->state = TASK_READY;
+		t->home = to;
+		WORKER_DBG("master %d: give task %d to domain %d\n", master->domain, t->uid, to);
+		msg.body.task = t;
+		LpelMailboxSend(mastermbs[to], &msg);
+	}
+}
+
+/* publish the state of the domain for the balancer */
+static void publishSummary(masterctx_t *master) {
+	domainsum_t *sum = &domainsums[master->domain];
+	lpel_task_t *top = LpelTaskqueuePeek(master->ready_tasks);
+	int i, waiting = 0, active = 0;
 
-			case TASK_READY:	// task yields
+	for (i = master->wfirst; i < master->wfirst + master->wcount && i < num_active; i++) {
+		active++;
+		waiting += master->waitworkers[i];
+	}
+	sum->size = LpelTaskqueueSize(master->ready_tasks);
+	sum->top = (top != NULL) ? top->sched_info.prio : LPEL_DBL_MIN;
+	sum->waiting = waiting;
+	sum->active = active;
+	if (sum->size > 0)
+		master->hungry = 0;
+}
+
+/* number of messages processed before the neighbour updates are applied */
+#define MASTER_BATCH		64
+
+static void processMessage(masterctx_t *master, workermsg_t *msg)
+{
+	lpel_task_t *t;
+	int wid;
+	switch(msg->type) {
+	case WORKER_MSG_ASSIGN:
+		/* master receive a new task */
+		t = msg->body.task;
+		assert (t->state == TASK_CREATED);
+		t->state = TASK_READY;
+		WORKER_DBG("master: get task %d, priof = %lf\n", t->uid, t->sched_info.prio);
+		if (servePendingReq(master, t) < 0) {		 // no pending request
+			t->state = TASK_INQUEUE;
+			LpelTaskqueuePush(master->ready_tasks, t);
+			WORKER_DBG("no pending request, push task %d to queue\n", t->uid);
+		}
+		break;
+
+	case WORKER_MSG_RETURN:
+		t = msg->body.task;
+		WORKER_DBG("master: get returned task %d, state %c\n", t->uid, t->state);
+		// dynamic priority: update both priority and validity of neighbours, static priority: update only valididity
+		updateNeighours(master, t, PRIO_CFG(update_neigh_prio));
+		switch(t->state) {
+		case TASK_BLOCKED:
+			if (t->wakenup == 1) {	/* task has been waked up, considered as return ready */
+				t->wakenup = 0;
+				t->state = TASK_READY;
+				WORKER_DBG("task %d has been woken up, now make it ready\n", t->uid);
 				processTaskReady(master, t);
-				break;
+			} else
+				t->state = TASK_RETURNED;
+			break;
 
-			case TASK_ZOMBIE:
-				LpelTaskDestroy(t);
-				break;
-			default:
-				assert(0);
+		case TASK_READY:	// task yields
+			processTaskReady(master, t);
+			break;
+
+		case TASK_ZOMBIE:
+			if (t->sched_info.dirty)		// still referenced by the batch
+				flushUpdates(master);
+			LpelTaskDestroy(t);
+			break;
+		default:
+			assert(0);
+			break;
+		}
+		break;
+
+		case WORKER_MSG_WAKEUP:
+			t = msg->body.task;
+			if (t->state != TASK_RETURNED) {		// task has not been returned yet
+				t->wakenup = 1;		// set task as wakenup so that when returned it will be treated as ready
 				break;
 			}
+			WORKER_DBG("master: unblock task %d\n", t->uid);
+			t->state = TASK_READY;
+			processTaskReady(master, t);
 			break;
 
-			case WORKER_MSG_WAKEUP:
-				t = msg.body.task;
-				if (t->state != TASK_RETURNED) {		// task has not been returned yet
-					t->wakenup = 1;		// set task as wakenup so that when returned it will be treated as ready
-					break;
-				}
-				WORKER_DBG("master: unblock task %d\n", t->uid);
-				t->state = TASK_READY;
-				processTaskReady(master, t);
-				break;
 
+		case WORKER_MSG_REQUEST:
+			wid = msg->body.from_worker;
+			WORKER_DBG("master: request task from worker %d\n", wid);
+			processTaskReq(master, wid);
+			break;
 
-			case WORKER_MSG_REQUEST:
-				wid = msg.body.from_worker;
-				WORKER_DBG("master: request task from worker %d\n", wid);
-				processTaskReq(master, wid);
-				break;
+		case WORKER_MSG_RESIZE:
+			/* serve the waiting workers which have been activated */
+			for (wid = master->wfirst; wid < master->wfirst + master->wcount && wid < num_active; wid++)
+				serveWorker(master, wid);
+			break;
 
-			case WORKER_MSG_TERMINATE:
-				master->terminate = 1;
-				break;
-			default:
-				assert(0);
+		case WORKER_MSG_TRANSFER:
+			t = msg->body.task;
+			assert(t->state == TASK_READY && t->home == master->domain);
+			processTaskReady(master, t);
+			break;
+
+		case WORKER_MSG_UPDATE:
+			t = msg->body.task;
+			if (t->home != master->domain) {		// given away meanwhile
+				sendUpdate(t);
 				break;
+			}
+			markDirty(master, t);
+			break;
+
+		case WORKER_MSG_GIVE:
+			giveTasks(master, msg->body.balance.domain, msg->body.balance.count);
+			break;
+
+		case WORKER_MSG_REPRIO:
+			/* the priority function changed, re-evaluate the whole queue */
+			LpelTaskqueueRefresh(master->ready_tasks);
+			for (wid = master->wfirst; wid < master->wfirst + master->wcount && wid < num_active; wid++)
+				serveWorker(master, wid);
+			break;
+
+		case WORKER_MSG_TERMINATE:
+			master->terminate = 1;
+			break;
+		default:
+			assert(0);
+			break;
+	}
+}
+
+static void MasterLoop(masterctx_t *master)
+{
+	workermsg_t msg;
+	int n;
+	WORKER_DBG("start master\n");
+	do {
+		LpelMailboxRecv(master->mailbox, &msg);
+		processMessage(master, &msg);
+		/* take the messages already there as one batch */
+		for (n = 1; n < MASTER_BATCH && LpelMailboxHasIncoming(master->mailbox); n++) {
+			LpelMailboxRecv(master->mailbox, &msg);
+			processMessage(master, &msg);
 		}
+		flushUpdates(master);
+		publishSummary(master);
 	} while (!(master->terminate && LpelTaskqueueSize(master->ready_tasks) == 0));
 }
 
@@ -351,6 +685,7 @@ static void MasterLoop(masterctx_t *master)
 void *MasterThread(void *arg)
 {
 	masterctx_t *master = (masterctx_t *)arg;
+	int i;
 	num_workers = master->num_workers;
 	//#ifdef HAVE___THREAD
 	//  workerctx_cur = ms;
@@ -369,15 +704,16 @@ void *MasterThread(void *arg)
 
 	/* assign to cores */
 	master->terminate = 0;
-	LpelThreadAssign(LPEL_MAP_MASTER);
+	LpelThreadAssign(master->core);
 
 	// master loop, no monitor for master
 	MasterLoop(master);
 
-	// master terminated, now terminate worker
+	// master terminated, now terminate the workers of the domain
 	workermsg_t msg;
 	msg.type = WORKER_MSG_TERMINATE;
-	LpelWorkerBroadcast(&msg);
+	for (i = master->wfirst; i < master->wfirst + master->wcount; i++)
+		LpelMailboxSend(workermbs[i], &msg);
 
 #ifdef USE_MCTX_PCL
 	co_thread_cleanup();
@@ -387,11 +723,421 @@ void *MasterThread(void *arg)
 }
 
 
+/*******************************************************************************
+ * BALANCER FUNCTION
+ ******************************************************************************/
+
+#define BALANCE_INTERVAL_NS		1000000		// 1ms
+
+static void sendGive(int from, int to, int count) {
+	workermsg_t msg;
+	msg.type = WORKER_MSG_GIVE;
+	msg.body.balance.domain = to;
+	msg.body.balance.count = count;
+	LpelMailboxSend(mastermbs[from], &msg);
+}
+
+/*
+ * Move tasks between the domains, based on the published summaries
+ * - a domain with waiting workers and no tasks gets tasks from the largest domain
+ * - the tasks of a domain without active workers are moved away
+ * - if the queues diverge and the larger one holds higher priorities,
+ *   half of the difference is moved
+ */
+static void balanceDomains(int *size, int *waiting, int *active, double *top) {
+	int d, donor, to, n;
+
+	for (d = 0; d < num_domains; d++) {
+		size[d] = domainsums[d].size;
+		waiting[d] = domainsums[d].waiting;
+		active[d] = domainsums[d].active;
+		top[d] = domainsums[d].top;
+	}
+
+	for (d = 0; d < num_domains; d++) {
+		if (active[d] > 0 || size[d] == 0)
+			continue;
+		for (to = 0; to < num_domains && active[to] == 0; to++);
+		if (to == num_domains)
+			return;
+		sendGive(d, to, size[d]);
+		size[to] += size[d];
+		size[d] = 0;
+	}
+
+	for (d = 0; d < num_domains; d++) {
+		if (waiting[d] == 0 || size[d] > 0)
+			continue;
+		donor = -1;
+		for (n = 0; n < num_domains; n++) {
+			if (n != d && size[n] > 0 && waiting[n] == 0 && (donor < 0 || size[n] > size[donor]))
+				donor = n;
+		}
+		if (donor < 0)
+			continue;
+		n = (size[donor] + 1) / 2;
+		if (n > waiting[d])
+			n = waiting[d];
+		sendGive(donor, d, n);
+		size[donor] -= n;
+		size[d] += n;
+		waiting[d] = 0;
+	}
+
+	donor = to = -1;
+	for (d = 0; d < num_domains; d++) {
+		if (active[d] == 0)
+			continue;
+		if (donor < 0 || size[d] > size[donor])
+			donor = d;
+		if (to < 0 || size[d] < size[to])
+			to = d;
+	}
+	if (donor >= 0 && to >= 0 && size[donor] >= size[to] + 2 && top[donor] > top[to])
+		sendGive(donor, to, (size[donor] - size[to]) / 2);
+}
+
+static void *BalancerThread(void *arg) {
+	workermsg_t msg;
+	struct timespec ts;
+	int *size = (int *) malloc(3 * num_domains * sizeof(int));
+	double *top = (double *) malloc(num_domains * sizeof(double));
+
+	(void) arg;
+	LpelThreadAssign(LPEL_MAP_WRAPPER);
+	while (1) {
+		(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_nsec += BALANCE_INTERVAL_NS;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		/* hungry domains are served at once, the others periodically */
+		if (0 == LpelMailboxRecvTimeout(balancermb, &msg, &ts)
+				&& msg.type == WORKER_MSG_TERMINATE)
+			break;
+		balanceDomains(size, size + num_domains, size + 2 * num_domains, top);
+	}
+
+	free(size);
+	free(top);
+	return NULL;
+}
+
+/* the balancer runs only if there are several domains */
+void spawnBalancer(void) {
+	if (num_domains <= 1)
+		return;
+	balancermb = LpelMailboxCreate();
+	(void) pthread_create(&balancer, NULL, BalancerThread, NULL);
+}
+
+void terminateBalancer(void) {
+	workermsg_t msg;
+	if (balancermb == NULL)
+		return;
+	msg.type = WORKER_MSG_TERMINATE;
+	LpelMailboxSend(balancermb, &msg);
+	(void) pthread_join(balancer, NULL);
+	/* the mailbox is kept until the masters have finished */
+}
+
+
+/*******************************************************************************
+ * MASTERLESS MODE
+ ******************************************************************************/
+
+#define SHARED_POP_TRIES	(2 * num_workers)		// pops before waiting
+#define SHARED_RETRY_NS		1000000		// wait for invalid tasks to become valid
+
+/* random state of the calling thread, threads outside lpel get a fresh one */
+static unsigned int *localSeed(unsigned int *tmp) {
+	workerctx_t *wc = LpelWorkerSelf();
+	if (wc != NULL)
+		return &wc->seed;
+	*tmp = __sync_add_and_fetch(&seedseq, 2654435761u) | 1;
+	return tmp;
+}
+
+static void addIdle(int wid) {
+	PRODLOCK_LOCK(&lockidle);
+	if (idlepos[wid] < 0) {
+		idlepos[wid] = num_idle;
+		idlestack[num_idle++] = wid;
+	}
+	PRODLOCK_UNLOCK(&lockidle);
+}
+
+static void removeIdle(int wid) {
+	int last;
+	PRODLOCK_LOCK(&lockidle);
+	if (idlepos[wid] >= 0) {
+		last = idlestack[--num_idle];
+		idlestack[idlepos[wid]] = last;
+		idlepos[last] = idlepos[wid];
+		idlepos[wid] = -1;
+	}
+	PRODLOCK_UNLOCK(&lockidle);
+}
+
+/* wake up one idle worker, if any */
+static void wakeIdleWorker(void) {
+	int wid = -1;
+	workermsg_t msg;
+	if (num_idle == 0)
+		return;
+	PRODLOCK_LOCK(&lockidle);
+	if (num_idle > 0) {
+		wid = idlestack[--num_idle];
+		idlepos[wid] = -1;
+	}
+	PRODLOCK_UNLOCK(&lockidle);
+	if (wid >= 0) {
+		msg.type = WORKER_MSG_WAKEUP;
+		msg.body.task = NULL;
+		LpelMailboxSend(workermbs[wid], &msg);
+	}
+}
+
+/* queue a ready task, its priority has to be set */
+static void pushShared(lpel_task_t *t) {
+	unsigned int tmp;
+	LpelMultiqueuePush(readyq, t, localSeed(&tmp));
+	wakeIdleWorker();
+}
+
+/* same as processTaskReady of the master */
+static void readyShared(lpel_task_t *t) {
+#ifdef _USE_NEG_DEMAND_LIMIT_
+	if (LpelTaskUpdateValid(t) != 0)
+#endif
+		t->sched_info.prio = LpelTaskCalPriority(t);
+	pushShared(t);
+}
+
+/*
+ * wakenup: 0 running, 1 woken up before it was returned, 2 returned blocked
+ * whoever comes second makes the task ready
+ */
+static void wakeupShared(lpel_task_t *t) {
+	if (!__sync_bool_compare_and_swap(&t->wakenup, 0, 1)) {
+		assert(t->wakenup == 2);
+		t->wakenup = 0;
+		t->state = TASK_READY;
+		readyShared(t);
+	}
+}
+
+static void updateListShared(sd_array_t *arr, char mode, int update_prio) {
+	lpel_task_t *t = NULL;
+	lpel_stream_t *s;
+	int i;
+	for (i = 0; i < arr->count; i++) {
+		s = arr->sds[i]->stream;
+		if (mode == 'r')
+			t = LpelStreamProducer(s);
+		else if (mode == 'w')
+			t = LpelStreamConsumer(s);
+		if (t)
+			LpelMultiqueueUpdate(readyq, t, update_prio);
+	}
+}
+
+/* the worker returning the task updates its neighbours */
+static void returnShared(lpel_task_t *t) {
+	int update_prio = PRIO_CFG(update_neigh_prio);
+	updateListShared(&t->sched_info.in_streams, 'r', update_prio);
+	if (update_prio)
+		updateListShared(&t->sched_info.out_streams, 'w', update_prio);
+	switch(t->state) {
+	case TASK_BLOCKED:
+		if (__sync_bool_compare_and_swap(&t->wakenup, 0, 2))
+			break;		/* made ready by the wakeup */
+		t->wakenup = 0;
+		t->state = TASK_READY;
+		readyShared(t);
+		break;
+
+	case TASK_READY:	// task yields
+		readyShared(t);
+		break;
+
+	case TASK_ZOMBIE:
+		LpelTaskDestroy(t);
+		break;
+	default:
+		assert(0);
+		break;
+	}
+}
+
+/* account the time a task ran in the slice histogram of the worker */
+static void recordSlice(workerctx_t *wc, lpel_cycles_t start) {
+	lpel_cycles_t us = (LpelCyclesNow() - start) / _lpel_cycles_per_us;
+	int b = 0;
+	while (us > 0 && b < LPEL_SLICE_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	wc->slice_hist[b]++;
+}
+
+static void runShared(workerctx_t *wc, lpel_task_t *t) {
+	lpel_cycles_t start;
+	WORKER_DBG("worker %d: get task %d\n", wc->wid, t->uid);
+	if (wc->idle_since != 0) {
+		wc->idle_cycles += LpelCyclesNow() - wc->idle_since;
+		wc->idle_since = 0;
+#ifdef USE_LOGGING
+		if (wc->mon && MON_CB(worker_waitstop)) {
+			MON_CB(worker_waitstop)(wc->mon);
+		}
+#endif
+	}
+	t->worker_context = wc;
+	wc->current_task = t;
+#ifdef USE_LOGGING
+	if (t->mon && MON_CB(task_assign)) {
+		MON_CB(task_assign)(t->mon, wc->mon);
+	}
+#endif
+	start = LpelCyclesNow();
+	mctx_switch(&wc->mctx, &t->mctx);
+	//task return here
+	recordSlice(wc, start);
+	assert(t->state != TASK_RUNNING);
+	wc->current_task = NULL;
+	t->worker_context = NULL;
+	returnShared(t);
+}
+
+static void waitShared(workerctx_t *wc, const struct timespec *abstime) {
+	workermsg_t msg;
+	if (0 == LpelMailboxRecvTimeout(wc->mailbox, &msg, abstime)) {
+		switch(msg.type) {
+		case WORKER_MSG_TERMINATE:
+			wc->terminate = 1;
+			break;
+		case WORKER_MSG_WAKEUP:
+		case WORKER_MSG_RESIZE:
+			break;
+		default:
+			assert(0);
+			break;
+		}
+	}
+}
+
+static void SharedWorkerLoop(workerctx_t *wc)
+{
+	WORKER_DBG("start worker %d\n", wc->wid);
+
+	lpel_task_t *t;
+	struct timespec ts;
+	int tries = 0;
+
+	while (1) {
+		t = (wc->wid < num_active) ? LpelMultiqueuePop(readyq, &wc->seed) : NULL;
+		if (t != NULL) {
+			tries = 0;
+			runShared(wc, t);
+			continue;
+		}
+
+		if (wc->idle_since == 0) {
+			wc->idle_since = LpelCyclesNow();
+#ifdef USE_LOGGING
+			if (wc->mon && MON_CB(worker_waitstart)) {
+				MON_CB(worker_waitstart)(wc->mon);
+			}
+#endif
+		}
+
+		if (wc->wid >= num_active) {		// retired workers wait until activated again
+			if (wc->terminate)
+				break;
+			waitShared(wc, NULL);
+			continue;
+		}
+
+		if (LpelMultiqueueSize(readyq) > 0) {
+			if (tries++ < SHARED_POP_TRIES)
+				continue;
+			/* only invalid tasks left, neighbours change them */
+			(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+			ts.tv_nsec += SHARED_RETRY_NS;
+			if (ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			waitShared(wc, &ts);
+			tries = 0;
+			continue;
+		}
+
+		/* check again after registering, a push wakes up a registered worker */
+		addIdle(wc->wid);
+		__sync_synchronize();
+		if (LpelMultiqueueSize(readyq) == 0) {
+			if (wc->terminate) {
+				removeIdle(wc->wid);
+				break;
+			}
+			waitShared(wc, NULL);
+		}
+		removeIdle(wc->wid);
+	}
+}
+
+
 /*******************************************************************************
  * WRAPPER FUNCTION
  ******************************************************************************/
 
 
+static void wrapperProcessMsg(workerctx_t *wp, workermsg_t *msg)
+{
+	lpel_task_t *t;
+	switch(msg->type) {
+	case WORKER_MSG_ASSIGN:
+		t = msg->body.task;
+		WORKER_DBG("wrapper: get task %d\n", t->uid);
+		assert(t->state == TASK_CREATED);
+		t->state = TASK_READY;
+		wp->current_task = t;
+#ifdef USE_LOGGING
+		if (t->mon) {
+			if (MON_CB(worker_create_wrapper)) {
+				wp->mon = MON_CB(worker_create_wrapper)(t->mon);
+			} else {
+				wp->mon = NULL;
+			}
+		}
+		if (t->mon && MON_CB(task_assign)) {
+			MON_CB(task_assign)(t->mon, wp->mon);
+		}
+#endif
+		break;
+
+	case WORKER_MSG_WAKEUP:
+		t = msg->body.task;
+		WORKER_DBG("wrapper: unblock task %d\n", t->uid);
+		assert (t->state == TASK_BLOCKED);
+		t->state = TASK_READY;
+		wp->current_task = t;
+#ifdef USE_LOGGING
+		if (t->mon && MON_CB(task_assign)) {
+			MON_CB(task_assign)(t->mon, wp->mon);
+		}
+#endif
+		break;
+	default:
+		assert(0);
+		break;
+	}
+}
+
+
 static void WrapperLoop(workerctx_t *wp)
 {
 	lpel_task_t *t = NULL;
@@ -405,56 +1151,40 @@ static void WrapperLoop(workerctx_t *wp)
 		} else {
 			/* no ready tasks */
 			LpelMailboxRecv(wp->mailbox, &msg);
-			switch(msg.type) {
-			case WORKER_MSG_ASSIGN:
-				t = msg.body.task;
-				WORKER_DBG("wrapper: get task %d\n", t->uid);
-				assert(t->state == TASK_CREATED);
-				t->state = TASK_READY;
-				wp->current_task = t;
-#ifdef USE_LOGGING
-				if (t->mon) {
-					if (MON_CB(worker_create_wrapper)) {
-						wp->mon = MON_CB(worker_create_wrapper)(t->mon);
-					} else {
-						wp->mon = NULL;
-					}
-				}
-				if (t->mon && MON_CB(task_assign)) {
-					MON_CB(task_assign)(t->mon, wp->mon);
-				}
-#endif
-				break;
-
-			case WORKER_MSG_WAKEUP:
-				t = msg.body.task;
-				WORKER_DBG("wrapper: unblock task %d\n", t->uid);
-				assert (t->state == TASK_BLOCKED);
-				t->state = TASK_READY;
-				wp->current_task = t;
-#ifdef USE_LOGGING
-				if (t->mon && MON_CB(task_assign)) {
-					MON_CB(task_assign)(t->mon, wp->mon);
-				}
-#endif
-				break;
-			default:
-				assert(0);
-				break;
-			}
+			wrapperProcessMsg(wp, &msg);
 		}
 	} while (!wp->terminate);
 	LpelTaskDestroy(wp->current_task);
+	wp->current_task = NULL;
 	/* cleanup task context marked for deletion */
 }
 
 
-static void addFreeWrapper(workerctx_t *wp) {
+/*
+ * park the wrapper in the list of free wrappers
+ * @return 1 if parked, 0 if the wrapper thread should exit
+ */
+static int addFreeWrapper(workerctx_t *wp) {
+	int parked = 0;
 	assert (!LpelMailboxHasIncoming(wp->mailbox) && wp->terminate);
+
+#ifdef USE_LOGGING
+	/* the monitoring context belongs to the terminated task */
+	if (wp->mon && MON_CB(worker_destroy)) {
+		MON_CB(worker_destroy)(wp->mon);
+	}
+#endif
+	wp->mon = NULL;
+
 	PRODLOCK_LOCK(&lockwrappers);
-	wp->next = freewrappers;
-	freewrappers = wp;
+	if (!wrappers_terminate && num_freewrappers < wrappers_max) {
+		wp->next = freewrappers;
+		freewrappers = wp;
+		num_freewrappers++;
+		parked = 1;
+	}
 	PRODLOCK_UNLOCK(&lockwrappers);
+	return parked;
 }
 
 static workerctx_t *getFreeWrapper(){
@@ -468,11 +1198,27 @@ static workerctx_t *getFreeWrapper(){
 		w = freewrappers;
 		freewrappers = w->next;
 		w->next = NULL;
+		num_freewrappers--;
 	}
 	PRODLOCK_UNLOCK(&lockwrappers);
 	return w;
 }
 
+/*
+ * wait until the parked wrapper is reused
+ * @return 1 if reused, 0 if the wrapper thread should exit
+ */
+static int waitReuse(workerctx_t *wp) {
+	workermsg_t msg;
+	LpelMailboxRecv(wp->mailbox, &msg);
+	if (msg.type == WORKER_MSG_TERMINATE)
+		return 0;
+
+	/* reused, honour the mapping of the new task */
+	LpelThreadAssign(wp->wid);
+	wrapperProcessMsg(wp, &msg);
+	return 1;
+}
 
 
 
@@ -493,10 +1239,22 @@ void *WrapperThread(void *arg)
 	wp->mctx = co_current();
 #endif
 
-	LpelThreadAssign(wp->wid);
-	WrapperLoop(wp);
+	/* a wrapper created for the pool waits for its first task */
+	int run = 1;
+	if (wp->terminate)
+		run = waitReuse(wp);
+	else
+		LpelThreadAssign(wp->wid);
 
-	addFreeWrapper(wp);
+	while (run) {
+		WrapperLoop(wp);
+		run = addFreeWrapper(wp) && waitReuse(wp);
+	}
+
+	LpelMailboxDestroy(wp->mailbox);
+	LpelWorkerDestroyStream(wp);
+	LpelWorkerDestroySd(wp);
+	free(wp);
 
 #ifdef USE_MCTX_PCL
 	co_thread_cleanup();
@@ -504,28 +1262,81 @@ void *WrapperThread(void *arg)
 	return NULL;
 }
 
-workerctx_t *LpelCreateWrapperContext(int wid) {
-	workerctx_t *wp = getFreeWrapper();
-	if (wp == NULL) {
-		wp = (workerctx_t *) malloc(sizeof(workerctx_t));
-		/* mailbox */
-		wp->mailbox = LpelMailboxCreate();
-		wp->free_sd = NULL;
-		wp->free_stream = NULL;
-		wp->next = NULL;
-	}
+/*
+ * create a wrapper context and thread
+ * @param parked	if set, the wrapper is put in the list of free wrappers
+ */
+static workerctx_t *createWrapper(int wid, int parked) {
+	workerctx_t *wp = (workerctx_t *) malloc(sizeof(workerctx_t));
+	/* mailbox */
+	wp->mailbox = LpelMailboxCreate();
+	wp->free_sd = NULL;
+	wp->free_stream = NULL;
+	wp->next = NULL;
 	wp->wid = wid;
-	wp->terminate = 0;
+	wp->domain = 0;
+	wp->seed = __sync_add_and_fetch(&seedseq, 2654435761u) | 1;
+	/* no task yet if parked */
+	wp->terminate = parked;
 	/* Wrapper is excluded from scheduling module */
 	wp->current_task = NULL;
+	wp->cont = NULL;
 	wp->mon = NULL;
 
-	/* taskqueue of free tasks */
+	if (parked) {
+		PRODLOCK_LOCK(&lockwrappers);
+		wp->next = freewrappers;
+		freewrappers = wp;
+		num_freewrappers++;
+		PRODLOCK_UNLOCK(&lockwrappers);
+	}
+
 	(void) pthread_create(&wp->thread, NULL, WrapperThread, wp);
 	(void) pthread_detach(wp->thread);
 	return wp;
 }
 
+workerctx_t *LpelCreateWrapperContext(int wid) {
+	workerctx_t *wp = getFreeWrapper();
+	if (wp == NULL)
+		return createWrapper(wid, 0);
+
+	/* the parked thread waits on its mailbox for the task */
+	wp->wid = wid;
+	wp->terminate = 0;
+	/* Wrapper is excluded from scheduling module */
+	wp->current_task = NULL;
+	wp->mon = NULL;
+	return wp;
+}
+
+/* spawn the minimum number of parked wrappers */
+void spawnParkedWrappers(void) {
+	int i;
+	for (i = 0; i < wrappers_min; i++)
+		(void) createWrapper(LPEL_MAP_WRAPPER, 1);
+}
+
+void LpelTaskPrefetchInit(int batch, double stale) {
+	if (batch < 1) batch = 1;
+	if (stale < 0.0) stale = 0.0;
+	prefetch = batch;
+	prefetch_stale = stale;
+}
+
+void LpelTaskLocalityInit(double tolerance) {
+	if (tolerance < 0.0) tolerance = 0.0;
+	locality_tolerance = tolerance;
+}
+
+void LpelWrapperPoolInit(int min, int max) {
+	if (max < 0) max = 0;
+	if (min < 0) min = 0;
+	if (min > max) min = max;
+	wrappers_min = min;
+	wrappers_max = max;
+}
+
 
 
 /** return the total number of workers, including master */
@@ -535,6 +1346,68 @@ int LpelWorkerCount(void)
 }
 
 
+int LpelWorkersActive(void)
+{
+	return num_active;
+}
+
+
+/*
+ * Resize the set of active workers
+ * The master does not assign tasks to retired workers anymore,
+ * they wait for a task until they are activated again.
+ * @return the number of active workers
+ */
+int LpelWorkersResize(int n)
+{
+	workermsg_t msg;
+	int i, old;
+	if (n < 1) n = 1;
+	if (n > num_workers) n = num_workers;
+	if ((old = __sync_lock_test_and_set(&num_active, n)) < n) {
+		/* let the masters serve the activated workers */
+		msg.type = WORKER_MSG_RESIZE;
+		msg.body.from_worker = n;
+		for (i = 0; i < num_domains; i++)
+			LpelMailboxSend(mastermbs[i], &msg);
+		/* without masters, the activated workers wake up themselves */
+		for (i = old; masterless && i < n; i++)
+			LpelMailboxSend(workermbs[i], &msg);
+	}
+	return n;
+}
+
+
+/* time the worker waited for tasks, including the current wait */
+unsigned long long LpelWorkerIdleCycles(int wid)
+{
+	workerctx_t *wc = workerctxs[wid];
+	lpel_cycles_t idle, since, now;
+	if (wc == NULL) return 0;
+	idle = wc->idle_cycles;
+	since = wc->idle_since;
+	if (since != 0) {
+		now = LpelCyclesNow();
+		if (now > since) idle += now - since;
+	}
+	return idle;
+}
+
+/* sum of the slice histograms of the workers */
+void LpelTaskSliceHistogram(unsigned long long *hist) {
+	int i, b;
+	for (b = 0; b < LPEL_SLICE_BUCKETS; b++)
+		hist[b] = 0;
+	for (i = 0; i < num_workers; i++) {
+		workerctx_t *wc = workerctxs[i];
+		if (wc == NULL)		// not started yet
+			continue;
+		for (b = 0; b < LPEL_SLICE_BUCKETS; b++)
+			hist[b] += wc->slice_hist[b];
+	}
+}
+
+
 /*******************************************************************************
  * WORKER FUNCTION
  ******************************************************************************/
@@ -553,15 +1426,48 @@ void LpelWorkerBroadcast(workermsg_t *msg)
 
 
 
+/* run the task until it stops and hand it back to the master */
+static void runTask(workerctx_t *wc, lpel_task_t *t) {
+	lpel_cycles_t start;
+	t->worker_context = wc;
+	t->last_worker = wc->wid;
+	wc->current_task = t;
+
+#ifdef USE_LOGGING
+	if (t->mon && MON_CB(task_assign)) {
+		MON_CB(task_assign)(t->mon, wc->mon);
+	}
+#endif
+	start = LpelCyclesNow();
+	mctx_switch(&wc->mctx, &t->mctx);
+	//task return here
+	recordSlice(wc, start);
+	assert(t->state != TASK_RUNNING);
+	wc->current_task = NULL;
+	t->worker_context = NULL;
+	returnTask(wc, t);
+}
+
 static void WorkerLoop(workerctx_t *wc)
 {
 	WORKER_DBG("start worker %d\n", wc->wid);
 
 	lpel_task_t *t = NULL;
-	requestTask(wc);		// ask for the first time
+	int i;
+	for (i = 0; i < prefetch; i++)
+		requestTask(wc);		// ask for the first time
 
 	workermsg_t msg;
 	do {
+		/* prefetched tasks are waiting in the mailbox already */
+		if (!LpelMailboxHasIncoming(wc->mailbox)) {
+			wc->idle_since = LpelCyclesNow();
+#ifdef USE_LOGGING
+			if (wc->mon && MON_CB(worker_waitstart)) {
+				MON_CB(worker_waitstart)(wc->mon);
+			}
+#endif
+		}
 		LpelMailboxRecv(wc->mailbox, &msg);
 
 		switch(msg.type) {
@@ -569,26 +1475,31 @@ static void WorkerLoop(workerctx_t *wc)
 			t = msg.body.task;
 			WORKER_DBG("worker %d: get task %d\n", wc->wid, t->uid);
 			assert(t->state == TASK_READY);
-			t->worker_context = wc;
-			wc->current_task = t;
-
+			if (wc->idle_since != 0) {
+				wc->idle_cycles += LpelCyclesNow() - wc->idle_since;
+				wc->idle_since = 0;
 #ifdef USE_LOGGING
-			if (wc->mon && MON_CB(worker_waitstop)) {
-				MON_CB(worker_waitstop)(wc->mon);
+				if (wc->mon && MON_CB(worker_waitstop)) {
+					MON_CB(worker_waitstop)(wc->mon);
+				}
+#endif
+			} else if (prefetch > 1 &&
+					t->sched_info.prio - LpelTaskCalPriority(t) > prefetch_stale) {
+				/* priority became stale while prefetched, let the master decide again */
+				WORKER_DBG("worker %d: return stale task %d\n", wc->wid, t->uid);
+				requestTask(wc);
+				returnTask(wc, t);
+				break;
 			}
-			if (t->mon && MON_CB(task_assign)) {
-				MON_CB(task_assign)(t->mon, wc->mon);
+			runTask(wc, t);
+			/* woken tasks kept on this worker take over the slot of t */
+			while (wc->cont != NULL) {
+				t = wc->cont;
+				wc->cont = NULL;
+				WORKER_DBG("worker %d: continue with task %d\n", wc->wid, t->uid);
+				t->state = TASK_READY;
+				runTask(wc, t);
 			}
-#endif
-			mctx_switch(&wc->mctx, &t->mctx);
-			//task return here
-			assert(t->state != TASK_RUNNING);
-			//  	  	if (t->state != TASK_ZOMBIE) {
-			wc->current_task = NULL;
-			t->worker_context = NULL;
-			returnTask(t);
-			//  	  	} else
-			//  	  		LpelTaskDestroy(t);		// if task finish, destroy it and not return to master
 			break;
 		case WORKER_MSG_TERMINATE:
 			wc->terminate = 1;
@@ -622,8 +1533,12 @@ void *WorkerThread(void *arg)
 
 	wc->terminate = 0;
 	wc->current_task = NULL;
-	LpelThreadAssign(wc->wid + 1);		// 0 is for the master
-	WorkerLoop(wc);
+	workerctxs[wc->wid] = wc;
+	LpelThreadAssign(wc->core);		// first core of the domain is for the master
+	if (masterless)
+		SharedWorkerLoop(wc);
+	else
+		WorkerLoop(wc);
 
 #ifdef USE_LOGGING
 	/* cleanup monitoring */
@@ -668,7 +1583,8 @@ void LpelWorkerTaskExit(lpel_task_t *t) {
 	workerctx_t *wc = t->worker_context;
 	WORKER_DBG("worker %d: task %d exit\n", wc->wid, t->uid);
 	if (wc->wid >= 0) {
-		requestTask(wc);	// FIXME: should have requested before
+		if (!masterless && wc->cont == NULL)
+			requestTask(wc);	// FIXME: should have requested before
 		wc->current_task = NULL;
 	}
 	else
@@ -685,7 +1601,8 @@ void LpelWorkerTaskBlock(lpel_task_t *t){
 	} else {
 		WORKER_DBG("worker %d: block task %d\n", wc->wid, t->uid);
 		//sendUpdatePrior(t);		//update prior for neighbor
-		requestTask(wc);
+		if (!masterless && wc->cont == NULL)
+			requestTask(wc);
 	}
 	wc->current_task = NULL;
 	mctx_switch(&t->mctx, &wc->mctx);		// switch back to the worker/wrapper
@@ -698,23 +1615,106 @@ void LpelWorkerTaskYield(lpel_task_t *t){
 	}
 	else {
 		//sendUpdatePrior(t);		//update prior for neighbor
-		requestTask(wc);
+		if (!masterless && wc->cont == NULL)
+			requestTask(wc);
 		WORKER_DBG("worker %d: return task %d\n", wc->wid, t->uid);
 		wc->current_task = NULL;
 	}
 	mctx_switch(&t->mctx, &wc->mctx);		// switch back to the worker/wrapper
 }
 
+/*
+ * Keep the woken task on the waking worker if it would be the head of the
+ * queue of its domain. It is run as soon as the current task stops, the
+ * master learns about it when the task is returned.
+ * @pre t has been returned blocked to its master, which does not touch it
+ *      until it is woken up
+ */
+static int claimTask(workerctx_t *wc, lpel_task_t *t) {
+	if (wc == NULL || wc->wid < 0 || wc->wid >= num_active || wc->cont != NULL
+			|| wc->current_task == NULL)
+		return 0;
+	if (t->home != wc->domain || t->state != TASK_RETURNED)
+		return 0;
+#ifdef _USE_NEG_DEMAND_LIMIT_
+	if (LpelTaskUpdateValid(t) == 0)
+		return 0;
+#endif
+	t->sched_info.prio = LpelTaskCalPriority(t);
+	if (t->sched_info.prio < domainsums[wc->domain].top)
+		return 0;
+	wc->cont = t;
+	wc->cont_fresh = 1;
+	return 1;
+}
+
+/*
+ * Called by the running task after each read and each data write that
+ * does not yield. A continuation not used by the end of the next of
+ * these stream accesses is passed to the master, so that the woken task
+ * is not delayed further.
+ */
+void LpelWorkerReleaseCont(lpel_task_t *t) {
+	workerctx_t *wc = t->worker_context;
+	if (wc->cont == NULL)
+		return;
+	if (wc->cont_fresh) {
+		wc->cont_fresh = 0;
+		return;
+	}
+	sendWakeup(mastermbs[wc->cont->home], wc->cont);
+	wc->cont = NULL;
+}
+
+/*
+ * The streams of a task not running changed outside of the workers,
+ * e.g. a wrapper read from a full output stream of the task. Tasks on
+ * workers update their neighbours when they are returned, tasks on
+ * wrappers never are.
+ */
+void LpelWorkerTaskUpdate(lpel_task_t *t) {
+	if (t->worker_context != NULL)		// running, evaluated when returned
+		return;
+	if (masterless)
+		LpelMultiqueueUpdate(readyq, t, 0);
+	else
+		sendUpdate(t);
+}
+
+/*
+ * The priority function changed (drain mode of the memory budget,
+ * LpelTaskPrioSwitch), the queued tasks are re-evaluated by their
+ * masters, or directly in the masterless mode
+ */
+void LpelWorkerReprioritise(void) {
+	workermsg_t msg;
+	int i;
+	if (num_domains < 0)		// not started yet
+		return;
+	if (masterless) {
+		LpelMultiqueueRefresh(readyq);
+		wakeIdleWorker();
+		return;
+	}
+	msg.type = WORKER_MSG_REPRIO;
+	for (i = 0; i < num_domains; i++)
+		LpelMailboxSend(mastermbs[i], &msg);
+}
+
 void LpelWorkerTaskWakeup(lpel_task_t *t) {
 	workerctx_t *wc = t->worker_context;
 	WORKER_DBG("worker %d: send wake up task %d\n", LpelWorkerSelf()->wid, t->uid);
-	if (wc == NULL)
-		sendWakeup(mastermb, t);
+	if ((wc == NULL || wc->wid >= 0) && masterless)
+		wakeupShared(t);
+	else if (wc == NULL) {
+		if (!claimTask(LpelWorkerSelf(), t))
+			sendWakeup(mastermbs[t->home], t);
+	}
 	else {
 		if (wc->wid < 0)
 			sendWakeup(wc->mailbox, t);
 		else
-			sendWakeup(mastermb, t);
+			sendWakeup(mastermbs[t->home], t);
 	}
 }
 
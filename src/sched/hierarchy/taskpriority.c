@@ -3,6 +3,8 @@
 #include <time.h>
 #include "taskpriority.h"
 #include "hrc_lpel.h"
+#include "lpelcfg.h"
+#include "hrc_worker.h"
 
 /****************************************************************
  * 14 different function to calculate task priority based on
@@ -34,6 +36,13 @@
  *	 14										I - O											- O										I
  *	 15									LOCATION-BASED
  *	 16									STATIC RANDOM (use the 13 one but not update every time task stop)
+ *	 17									CRITICAL PATH (I + 1) * (B + 1) / (D + 1), D hops to the exit, B items downstream
+ *	 18									Wi - Wo									- Wo									Wi
+ *	 19									(Wi + 1) / (Wo + 1)			0											infinity
+ *
+ * 18 and 19 use the estimated work in us instead of the number of records:
+ * Wi records in the input streams times the measured time per record of the task,
+ * Wo records in the output streams times the time per record of their consumers
  ****************************************************************************************/
 
 double priorfunc1(int in, int out) {
@@ -179,8 +188,25 @@ double priorfunc14(int in, int out) {
 }
 
 
-void LpelTaskPrioInit(lpel_task_prio_conf *conf) {
-		srand(time(NULL));
+/*
+ * priority functions on the estimated work,
+ * in/out are -1 for entry/exit tasks as for the records
+ */
+double priorwork(int index, double in, double out) {
+	if (index == LPEL_PRIO_WORK_RATIO) {
+		if (in < 0)
+			return 0;
+		if (out < 0)
+			return DBL_MAX;
+		return (in + 1.0)/(out + 1.0);
+	}
+
+	in = (in < 0 ? 0 : in);
+	out = (out < 0 ? 0 : out);
+	return (in - out);
+}
+
+static void selectPrioFunc(lpel_task_prio_conf *conf) {
 		conf->prio_type = LPEL_DYN_PRIO;
 		conf->update_neigh_prio = 1;
 		switch (conf->prio_index){
@@ -220,6 +246,15 @@ void LpelTaskPrioInit(lpel_task_prio_conf *conf) {
 						conf->prio_type = LPEL_STC_PRIO;
 						conf->update_neigh_prio = 0;
 						break;
+		case LPEL_PRIO_CRITICAL_PATH:			// see hrc_critpath.c
+						conf->prio_func = priorfunc14;
+						break;
+		case LPEL_PRIO_WORK_BALANCE:			// see priorwork
+						conf->prio_func = priorfunc14;
+						break;
+		case LPEL_PRIO_WORK_RATIO:
+						conf->prio_func = priorfunc1;
+						break;
 		default: conf->prio_func = priorfunc14;
 						break;
 		}
@@ -228,3 +263,68 @@ void LpelTaskPrioInit(lpel_task_prio_conf *conf) {
 		if (conf->prio_index != 15)
 			conf->rts_prio_cmp = NULL;
 }
+
+
+void LpelTaskPrioInit(lpel_task_prio_conf *conf) {
+		srand(time(NULL));
+		selectPrioFunc(conf);
+}
+
+
+/* configurations published by LpelTaskPrioSwitch(), freed on cleanup */
+typedef struct prio_switched {
+	lpel_task_prio_conf conf;
+	struct prio_switched *next;
+} prio_switched_t;
+
+static prio_switched_t * volatile prio_switched = NULL;
+
+
+/**
+ * Switch the priority configuration while running, e.g. to tune it
+ * against a live network. prio_index and neg_demand_lim are taken from
+ * conf and the queued tasks are re-evaluated.
+ * The new configuration is set up in a copy of the current one, which
+ * then replaces it at once. The replaced one is kept until cleanup, as
+ * the workers may still read it.
+ * The location-based priority (15) needs the rts priorities of all tasks
+ * and can only be chosen in LpelInit(). The graph of the critical-path
+ * priority (17) only includes the streams opened after the switch.
+ *
+ * @return LPEL_ERR_INVAL for location-based priority
+ */
+int LpelTaskPrioSwitch(lpel_task_prio_conf *conf) {
+	prio_switched_t *ps;
+
+	if (conf->prio_index == 15)
+		return LPEL_ERR_INVAL;
+	ps = (prio_switched_t *) malloc(sizeof(prio_switched_t));
+	ps->conf = *_lpel_prio_config;
+	ps->conf.prio_index = conf->prio_index;
+	ps->conf.neg_demand_lim = conf->neg_demand_lim;
+	selectPrioFunc(&ps->conf);
+
+	do {
+		ps->next = prio_switched;
+	} while (!__sync_bool_compare_and_swap(&prio_switched, ps->next, ps));
+	__sync_synchronize();		// the copy is complete before it is published
+	_lpel_prio_config = &ps->conf;
+
+	LpelWorkerReprioritise();
+	return LPEL_ERR_SUCCESS;
+}
+
+
+/*
+ * Return to the configuration given to LpelInit() and free the switched
+ * ones, once the workers have finished
+ */
+void LpelTaskPrioCleanup(void) {
+	prio_switched_t *ps;
+
+	_lpel_prio_config = &_lpel_global_config.prio_config;
+	while ((ps = prio_switched) != NULL) {
+		prio_switched = ps->next;
+		free(ps);
+	}
+}
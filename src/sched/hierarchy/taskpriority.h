@@ -15,4 +15,7 @@ double priorfunc11(int in, int out);
 double priorfunc12(int in, int out);
 double priorrandom(int in, int out);
 double priorfunc14(int in, int out);
+double priorwork(int index, double in, double out);
+
+void LpelTaskPrioCleanup(void);
 #endif /* _TASKPRIORITY_H */
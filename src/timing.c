@@ -4,6 +4,7 @@
 
 
 #include <lpel/timing.h>
+#include "arch/cycles.h"
 
 
 
@@ -189,3 +190,35 @@ void LpelTimingExpAvg(lpel_timing_t *t, const lpel_timing_t *last,
 
 
 
+
+
+lpel_cycles_t _lpel_cycles_per_us = 1000;
+
+/**
+ * Calibrate the cycle counter against the clock
+ *
+ * Busy waits for about a millisecond.
+ */
+void LpelCyclesInit(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  lpel_timing_t start, now, diff;
+  lpel_cycles_t c0, c1;
+  double ns;
+
+  LpelTimingNow(&start);
+  c0 = LpelCyclesNow();
+  do {
+    LpelTimingNow(&now);
+    LpelTimingDiff(&diff, &start, &now);
+    ns = LpelTimingToNSec(&diff);
+  } while (ns < 1000000.0);
+  c1 = LpelCyclesNow();
+
+  _lpel_cycles_per_us = (lpel_cycles_t) ((double)(c1 - c0) * 1000.0 / ns);
+  if (_lpel_cycles_per_us == 0) _lpel_cycles_per_us = 1;
+#else
+  /* the monotonic clock in nanoseconds is used */
+  _lpel_cycles_per_us = 1000;
+#endif
+}
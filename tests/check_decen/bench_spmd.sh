@@ -0,0 +1,16 @@
+#!/bin/bash
+# SPMD enter/exit latency against the number of workers
+# usage: bench_spmd.sh [max_workers] [rounds] [team_size]
+
+MAX=${1:-`nproc`}
+ROUNDS=${2:-10000}
+TEAM=${3:-0}
+F_SPMD=results_spmd
+
+rm -f $F_SPMD.tmp
+for w in `seq 1 $MAX`
+do
+  ./spmdtest $w $ROUNDS $TEAM >> $F_SPMD.tmp
+done
+
+mv $F_SPMD.tmp $F_SPMD
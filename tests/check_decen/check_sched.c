@@ -0,0 +1,324 @@
+/**
+ * Test of the scheduling policies of a worker, all cases run on one worker
+ *
+ * group: task groups and the aging of the priorities
+ * - two busy tasks in a group of weight 3072 and one in a group of the
+ *   default weight 1024 share the worker 3:1
+ * - a busy task of priority 0 next to one of priority 1 in the same
+ *   group is passed over SCHED_AGING_LIMIT (8) times before it runs,
+ *   i.e. it gets about 1/9 of the runs
+ *
+ * deadline: earliest-deadline-first scheduling
+ * - a task writes a record without a deadline to one consumer and then a
+ *   record with a deadline to another, while busy tasks keep the worker
+ *   occupied; the consumer of the second record inherits the deadline
+ *   and has to finish before the consumer of the first one
+ * - with a deadline which has passed already, the second record no
+ *   longer overtakes the first one
+ *
+ * inherit: priority inheritance along streams
+ * - a reader of priority 1 reads from a producer of priority 0, which
+ *   yields before each write, next to busy tasks of priority 0; without
+ *   inheritance the producer queues behind the busy tasks for each item,
+ *   with inheritance the blocked reader moves it ahead of them
+ *
+ * usage: sched [case] [ms per phase]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "lpel.h"
+
+#define NUM_BUSY   3
+#define NUM_ITEMS  2000
+
+static unsigned long long phase_ns = 500000000ULL;
+static const char *only = NULL;
+static int failed = 0;
+
+/* busy tasks spin for slice_us between yields and count their runs */
+static int slice_us;
+static volatile int stop;
+static volatile long runs[NUM_BUSY];
+
+/* all tasks of a case post it when they are done */
+static lpel_sema_t done;
+
+
+static void Fail(const char *msg)
+{
+  fprintf(stderr, "%s\n", msg);
+  failed = 1;
+}
+
+static void spin(int us)
+{
+  struct timespec a, b;
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &b);
+  } while ((b.tv_sec - a.tv_sec) * 1000000L + (b.tv_nsec - a.tv_nsec) / 1000 < us);
+}
+
+
+static void *Busy(void *arg)
+{
+  long i = (long) arg;
+  while (!stop) {
+    spin(slice_us);
+    runs[i]++;
+    LpelTaskYield();
+  }
+  LpelSemaPost(&done);
+  return NULL;
+}
+
+static void Spawn(long i, int group, int prio)
+{
+  lpel_task_t *t = LpelTaskCreate(0, Busy, (void *) i, 0);
+  LpelTaskSetGroup(t, group);
+  LpelTaskSetPriority(t, prio);
+  LpelTaskStart(t);
+}
+
+/* stop the busy tasks and wait for them */
+static void StopBusy(int n)
+{
+  int i;
+  stop = 1;
+  for (i=0; i<n; i++) LpelSemaWait(&done);
+  stop = 0;
+}
+
+
+/* let the tasks run for a phase, then stop them */
+static void GroupPhase(int n)
+{
+  LpelTaskSleep(phase_ns);
+  StopBusy(n);
+}
+
+static void TestGroup(void)
+{
+  unsigned long long u1, u2;
+  double share;
+
+  slice_us = 50;
+
+  /* weights */
+  LpelTaskGroupSetWeight(1, 3 * LPEL_GROUP_WEIGHT_DEFAULT);
+  Spawn(0, 1, 0);
+  Spawn(1, 1, 0);
+  Spawn(2, 2, 0);
+  GroupPhase(3);
+  u1 = LpelTaskGroupUsage(1);
+  u2 = LpelTaskGroupUsage(2);
+  share = (double) u1 / (u1 + u2);
+  printf("weights 3:1, usage %llu:%llu us\n", u1, u2);
+  if (share < 0.7 || share > 0.8) Fail("group 1 did not get 0.75 of the worker");
+
+  /* aging, in a group of its own */
+  runs[0] = runs[1] = 0;
+  Spawn(0, 3, 1);
+  Spawn(1, 3, 0);
+  GroupPhase(2);
+  share = (double) runs[1] / (runs[0] + runs[1]);
+  printf("aging, runs prio 1: %ld, prio 0: %ld\n", runs[0], runs[1]);
+  if (share < 0.08 || share > 0.15) Fail("priority 0 did not get 1/9 of the runs");
+}
+
+
+static volatile int finished;     /* records consumed so far */
+static lpel_sema_t ready;
+
+/* records the position at which it consumed its record */
+static void *Consumer(void *arg)
+{
+  lpel_stream_desc_t *in = LpelStreamOpen((lpel_stream_t *) arg, 'r');
+  int *pos;
+
+  LpelSemaPost(&ready);
+  pos = (int *) LpelStreamRead(in);
+  spin(slice_us);
+  *pos = ++finished;
+  LpelStreamClose(in, 1);
+  LpelSemaPost(&done);
+  return NULL;
+}
+
+/* @return 1 if the second record is consumed first */
+static int Overtakes(unsigned long long ns, int missed)
+{
+  lpel_stream_t *s[2];
+  lpel_stream_desc_t *out[2];
+  int pos[2];
+  int i;
+
+  finished = 0;
+  for (i=0; i<2; i++) {
+    s[i] = LpelStreamCreate(0);
+    LpelTaskStart(LpelTaskCreate(0, Consumer, s[i], 0));
+    LpelSemaWait(&ready);
+    out[i] = LpelStreamOpen(s[i], 'w');
+  }
+
+  LpelStreamWrite(out[0], &pos[0]);
+  LpelTaskSetDeadline(LpelTaskSelf(), ns);
+  if (missed) spin(slice_us);
+  LpelStreamWrite(out[1], &pos[1]);
+  LpelTaskSetDeadline(LpelTaskSelf(), 0);
+
+  for (i=0; i<2; i++) {
+    LpelSemaWait(&done);
+    LpelStreamClose(out[i], 0);
+  }
+  return pos[1] < pos[0];
+}
+
+static void TestDeadline(void)
+{
+  int i;
+
+  slice_us = 50;
+  LpelSemaInit(&ready, 0, 0);
+  for (i=0; i<NUM_BUSY; i++) Spawn(0, 0, 0);
+
+  if (!Overtakes(100000000ULL, 0)) Fail("the record with a deadline did not overtake");
+  if (Overtakes(1000ULL, 1)) Fail("the record with a missed deadline overtook");
+
+  StopBusy(NUM_BUSY);
+  LpelSemaDestroy(&ready);
+}
+
+
+static lpel_stream_t *stream;
+static int item;
+
+static void *Producer(void *arg)
+{
+  lpel_stream_desc_t *out = LpelStreamOpen(stream, 'w');
+  int i;
+  (void) arg;
+
+  for (i=0; i<NUM_ITEMS; i++) {
+    spin(slice_us);
+    LpelTaskYield();
+    LpelStreamWrite(out, &item);
+  }
+  LpelStreamClose(out, 0);
+  LpelSemaPost(&done);
+  return NULL;
+}
+
+static void *Reader(void *arg)
+{
+  lpel_stream_desc_t *in = LpelStreamOpen(stream, 'r');
+  int i;
+  (void) arg;
+
+  for (i=0; i<NUM_ITEMS; i++) (void) LpelStreamRead(in);
+  LpelStreamClose(in, 1);
+  LpelSemaPost(&done);
+  return NULL;
+}
+
+static void Start(lpel_taskfunc_t func, int prio)
+{
+  lpel_task_t *t = LpelTaskCreate(0, func, NULL, 0);
+  LpelTaskSetPriority(t, prio);
+  LpelTaskStart(t);
+}
+
+/* @return the runs of the busy tasks per item */
+static double InheritPhase(int depth)
+{
+  int i;
+
+  LpelTaskPrioInheritInit(depth);
+  for (i=0; i<NUM_BUSY; i++) runs[i] = 0;
+  stream = LpelStreamCreate(0);
+  for (i=0; i<NUM_BUSY; i++) Spawn(i, 0, 0);
+  Start(Reader, 1);
+  Start(Producer, 0);
+
+  /* reader and producer */
+  for (i=0; i<2; i++) LpelSemaWait(&done);
+  StopBusy(NUM_BUSY);
+  return (double) (runs[0] + runs[1] + runs[2]) / NUM_ITEMS;
+}
+
+static void TestInherit(void)
+{
+  double without, with;
+
+  slice_us = 20;
+  without = InheritPhase(0);
+  with = InheritPhase(1);
+  LpelTaskPrioInheritInit(0);
+  printf("busy runs per item: %.2f without, %.2f with inheritance\n", without, with);
+  if (with > 1.0 || without < 2.0) Fail("the producer was not moved ahead of the busy tasks");
+}
+
+
+typedef struct {
+  const char *name;
+  void (*run)(void);
+} sched_case_t;
+
+static const sched_case_t cases[] = {
+  { "group",    TestGroup },
+  { "deadline", TestDeadline },
+  { "inherit",  TestInherit },
+};
+#define NUM_CASES  ((int) (sizeof(cases) / sizeof(cases[0])))
+
+
+static void *Main(void *arg)
+{
+  int i;
+  (void) arg;
+
+  LpelSemaInit(&done, 0, 0);
+  for (i=0; i<NUM_CASES; i++) {
+    if (only != NULL && strcmp(only, cases[i].name) != 0) continue;
+    cases[i].run();
+  }
+  LpelSemaDestroy(&done);
+  LpelStop();
+  return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+  lpel_config_t cfg;
+  int i;
+
+  if (argc > 1) only = argv[1];
+  if (argc > 2) phase_ns = atoi(argv[2]) * 1000000ULL;
+  for (i=0; i<NUM_CASES && only != NULL; i++) {
+    if (strcmp(only, cases[i].name) == 0) break;
+  }
+  if (i == NUM_CASES) {
+    fprintf(stderr, "unknown case %s\n", only);
+    return EXIT_FAILURE;
+  }
+
+  memset(&cfg, 0, sizeof(lpel_config_t));
+  cfg.num_workers = 1;
+  cfg.proc_workers = 1;
+  cfg.proc_others = 0;
+  cfg.type = DECEN_LPEL;
+
+  LpelInit(&cfg);
+  if (0 != LpelStart(&cfg)) {
+    fprintf(stderr, "cannot start lpel\n");
+    return EXIT_FAILURE;
+  }
+  LpelTaskStart(LpelTaskCreate(0, Main, NULL, 0));
+  LpelCleanup();
+
+  printf("sched: %s\n", failed ? "FAILED" : "ok");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
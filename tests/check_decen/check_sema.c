@@ -0,0 +1,178 @@
+/**
+ * Test of the counting semaphores, barriers and binary semaphores
+ *
+ * - N tasks pass a barrier R times, all of them have to arrive
+ *   before any of them leaves
+ * - a producer and a consumer exchange items through a bounded
+ *   buffer guarded by two counting semaphores
+ * - tasks increment a shared counter under a binary semaphore
+ *
+ * usage: sema [num_workers] [spin_us]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "lpel.h"
+
+#define NUM_TASKS   6
+#define ROUNDS      200
+#define NUM_ITEMS   20000
+#define BUF_SIZE    8
+#define INCREMENTS  5000
+
+static int num_workers = 2;
+static int spin = 0;
+static int failed = 0;
+
+/* all tasks of a test post it when they are done */
+static lpel_sema_t done;
+
+static lpel_barrier_t bar;
+static volatile int arrived[ROUNDS];
+static volatile int leaders;
+
+static lpel_sema_t empty, full;
+static int buffer[BUF_SIZE];
+
+static lpel_bisema_t mutex;
+static volatile int counter;
+
+
+static void Fail(const char *msg)
+{
+  fprintf(stderr, "%s\n", msg);
+  failed = 1;
+}
+
+
+static void *BarrierTask(void *arg)
+{
+  int r;
+  (void) arg;
+  for (r=0; r<ROUNDS; r++) {
+    (void) __sync_fetch_and_add(&arrived[r], 1);
+    if (LpelBarrierWait(&bar)) (void) __sync_fetch_and_add(&leaders, 1);
+    if (arrived[r] != NUM_TASKS) Fail("barrier left too early");
+  }
+  LpelSemaPost(&done);
+  return NULL;
+}
+
+
+static void *Producer(void *arg)
+{
+  int i;
+  (void) arg;
+  for (i=0; i<NUM_ITEMS; i++) {
+    LpelSemaWait(&empty);
+    buffer[i % BUF_SIZE] = i;
+    LpelSemaPost(&full);
+  }
+  LpelSemaPost(&done);
+  return NULL;
+}
+
+static void *Consumer(void *arg)
+{
+  int i;
+  (void) arg;
+  for (i=0; i<NUM_ITEMS; i++) {
+    LpelSemaWait(&full);
+    if (buffer[i % BUF_SIZE] != i) Fail("counting semaphore: wrong item");
+    LpelSemaPost(&empty);
+  }
+  if (LpelSemaTryWait(&full)) Fail("counting semaphore: item left");
+  LpelSemaPost(&done);
+  return NULL;
+}
+
+
+static void *Incrementer(void *arg)
+{
+  int i;
+  (void) arg;
+  for (i=0; i<INCREMENTS; i++) {
+    LpelBiSemaWait(&mutex);
+    counter = counter + 1;
+    LpelBiSemaSignal(&mutex);
+  }
+  LpelSemaPost(&done);
+  return NULL;
+}
+
+
+static void Spawn(lpel_taskfunc_t func, int n)
+{
+  int i;
+  for (i=0; i<n; i++) {
+    LpelTaskStart(LpelTaskCreate(i % num_workers, func, NULL, 0));
+  }
+}
+
+static void Join(int n)
+{
+  int i;
+  for (i=0; i<n; i++) LpelSemaWait(&done);
+}
+
+
+static void *Main(void *arg)
+{
+  (void) arg;
+  LpelSemaInit(&done, 0, 0);
+
+  LpelBarrierInit(&bar, NUM_TASKS, spin);
+  Spawn(BarrierTask, NUM_TASKS);
+  Join(NUM_TASKS);
+  LpelBarrierDestroy(&bar);
+  if (leaders != ROUNDS) Fail("barrier: one task per round has to be the last");
+
+  LpelSemaInit(&empty, BUF_SIZE, spin);
+  LpelSemaInit(&full, 0, spin);
+  LpelTaskStart(LpelTaskCreate(0, Producer, NULL, 0));
+  LpelTaskStart(LpelTaskCreate(num_workers - 1, Consumer, NULL, 0));
+  Join(2);
+  LpelSemaDestroy(&empty);
+  LpelSemaDestroy(&full);
+
+  LpelBiSemaInit(&mutex);
+  Spawn(Incrementer, NUM_TASKS);
+  Join(NUM_TASKS);
+  LpelBiSemaDestroy(&mutex);
+  if (counter != NUM_TASKS * INCREMENTS) Fail("binary semaphore: lost update");
+
+  LpelSemaDestroy(&done);
+  LpelStop();
+  return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+  lpel_config_t cfg;
+
+  if (argc > 1) num_workers = atoi(argv[1]);
+  if (argc > 2) spin = atoi(argv[2]);
+  if (num_workers < 1) num_workers = 1;
+
+  memset(&cfg, 0, sizeof(lpel_config_t));
+  cfg.num_workers = num_workers;
+  /* more workers than cores share them */
+  cfg.proc_workers = num_workers;
+  if (cfg.proc_workers > sysconf(_SC_NPROCESSORS_ONLN))
+    cfg.proc_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  cfg.proc_others = 0;
+  cfg.type = DECEN_LPEL;
+
+  LpelInit(&cfg);
+  if (0 != LpelStart(&cfg)) {
+    fprintf(stderr, "cannot start lpel with %d workers\n", num_workers);
+    return EXIT_FAILURE;
+  }
+  LpelTaskStart(LpelTaskCreate(0, Main, NULL, 0));
+  LpelCleanup();
+
+  printf("sema: %s\n", failed ? "FAILED" : "ok");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+/**
+ * SPMD benchmark: measures the latency of entering and leaving
+ * a SPMD region (LpelTaskEnterSPMDTeam) for a given number of workers
+ *
+ * usage: spmdtest [num_workers] [rounds] [team_size]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "lpel.h"
+#include "lpel/timing.h"
+
+
+static int num_workers = 2;
+static int rounds = 10000;
+static int team_size = 0;
+
+/* every worker adds its virtual id + 1 */
+static volatile int vid_sum;
+
+
+static void Spmd(void *arg)
+{
+  (void) arg;
+  assert(LpelSpmdSize() == team_size);
+  (void) __sync_fetch_and_add(&vid_sum, LpelSpmdVId() + 1);
+}
+
+
+static void *Master(void *arg)
+{
+  lpel_timing_t total;
+  int i, expected = team_size * (team_size + 1) / 2;
+  (void) arg;
+
+  /* warm up */
+  i = LpelTaskEnterSPMDTeam(team_size, NULL, Spmd, NULL);
+  assert(i == team_size && vid_sum == expected);
+
+  vid_sum = 0;
+  LpelTimingStart(&total);
+  for (i=0; i<rounds; i++) {
+    LpelTaskEnterSPMDTeam(team_size, NULL, Spmd, NULL);
+  }
+  LpelTimingEnd(&total);
+
+  if (vid_sum != rounds * expected) {
+    fprintf(stderr, "wrong spmd execution: %d != %d\n",
+        vid_sum, rounds * expected);
+    exit(EXIT_FAILURE);
+  }
+
+  /* workers, team size, average enter/exit latency in usec */
+  printf("%d %d %.3f\n", num_workers, team_size,
+      LpelTimingToNSec(&total) / rounds / 1000.0);
+
+  LpelStop();
+  return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+  lpel_config_t cfg;
+  lpel_task_t *t;
+
+  if (argc > 1) num_workers = atoi(argv[1]);
+  if (argc > 2) rounds = atoi(argv[2]);
+  if (argc > 3) team_size = atoi(argv[3]);
+  if (team_size <= 0 || team_size > num_workers) team_size = num_workers;
+  assert(num_workers > 0 && rounds > 0);
+
+  memset(&cfg, 0, sizeof(lpel_config_t));
+  cfg.num_workers = num_workers;
+  /* more workers than cores share them */
+  cfg.proc_workers = num_workers;
+  if (cfg.proc_workers > sysconf(_SC_NPROCESSORS_ONLN))
+    cfg.proc_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  cfg.proc_others = 0;
+  cfg.flags = 0;
+  cfg.type = DECEN_LPEL;
+
+  LpelInit(&cfg);
+  if (0 != LpelStart(&cfg)) {
+    fprintf(stderr, "cannot start lpel with %d workers\n", num_workers);
+    return EXIT_FAILURE;
+  }
+
+  t = LpelTaskCreate(0, Master, NULL, 0);
+  LpelTaskStart(t);
+
+  LpelCleanup();
+  return 0;
+}
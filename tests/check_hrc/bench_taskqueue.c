@@ -0,0 +1,88 @@
+/*
+ * Benchmark of the ready queue of the master
+ *
+ * Pushes N tasks with random priorities, updates priorities at random
+ * (as the master does for the neighbours of a returned task), removes
+ * random tasks and finally pops all, checking the order.
+ *
+ * usage: bench_taskqueue [tasks]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "hrc_task.h"
+#include "hrc_taskqueue.h"
+
+#define N        100000
+#define UPDATES  10           /* priority updates per task */
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double rnd(void)
+{
+  return (double) rand() / RAND_MAX;
+}
+
+int main(int argc, char **argv)
+{
+  int i, n = N, errors = 0;
+  double t0, t1, last;
+  lpel_task_t *tasks, *t;
+  taskqueue_t *tq;
+
+  if (argc > 1) n = atoi(argv[1]);
+  tasks = (lpel_task_t *) calloc(n, sizeof(lpel_task_t));
+  for (i = 0; i < n; i++) {
+    tasks[i].sched_info.valid = 1;
+    tasks[i].sched_info.qpos = -1;
+    tasks[i].sched_info.prio = rnd();
+  }
+  tq = LpelTaskqueueInit();
+
+  t0 = now();
+  for (i = 0; i < n; i++)
+    LpelTaskqueuePush(tq, &tasks[i]);
+  t1 = now();
+  printf("push      %8d: %8.3f ms\n", n, (t1 - t0) * 1e3);
+
+  t0 = now();
+  for (i = 0; i < UPDATES * n; i++)
+    LpelTaskqueueUpdatePriority(tq, &tasks[rand() % n], rnd());
+  t1 = now();
+  printf("update    %8d: %8.3f ms\n", UPDATES * n, (t1 - t0) * 1e3);
+
+  t0 = now();
+  for (i = 0; i < n / 2; i++) {
+    t = &tasks[rand() % n];
+    if (t->sched_info.qpos >= 0) {
+      LpelTaskqueueOccupyTask(tq, t);
+      LpelTaskqueuePush(tq, t);
+    }
+  }
+  t1 = now();
+  printf("remove    %8d: %8.3f ms\n", n / 2, (t1 - t0) * 1e3);
+
+  t0 = now();
+  last = 2.0;
+  for (i = 0; (t = LpelTaskqueuePop(tq)) != NULL; i++) {
+    if (t->sched_info.prio > last) errors++;
+    last = t->sched_info.prio;
+  }
+  t1 = now();
+  printf("pop       %8d: %8.3f ms\n", i, (t1 - t0) * 1e3);
+
+  LpelTaskqueueDestroy(tq);
+  free(tasks);
+
+  if (i != n || errors > 0) {
+    printf("FAILED: %d tasks popped, %d out of order\n", i, errors);
+    return 1;
+  }
+  return 0;
+}
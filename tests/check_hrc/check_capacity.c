@@ -0,0 +1,235 @@
+/*
+ * Regression test for bounded middle streams
+ *
+ * A source feeds p pipelines of s stages, all middle streams have a
+ * small capacity. The producer of a full stream is queued as invalid,
+ * it has to be re-evaluated when its consumer reads from the stream or
+ * closes it, otherwise LpelCleanup() never returns.
+ *
+ * The stages yield after rec_limit records, right after a write which
+ * may have filled the stream. Each run is done in a child process, a run
+ * which does not finish within the timeout fails.
+ *
+ * usage: check_capacity [-r runs] [-n records] [-p pipelines] [-s stages]
+ *                       [-c capacity] [-R rec_limit] [-w workers] [-t timeout_s]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <hrc_lpel.h>
+
+#define MAX_STAGES  8
+#define MAX_PIPES   8
+
+static int num_runs = 40;
+static int num_rec = 2000;
+static int num_pipes = 3;
+static int num_stages = 3;
+static int capacity = 4;
+static int rec_limit = 1;
+static int num_workers = 3;
+static int timeout = 20;
+
+static int *recs;
+static int term_rec;
+static lpel_stream_t *streams[MAX_PIPES][MAX_STAGES + 1];
+static volatile int run_failed;
+
+typedef struct {
+  lpel_stream_t *in, *out;
+  int stage;
+} stage_arg_t;
+static stage_arg_t stage_args[MAX_PIPES][MAX_STAGES];
+
+
+static uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* later stages are slower, so that the streams before them fill up */
+static void spin(int stage)
+{
+  uint64_t end = now() + 1000 * (1 + stage);
+  while (now() < end);
+}
+
+
+static void *Source(void *arg)
+{
+  lpel_stream_desc_t *out[MAX_PIPES];
+  int i;
+  (void) arg;
+
+  for (i=0; i<num_pipes; i++) out[i] = LpelStreamOpen(streams[i][0], 'w');
+  for (i=0; i<num_rec; i++) {
+    recs[i] = i;
+    LpelStreamWrite(out[i % num_pipes], &recs[i]);
+  }
+  for (i=0; i<num_pipes; i++) {
+    LpelStreamWrite(out[i], &term_rec);
+    LpelStreamClose(out[i], 0);
+  }
+  return NULL;
+}
+
+static void *Stage(void *arg)
+{
+  stage_arg_t *sa = (stage_arg_t *) arg;
+  lpel_stream_desc_t *in = LpelStreamOpen(sa->in, 'r');
+  lpel_stream_desc_t *out = LpelStreamOpen(sa->out, 'w');
+  int *r;
+
+  do {
+    r = (int *) LpelStreamRead(in);
+    if (r != &term_rec) spin(sa->stage);
+    LpelStreamWrite(out, r);
+  } while (r != &term_rec);
+
+  LpelStreamClose(in, 1);
+  LpelStreamClose(out, 0);
+  return NULL;
+}
+
+static void *Sink(void *arg)
+{
+  lpel_streamset_t set = NULL;
+  lpel_stream_desc_t *in[MAX_PIPES], *sd;
+  int next[MAX_PIPES];
+  int i, terms = 0;
+  int *r;
+  (void) arg;
+
+  for (i=0; i<num_pipes; i++) {
+    in[i] = LpelStreamOpen(streams[i][num_stages], 'r');
+    LpelStreamsetPut(&set, in[i]);
+    next[i] = i;
+  }
+
+  while (terms < num_pipes) {
+    sd = LpelStreamPoll(&set);
+    r = (int *) LpelStreamRead(sd);
+    if (r == &term_rec) {
+      terms++;
+      continue;
+    }
+    /* the records of a pipeline arrive in order */
+    if (*r != next[*r % num_pipes]) run_failed = 1;
+    next[*r % num_pipes] += num_pipes;
+  }
+  for (i=0; i<num_pipes; i++) {
+    if (next[i] < num_rec) run_failed = 1;
+  }
+
+  /* a closed descriptor is recycled, do not iterate the set */
+  for (i=0; i<num_pipes; i++) LpelStreamClose(in[i], 1);
+  LpelStop();
+  return NULL;
+}
+
+
+static int runOnce(void)
+{
+  lpel_config_t cfg;
+  lpel_task_t *t;
+  int i, j;
+
+  recs = (int *) malloc(num_rec * sizeof(int));
+  memset(&cfg, 0, sizeof(lpel_config_t));
+  cfg.num_workers = num_workers;
+  cfg.proc_workers = num_workers;
+  if (cfg.proc_workers > sysconf(_SC_NPROCESSORS_ONLN))
+    cfg.proc_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  cfg.proc_others = 0;
+  cfg.type = HRC_LPEL;
+
+  LpelInit(&cfg);
+  if (LpelStart(&cfg)) {
+    fprintf(stderr, "could not start\n");
+    return 1;
+  }
+
+  LpelStreamCapacityInit(capacity);
+  for (i=0; i<num_pipes; i++)
+    for (j=0; j<=num_stages; j++)
+      streams[i][j] = LpelStreamCreate(0);
+
+  LpelTaskStart(LpelTaskCreate(LPEL_MAP_SOSI, Sink, NULL, 0, NULL));
+  for (i=0; i<num_pipes; i++) {
+    for (j=0; j<num_stages; j++) {
+      stage_args[i][j].in = streams[i][j];
+      stage_args[i][j].out = streams[i][j+1];
+      stage_args[i][j].stage = j;
+      t = LpelTaskCreate(0, Stage, &stage_args[i][j], 0, NULL);
+      LpelTaskSetRecLimit(t, rec_limit);
+      LpelTaskStart(t);
+    }
+  }
+  LpelTaskStart(LpelTaskCreate(LPEL_MAP_SOSI, Source, NULL, 0, NULL));
+
+  LpelCleanup();
+  free(recs);
+  return run_failed;
+}
+
+/* run in a child process, which may hang */
+static int runIsolated(void)
+{
+  int status;
+  pid_t pid;
+
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0) return 1;
+  if (pid == 0) {
+    alarm(timeout);
+    _exit(runOnce());
+  }
+  if (waitpid(pid, &status, 0) != pid) return 1;
+  if (WIFSIGNALED(status)) {
+    printf("run %s\n", WTERMSIG(status) == SIGALRM ? "hangs" : "crashed");
+    return 1;
+  }
+  return WEXITSTATUS(status);
+}
+
+
+int main(int argc, char **argv)
+{
+  int i, c, failed = 0;
+
+  while ((c = getopt(argc, argv, "r:n:p:s:c:R:w:t:")) != -1) {
+    switch (c) {
+    case 'r': num_runs = atoi(optarg); break;
+    case 'n': num_rec = atoi(optarg); break;
+    case 'p': num_pipes = atoi(optarg); break;
+    case 's': num_stages = atoi(optarg); break;
+    case 'c': capacity = atoi(optarg); break;
+    case 'R': rec_limit = atoi(optarg); break;
+    case 'w': num_workers = atoi(optarg); break;
+    case 't': timeout = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-r runs] [-n records] [-p pipelines] "
+          "[-s stages] [-c capacity] [-R rec_limit] [-w workers] [-t timeout_s]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (num_pipes < 1 || num_pipes > MAX_PIPES
+      || num_stages < 1 || num_stages > MAX_STAGES) {
+    fprintf(stderr, "at most %d pipelines of %d stages\n", MAX_PIPES, MAX_STAGES);
+    return 1;
+  }
+
+  for (i=0; i<num_runs; i++) {
+    failed += (runIsolated() != 0);
+  }
+  printf("%d of %d runs failed\n", failed, num_runs);
+  return (failed > 0) ? 1 : 0;
+}
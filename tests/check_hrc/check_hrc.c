@@ -133,6 +133,7 @@ static void testBasic(void)
   lpel_task_t *intask, *outtask;
   mon_task_t *mt;
 
+  memset(&cfg, 0, sizeof(lpel_config_t));
   cfg.num_workers = 2;
   cfg.proc_workers = 2;
   cfg.proc_others = 0;
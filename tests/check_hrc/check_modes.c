@@ -0,0 +1,262 @@
+/*
+ * Test of the optional scheduling modes of HRC
+ *
+ * A source feeds p pipelines of s stages, a sink checks that all records
+ * arrive, in order per pipeline. The pipeline is run once per mode, each
+ * in a child process, as the modes are configured once before LpelStart().
+ * A run which does not finish within the timeout fails.
+ *
+ * usage: check_modes [-m mode] [-n records] [-p pipelines] [-s stages]
+ *                    [-R rec_limit] [-w workers] [-t timeout_s]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <hrc_lpel.h>
+
+#define MAX_STAGES  8
+#define MAX_PIPES   8
+
+static int num_rec = 5000;
+static int num_pipes = 3;
+static int num_stages = 3;
+static int rec_limit = 4;
+static int num_workers = 3;
+static int timeout = 30;
+
+static int *recs;
+static int term_rec;
+static lpel_stream_t *streams[MAX_PIPES][MAX_STAGES + 1];
+static volatile int run_failed;
+
+
+static void setupDefault(lpel_config_t *cfg)
+{
+  (void) cfg;
+}
+
+static void setupMasterless(lpel_config_t *cfg)
+{
+  cfg->flags |= LPEL_FLAG_MASTERLESS;
+}
+
+/* stale 0 also returns prefetched tasks to the master */
+static void setupPrefetch(lpel_config_t *cfg)
+{
+  (void) cfg;
+  LpelTaskPrefetchInit(3, 0.0);
+}
+
+static void setupLocality(lpel_config_t *cfg)
+{
+  (void) cfg;
+  LpelTaskLocalityInit(0.5);
+}
+
+/* the stages yield after a slice instead of rec_limit records */
+static void setupSlice(lpel_config_t *cfg)
+{
+  (void) cfg;
+  LpelTaskSliceInit(20);
+}
+
+/* a small target, so that the credit of the first stages is cut */
+static void setupAdmission(lpel_config_t *cfg)
+{
+  lpel_admission_config_t conf;
+  (void) cfg;
+  memset(&conf, 0, sizeof(lpel_admission_config_t));
+  conf.interval = 1;
+  conf.target_inflight = 4;
+  conf.min_credit = 1;
+  LpelAdmissionInit(&conf);
+}
+
+typedef struct {
+  const char *name;
+  void (*setup)(lpel_config_t *cfg);	/* called before LpelStart() */
+} run_mode_t;
+
+static const run_mode_t modes[] = {
+  { "default",    setupDefault },
+  { "masterless", setupMasterless },
+  { "prefetch",   setupPrefetch },
+  { "locality",   setupLocality },
+  { "slice",      setupSlice },
+  { "admission",  setupAdmission },
+};
+#define NUM_MODES  ((int) (sizeof(modes) / sizeof(modes[0])))
+
+
+static void *Source(void *arg)
+{
+  lpel_stream_desc_t *out[MAX_PIPES];
+  int i;
+  (void) arg;
+
+  for (i=0; i<num_pipes; i++) out[i] = LpelStreamOpen(streams[i][0], 'w');
+  for (i=0; i<num_rec; i++) {
+    recs[i] = i;
+    LpelStreamWrite(out[i % num_pipes], &recs[i]);
+  }
+  for (i=0; i<num_pipes; i++) {
+    LpelStreamWrite(out[i], &term_rec);
+    LpelStreamClose(out[i], 0);
+  }
+  return NULL;
+}
+
+static void *Stage(void *arg)
+{
+  lpel_stream_t **s = (lpel_stream_t **) arg;
+  lpel_stream_desc_t *in = LpelStreamOpen(s[0], 'r');
+  lpel_stream_desc_t *out = LpelStreamOpen(s[1], 'w');
+  int *r;
+
+  do {
+    r = (int *) LpelStreamRead(in);
+    LpelStreamWrite(out, r);
+  } while (r != &term_rec);
+
+  LpelStreamClose(in, 1);
+  LpelStreamClose(out, 0);
+  return NULL;
+}
+
+static void *Sink(void *arg)
+{
+  lpel_streamset_t set = NULL;
+  lpel_stream_desc_t *in[MAX_PIPES], *sd;
+  int next[MAX_PIPES];
+  int i, terms = 0;
+  int *r;
+  (void) arg;
+
+  for (i=0; i<num_pipes; i++) {
+    in[i] = LpelStreamOpen(streams[i][num_stages], 'r');
+    LpelStreamsetPut(&set, in[i]);
+    next[i] = i;
+  }
+
+  while (terms < num_pipes) {
+    sd = LpelStreamPoll(&set);
+    r = (int *) LpelStreamRead(sd);
+    if (r == &term_rec) {
+      terms++;
+      continue;
+    }
+    /* the records of a pipeline arrive in order */
+    if (*r != next[*r % num_pipes]) run_failed = 1;
+    next[*r % num_pipes] += num_pipes;
+  }
+  for (i=0; i<num_pipes; i++) {
+    if (next[i] < num_rec) run_failed = 1;
+  }
+
+  /* a closed descriptor is recycled, do not iterate the set */
+  for (i=0; i<num_pipes; i++) LpelStreamClose(in[i], 1);
+  LpelStop();
+  return NULL;
+}
+
+
+static int runOnce(const run_mode_t *mode)
+{
+  lpel_config_t cfg;
+  lpel_task_t *t;
+  int i, j;
+
+  recs = (int *) malloc(num_rec * sizeof(int));
+  memset(&cfg, 0, sizeof(lpel_config_t));
+  cfg.num_workers = num_workers;
+  cfg.proc_workers = num_workers;
+  if (cfg.proc_workers > sysconf(_SC_NPROCESSORS_ONLN))
+    cfg.proc_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  cfg.proc_others = 0;
+  cfg.type = HRC_LPEL;
+  mode->setup(&cfg);
+
+  LpelInit(&cfg);
+  if (LpelStart(&cfg)) {
+    fprintf(stderr, "could not start\n");
+    return 1;
+  }
+
+  for (i=0; i<num_pipes; i++)
+    for (j=0; j<=num_stages; j++)
+      streams[i][j] = LpelStreamCreate(0);
+
+  LpelTaskStart(LpelTaskCreate(LPEL_MAP_SOSI, Sink, NULL, 0, NULL));
+  for (i=0; i<num_pipes; i++) {
+    for (j=0; j<num_stages; j++) {
+      t = LpelTaskCreate(0, Stage, &streams[i][j], 0, NULL);
+      LpelTaskSetRecLimit(t, rec_limit);
+      LpelTaskStart(t);
+    }
+  }
+  LpelTaskStart(LpelTaskCreate(LPEL_MAP_SOSI, Source, NULL, 0, NULL));
+
+  LpelCleanup();
+  free(recs);
+  return run_failed;
+}
+
+/* run in a child process, which may hang */
+static int runIsolated(const run_mode_t *mode)
+{
+  int status;
+  pid_t pid;
+
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0) return 1;
+  if (pid == 0) {
+    alarm(timeout);
+    _exit(runOnce(mode));
+  }
+  if (waitpid(pid, &status, 0) != pid) return 1;
+  if (WIFSIGNALED(status)) {
+    printf("%s: run %s\n", mode->name, WTERMSIG(status) == SIGALRM ? "hangs" : "crashed");
+    return 1;
+  }
+  return WEXITSTATUS(status);
+}
+
+
+int main(int argc, char **argv)
+{
+  const char *only = NULL;
+  int i, c, res, failed = 0;
+
+  while ((c = getopt(argc, argv, "m:n:p:s:R:w:t:")) != -1) {
+    switch (c) {
+    case 'm': only = optarg; break;
+    case 'n': num_rec = atoi(optarg); break;
+    case 'p': num_pipes = atoi(optarg); break;
+    case 's': num_stages = atoi(optarg); break;
+    case 'R': rec_limit = atoi(optarg); break;
+    case 'w': num_workers = atoi(optarg); break;
+    case 't': timeout = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-m mode] [-n records] [-p pipelines] "
+          "[-s stages] [-R rec_limit] [-w workers] [-t timeout_s]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (num_pipes < 1 || num_pipes > MAX_PIPES
+      || num_stages < 1 || num_stages > MAX_STAGES) {
+    fprintf(stderr, "at most %d pipelines of %d stages\n", MAX_PIPES, MAX_STAGES);
+    return 1;
+  }
+
+  for (i=0; i<NUM_MODES; i++) {
+    if (only != NULL && strcmp(only, modes[i].name) != 0) continue;
+    res = runIsolated(&modes[i]);
+    printf("%s: %s\n", modes[i].name, res ? "FAILED" : "ok");
+    failed += (res != 0);
+  }
+  return (failed > 0) ? 1 : 0;
+}
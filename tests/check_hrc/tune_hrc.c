@@ -0,0 +1,459 @@
+/*
+ * Tuning driver for the priority configuration of HRC
+ *
+ * Runs a workload under each combination of prio_index, neg_demand_lim
+ * and record limit, measures throughput, latency percentiles and peak
+ * memory, and reports the best configuration.
+ *
+ * The workload consists of a source, p parallel pipelines of stages and
+ * a sink. The cost of a stage per record is either given per stage (-s)
+ * or recorded per record and stage in a file (-f, one line per record
+ * with the costs of the stages in us, the records are replayed cyclically).
+ *
+ * Each configuration runs in its own process. With -l all of them run
+ * in one process, switched online by LpelTaskPrioSwitch() after every n
+ * records, as a tuner would do against a live network (the record limit
+ * of running tasks cannot be switched, only the first one is used).
+ *
+ * usage: tune_hrc [-n records] [-p pipelines] [-s cost,cost,..] [-f file]
+ *                 [-i interarrival_us] [-w workers] [-d domains]
+ *                 [-P prio,..] [-L neg_demand_lim,..] [-R rec_limit,..]
+ *                 [-o tput|p50|p99|mem] [-t timeout_s] [-l]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <hrc_lpel.h>
+
+#define MAX_LIST    32
+#define MAX_STAGES  16
+#define MAX_PIPES   16
+
+typedef struct {
+  uint64_t born;
+  int id;
+} rec_t;
+
+typedef struct {
+  int prio;
+  int demand_lim;
+  int rec_limit;
+} tune_conf_t;
+
+typedef struct {
+  int ok;
+  double secs;            /* duration of the window */
+  double tput;            /* records per second */
+  double p50, p95, p99;   /* latency in us */
+  long peak_mem;          /* bytes in the streams */
+  long maxrss;            /* kB */
+} tune_result_t;
+
+/* workload */
+static int num_rec = 5000;
+static int num_pipes = 2;
+static int num_stages = 3;
+static double stage_cost[MAX_STAGES] = { 2, 10, 2 };
+static double *trace = NULL;      /* recorded costs, trace_len x num_stages */
+static int trace_len = 0;
+static int interarrival = 0;
+static int num_workers = 3;
+static int num_domains = 1;
+static int timeout = 60;
+
+/* state of a run */
+static rec_t *recs;
+static rec_t term_rec;
+static double *lat;
+static lpel_stream_t *streams[MAX_PIPES][MAX_STAGES + 1];
+static tune_conf_t *run_confs;
+static tune_result_t *run_results;
+static int run_windows;
+static volatile int run_done;
+
+typedef struct {
+  lpel_stream_t *in, *out;
+  int stage;
+} stage_arg_t;
+static stage_arg_t stage_args[MAX_PIPES][MAX_STAGES];
+
+
+static uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void spin(double us)
+{
+  uint64_t end = now() + (uint64_t) (us * 1000);
+  while (now() < end);
+}
+
+static long RecSize(void *item)
+{
+  (void) item;
+  return sizeof(rec_t);
+}
+
+/* all records are data, to apply the record limit */
+static int RecIsData(void *item)
+{
+  (void) item;
+  return 1;
+}
+
+
+static void *Source(void *arg)
+{
+  lpel_stream_desc_t *out[MAX_PIPES];
+  int i;
+  (void) arg;
+
+  for (i=0; i<num_pipes; i++) out[i] = LpelStreamOpen(streams[i][0], 'w');
+  for (i=0; i<num_rec * run_windows; i++) {
+    if (interarrival > 0) spin(interarrival);
+    recs[i].born = now();
+    recs[i].id = i;
+    LpelStreamWrite(out[i % num_pipes], &recs[i]);
+  }
+  for (i=0; i<num_pipes; i++) {
+    LpelStreamWrite(out[i], &term_rec);
+    LpelStreamClose(out[i], 0);
+  }
+  return NULL;
+}
+
+static void *Stage(void *arg)
+{
+  stage_arg_t *sa = (stage_arg_t *) arg;
+  lpel_stream_desc_t *in = LpelStreamOpen(sa->in, 'r');
+  lpel_stream_desc_t *out = LpelStreamOpen(sa->out, 'w');
+  rec_t *r;
+
+  do {
+    r = (rec_t *) LpelStreamRead(in);
+    if (r != &term_rec) {
+      if (trace != NULL)
+        spin(trace[(r->id % trace_len) * num_stages + sa->stage]);
+      else
+        spin(stage_cost[sa->stage]);
+    }
+    LpelStreamWrite(out, r);
+  } while (r != &term_rec);
+
+  LpelStreamClose(in, 1);
+  LpelStreamClose(out, 0);
+  return NULL;
+}
+
+
+static int cmpDouble(const void *a, const void *b)
+{
+  double d = *(const double *) a - *(const double *) b;
+  return (d > 0) - (d < 0);
+}
+
+/* from the latencies of the records completed in the window, sorted in place */
+static void finishWindow(tune_result_t *res, double *l, int n)
+{
+  qsort(l, n, sizeof(double), cmpDouble);
+  res->ok = 1;
+  res->tput = n / res->secs;
+  res->p50 = l[n / 2];
+  res->p95 = l[(int) (n * 0.95)];
+  res->p99 = l[(int) (n * 0.99)];
+}
+
+static void *Sink(void *arg)
+{
+  lpel_streamset_t set = NULL;
+  lpel_stream_desc_t *in[MAX_PIPES], *sd;
+  int i, terms = 0, cnt = 0, win = 0;
+  long peak = 0, mem;
+  uint64_t start = now();
+  rec_t *r;
+  (void) arg;
+
+  for (i=0; i<num_pipes; i++) {
+    in[i] = LpelStreamOpen(streams[i][num_stages], 'r');
+    LpelStreamsetPut(&set, in[i]);
+  }
+
+  while (terms < num_pipes) {
+    sd = LpelStreamPoll(&set);
+    r = (rec_t *) LpelStreamRead(sd);
+    if (r == &term_rec) {
+      terms++;
+      continue;
+    }
+    lat[cnt] = (now() - r->born) * 1e-3;
+    mem = LpelMemoryUsage();
+    if (mem > peak) peak = mem;
+
+    /* the stack of a task is small, the window is evaluated afterwards */
+    if (++cnt % num_rec == 0) {
+      run_results[win].secs = (now() - start) * 1e-9;
+      run_results[win].peak_mem = peak;
+      /* next configuration, online */
+      if (++win < run_windows) {
+        lpel_task_prio_conf pc;
+        memset(&pc, 0, sizeof(pc));
+        pc.prio_index = run_confs[win].prio;
+        pc.neg_demand_lim = run_confs[win].demand_lim;
+        LpelTaskPrioSwitch(&pc);
+      }
+      start = now();
+      peak = 0;
+    }
+  }
+
+  /* a closed descriptor is recycled, do not iterate the set */
+  for (i=0; i<num_pipes; i++) LpelStreamClose(in[i], 1);
+  run_done = 1;
+  return NULL;
+}
+
+
+/* run the workload under confs[0..n-1], one window of num_rec records each */
+static void runWorkload(tune_conf_t *confs, tune_result_t *results, int n)
+{
+  lpel_config_t cfg;
+  lpel_memory_config_t mc = { 1L << 50, 1.0, 0.99 };   /* count only */
+  lpel_task_t *t;
+  struct rusage ru;
+  int i, j;
+
+  run_confs = confs;
+  run_results = results;
+  run_windows = n;
+  run_done = 0;
+  memset(results, 0, n * sizeof(tune_result_t));
+  recs = (rec_t *) malloc(num_rec * n * sizeof(rec_t));
+  lat = (double *) malloc(num_rec * n * sizeof(double));
+
+  memset(&cfg, 0, sizeof(lpel_config_t));
+  cfg.num_workers = num_workers;
+  cfg.proc_workers = num_workers;
+  if (cfg.proc_workers > sysconf(_SC_NPROCESSORS_ONLN))
+    cfg.proc_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  cfg.proc_others = 0;
+  cfg.type = HRC_LPEL;
+  cfg.num_domains = num_domains;
+  cfg.mon.rectype_data = RecIsData;
+  cfg.mon.rec_size = RecSize;
+  cfg.prio_config.prio_index = confs[0].prio;
+  cfg.prio_config.neg_demand_lim = confs[0].demand_lim;
+  LpelMemoryBudgetInit(&mc);
+
+  LpelInit(&cfg);
+  if (LpelStart(&cfg)) {
+    fprintf(stderr, "could not start\n");
+    exit(1);
+  }
+
+  for (i=0; i<num_pipes; i++)
+    for (j=0; j<=num_stages; j++)
+      streams[i][j] = LpelStreamCreate(0);
+
+  LpelTaskStart(LpelTaskCreate(LPEL_MAP_SOSI, Sink, NULL, 0, NULL));
+  for (i=0; i<num_pipes; i++) {
+    for (j=0; j<num_stages; j++) {
+      stage_args[i][j].in = streams[i][j];
+      stage_args[i][j].out = streams[i][j+1];
+      stage_args[i][j].stage = j;
+      t = LpelTaskCreate(0, Stage, &stage_args[i][j], 0, NULL);
+      LpelTaskSetRecLimit(t, confs[0].rec_limit);
+      LpelTaskStart(t);
+    }
+  }
+  LpelTaskStart(LpelTaskCreate(LPEL_MAP_SOSI, Source, NULL, 0, NULL));
+
+  while (!run_done) usleep(10000);
+  LpelStop();
+  LpelCleanup();
+
+  getrusage(RUSAGE_SELF, &ru);
+  for (i=0; i<n; i++) {
+    finishWindow(&results[i], &lat[i * num_rec], num_rec);
+    results[i].maxrss = ru.ru_maxrss;
+  }
+  free(recs);
+  free(lat);
+}
+
+/* run one configuration in a child process, which may hang or crash */
+static void runIsolated(tune_conf_t *conf, tune_result_t *res)
+{
+  int fd[2], status;
+  pid_t pid;
+
+  memset(res, 0, sizeof(*res));
+  if (pipe(fd) != 0) return;
+  fflush(stdout);
+  pid = fork();
+  if (pid == 0) {
+    close(fd[0]);
+    alarm(timeout);
+    runWorkload(conf, res, 1);
+    if (write(fd[1], res, sizeof(*res)) != sizeof(*res)) _exit(1);
+    _exit(0);
+  }
+  close(fd[1]);
+  if (pid < 0 || read(fd[0], res, sizeof(*res)) != sizeof(*res))
+    res->ok = 0;
+  close(fd[0]);
+  if (pid > 0) waitpid(pid, &status, 0);
+}
+
+
+static int parseList(char *s, int *list)
+{
+  int n = 0;
+  char *tok;
+  for (tok = strtok(s, ","); tok && n < MAX_LIST; tok = strtok(NULL, ","))
+    list[n++] = atoi(tok);
+  return n;
+}
+
+static void readTrace(const char *file)
+{
+  FILE *f = fopen(file, "r");
+  char line[1024];
+  int alloc = 0;
+
+  if (f == NULL) {
+    perror(file);
+    exit(1);
+  }
+  num_stages = 0;
+  while (fgets(line, sizeof(line), f)) {
+    double c[MAX_STAGES];
+    int k = 0;
+    char *tok;
+    for (tok = strtok(line, " \t\n"); tok && k < MAX_STAGES; tok = strtok(NULL, " \t\n"))
+      c[k++] = atof(tok);
+    if (k == 0) continue;
+    if (num_stages == 0) num_stages = k;
+    if (k != num_stages) {
+      fprintf(stderr, "%s: %d stages expected\n", file, num_stages);
+      exit(1);
+    }
+    if (trace_len == alloc) {
+      alloc = (alloc == 0) ? 256 : 2 * alloc;
+      trace = (double *) realloc(trace, alloc * num_stages * sizeof(double));
+    }
+    memcpy(&trace[trace_len++ * num_stages], c, num_stages * sizeof(double));
+  }
+  fclose(f);
+  if (trace_len == 0) {
+    fprintf(stderr, "%s: empty\n", file);
+    exit(1);
+  }
+}
+
+/* the higher the better */
+static double score(tune_result_t *r, const char *objective)
+{
+  if (!r->ok) return -1e300;
+  if (strcmp(objective, "p50") == 0) return -r->p50;
+  if (strcmp(objective, "p99") == 0) return -r->p99;
+  if (strcmp(objective, "mem") == 0) return -(double) r->peak_mem;
+  return r->tput;
+}
+
+
+int main(int argc, char **argv)
+{
+  int prios[MAX_LIST] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 18, 19 };
+  int lims[MAX_LIST] = { 0, 8 };
+  int rlims[MAX_LIST] = { -1, 16 };
+  int np = 18, nl = 2, nr = 2;
+  int live = 0, i, j, k, n, best = -1, opt;
+  const char *objective = "tput";
+  tune_conf_t *confs;
+  tune_result_t *results;
+
+  while ((opt = getopt(argc, argv, "n:p:s:f:i:w:d:P:L:R:o:t:l")) != -1) {
+    switch (opt) {
+    case 'n': num_rec = atoi(optarg); break;
+    case 'p': num_pipes = atoi(optarg); break;
+    case 's': {
+        char *tok;
+        num_stages = 0;
+        for (tok = strtok(optarg, ","); tok && num_stages < MAX_STAGES; tok = strtok(NULL, ","))
+          stage_cost[num_stages++] = atof(tok);
+      }
+      break;
+    case 'f': readTrace(optarg); break;
+    case 'i': interarrival = atoi(optarg); break;
+    case 'w': num_workers = atoi(optarg); break;
+    case 'd': num_domains = atoi(optarg); break;
+    case 'P': np = parseList(optarg, prios); break;
+    case 'L': nl = parseList(optarg, lims); break;
+    case 'R': nr = parseList(optarg, rlims); break;
+    case 'o': objective = optarg; break;
+    case 't': timeout = atoi(optarg); break;
+    case 'l': live = 1; break;
+    default:
+      fprintf(stderr, "usage: %s [-n records] [-p pipelines] [-s cost,..] [-f file]"
+          " [-i us] [-w workers] [-d domains] [-P prio,..] [-L lim,..] [-R lim,..]"
+          " [-o tput|p50|p99|mem] [-t s] [-l]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (num_pipes < 1) num_pipes = 1;
+  if (num_pipes > MAX_PIPES) num_pipes = MAX_PIPES;
+  if (num_rec < 100) num_rec = 100;
+  if (live) nr = 1;
+
+  /* location-based priority needs the rts */
+  n = 0;
+  confs = (tune_conf_t *) malloc(np * nl * nr * sizeof(tune_conf_t));
+  for (i=0; i<np; i++) {
+    if (prios[i] == 15) continue;
+    for (j=0; j<nl; j++)
+      for (k=0; k<nr; k++) {
+        confs[n].prio = prios[i];
+        confs[n].demand_lim = lims[j];
+        confs[n].rec_limit = rlims[k];
+        n++;
+      }
+  }
+  results = (tune_result_t *) calloc(n, sizeof(tune_result_t));
+
+  if (live)
+    runWorkload(confs, results, n);
+  else
+    for (i=0; i<n; i++) runIsolated(&confs[i], &results[i]);
+
+  printf("%5s %6s %6s %12s %10s %10s %10s %10s %10s\n", "prio", "demand", "reclim",
+      "rec/s", "p50 us", "p95 us", "p99 us", "mem B", "rss kB");
+  for (i=0; i<n; i++) {
+    tune_result_t *r = &results[i];
+    printf("%5d %6d %6d ", confs[i].prio, confs[i].demand_lim, confs[i].rec_limit);
+    if (!r->ok) {
+      printf("%12s\n", "failed");
+      continue;
+    }
+    printf("%12.0f %10.1f %10.1f %10.1f %10ld %10ld\n", r->tput, r->p50, r->p95, r->p99,
+        r->peak_mem, r->maxrss);
+    if (best < 0 || score(r, objective) > score(&results[best], objective))
+      best = i;
+  }
+  if (best >= 0)
+    printf("best (%s): prio_index %d, neg_demand_lim %d, rec_limit %d\n", objective,
+        confs[best].prio, confs[best].demand_lim, confs[best].rec_limit);
+
+  free(confs);
+  free(results);
+  free(trace);
+  return (best >= 0) ? 0 : 1;
+}